@@ -6,3 +6,19 @@ coverage: test clean-coverage
 	@$(LCOV) --directory . --capture --base-directory=. --output-file .coverage
 	@$(GENHTML) --legend --output-directory coverage/ --title "pecl/apc code coverage" .coverage
 
+
+all: $(APCU_INSPECT)
+
+apcu-inspect: $(srcdir)/apc_inspect.c $(srcdir)/apc_sma.h $(srcdir)/apc_cache_api.h
+	$(CC) $(COMMON_FLAGS) $(CFLAGS_CLEAN) $(EXTRA_CFLAGS) $(APCU_CFLAGS) -I$(srcdir) -o $@ $(srcdir)/apc_inspect.c $(APCU_SHARED_LIBADD)
+
+install-apcu-inspect: $(APCU_INSPECT)
+	@test -z "$(APCU_INSPECT)" || $(mkinstalldirs) $(INSTALL_ROOT)$(bindir)
+	@test -z "$(APCU_INSPECT)" || $(INSTALL) -m 0755 apcu-inspect $(INSTALL_ROOT)$(bindir)/apcu-inspect
+
+install: install-apcu-inspect
+
+clean: clean-apcu-inspect
+
+clean-apcu-inspect:
+	@rm -f apcu-inspect
@@ -28,18 +28,34 @@
 
  */
 
+#include "php_apc.h"
 #include "apc_cache.h"
 #include "apc_sma.h"
 #include "apc_globals.h"
 #include "apc_strings.h"
+#include "apc_mmap.h"
 #include "php_scandir.h"
 #include "SAPI.h"
 #include "TSRM.h"
 #include "php_main.h"
 #include "ext/standard/md5.h"
+#include "ext/standard/php_lcg.h"
 #include "ext/standard/php_var.h"
 #include "zend_smart_str.h"
 
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#else
+# include <sys/time.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+#endif
+
+#ifdef APC_PRELOAD_THREADS
+# include <pthread.h>
+#endif
+
 #if PHP_VERSION_ID < 70300
 # define GC_SET_REFCOUNT(ref, rc) (GC_REFCOUNT(ref) = (rc))
 # define GC_ADDREF(ref) GC_REFCOUNT(ref)++
@@ -50,14 +66,31 @@
  * increments without atomics. */
 #ifdef APC_LOCK_RECURSIVE
 # define ATOMIC_INC_RLOCKED(a) (a)++
+# define ATOMIC_ADD_RLOCKED(a, b) (a) += (b)
 #else
 # define ATOMIC_INC_RLOCKED(a) ATOMIC_INC(a)
+# define ATOMIC_ADD_RLOCKED(a, b) ATOMIC_ADD(a, b)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+# define APC_PREFETCH(p) __builtin_prefetch(p)
+#else
+# define APC_PREFETCH(p)
 #endif
 
 /* Defined in apc_persist.c */
-apc_cache_entry_t *apc_persist(
-		apc_sma_t *sma, apc_serializer_t *serializer, const apc_cache_entry_t *orig_entry);
-zend_bool apc_unpersist(zval *dst, const zval *value, apc_serializer_t *serializer);
+apc_cache_entry_t *apc_persist(apc_cache_t *cache, const apc_cache_entry_t *orig_entry);
+zend_bool apc_unpersist(zval *dst, const zval *value, apc_cache_t *cache);
+zend_bool apc_persist_rebase(apc_cache_t *cache, apc_cache_entry_t *entry, size_t size, const void *from, void *to);
+zval *apc_persist_local(const zval *value, size_t limit, size_t *size);
+
+static void apc_cache_wlocked_lazy_claim(apc_cache_t *cache, zend_string *key);
+static void apc_cache_wlocked_lazy_claim_all(apc_cache_t *cache, zend_string *prefix);
+static zend_long apc_cache_wlocked_lazy_claim_matching(
+		apc_cache_t *cache, apc_cache_entry_predicate_t predicate, void *data);
+static zend_long apc_cache_wlocked_lazy_claim_tagged(apc_cache_t *cache, zend_string **tags, uint32_t ntags);
+static void apc_cache_lazy_load(apc_cache_t *cache, zend_string *key, time_t t);
+static void apc_cache_lazy_load_prefix(apc_cache_t *cache, zend_string *prefix, time_t t);
 
 /* {{{ make_prime */
 static int const primes[] = {
@@ -108,8 +141,29 @@ static int make_prime(int n)
 }
 /* }}} */
 
+/* Statistics counters of the shard owned by this worker */
+#define APC_CACHE_STATS(cache) ((cache)->header->stats[APCG(stats_shard)])
+
+/* {{{ apc_cache_entry_alloc
+   Allocates size bytes for an entry and what follows it, starting on a cache line.
+   The SMA only aligns to a word, the offset of the entry in its block is stored
+   in the word before it. Entries must be freed with free_entry. */
+apc_cache_entry_t *apc_cache_entry_alloc(apc_cache_t *cache, size_t size) {
+	char *block = apc_sma_malloc(cache->sma, size + APC_CACHE_LINE_SIZE);
+	char *entry;
+
+	if (!block) {
+		return NULL;
+	}
+
+	entry = (char *) ZEND_MM_ALIGNED_SIZE_EX((uintptr_t) block + sizeof(size_t), APC_CACHE_LINE_SIZE);
+	((size_t *) entry)[-1] = entry - block;
+
+	return (apc_cache_entry_t *) entry;
+} /* }}} */
+
 static inline void free_entry(apc_cache_t *cache, apc_cache_entry_t *entry) {
-	apc_sma_free(cache->sma, entry);
+	apc_sma_free(cache->sma, (char *) entry - ((size_t *) entry)[-1]);
 }
 
 /* {{{ apc_cache_hash_slot
@@ -121,15 +175,22 @@ static inline void apc_cache_hash_slot(
 } /* }}} */
 
 static inline zend_bool apc_entry_key_equals(const apc_cache_entry_t *entry, zend_string *key, zend_ulong hash) {
-	return ZSTR_H(entry->key) == hash
+	return entry->hash == hash
 		&& ZSTR_LEN(entry->key) == ZSTR_LEN(key)
 		&& memcmp(ZSTR_VAL(entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0;
 }
 
+/* An entry is stale if it was inserted before the cache was last cleared.
+ * Stale entries are treated as expired, until they are swept from the slots. */
+static inline zend_bool apc_cache_entry_stale(apc_cache_t *cache, apc_cache_entry_t *entry) {
+	return entry->generation != cache->header->generation;
+}
+
 /* An entry is hard expired if the creation time if older than the per-entry TTL.
  * Hard expired entries must be treated indentially to non-existent entries. */
-static zend_bool apc_cache_entry_hard_expired(apc_cache_entry_t *entry, time_t t) {
-	return entry->ttl && (time_t) (entry->ctime + entry->ttl) < t;
+static zend_bool apc_cache_entry_hard_expired(apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return (entry->ttl && apc_cache_time_unpack(entry->ctime) + entry->ttl < t)
+		|| apc_cache_entry_stale(cache, entry);
 }
 
 /* An entry is soft expired if no per-entry TTL is set, a global cache TTL is set,
@@ -137,15 +198,129 @@ static zend_bool apc_cache_entry_hard_expired(apc_cache_entry_t *entry, time_t t
  * are accessible by lookup operation, but may be removed from the cache at any time. */
 static zend_bool apc_cache_entry_soft_expired(
 		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
-	return !entry->ttl && cache->ttl && (time_t) (entry->atime + cache->ttl) < t;
+	return !entry->ttl && cache->ttl && apc_cache_time_unpack(entry->atime) + cache->ttl < t;
+}
+
+/* An entry is grace expired once the grace period following its hard expiry is over.
+ * Until then apcu_entry() may keep serving it while it is being regenerated. */
+static zend_bool apc_cache_entry_grace_expired(apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return (entry->ttl && apc_cache_time_unpack(entry->ctime) + entry->ttl + entry->grace < t)
+		|| apc_cache_entry_stale(cache, entry);
 }
 
 static zend_bool apc_cache_entry_expired(
 		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
-	return apc_cache_entry_hard_expired(entry, t)
+	return apc_cache_entry_grace_expired(cache, entry, t)
 		|| apc_cache_entry_soft_expired(cache, entry, t);
 }
 
+/* Orders keys bytewise, shorter keys first */
+static inline int apc_cache_index_compare(const zend_string *key, const char *other, size_t other_len) {
+	size_t len = MIN(ZSTR_LEN(key), other_len);
+	int result = memcmp(ZSTR_VAL(key), other, len);
+
+	if (result) {
+		return result;
+	}
+	return ZSTR_LEN(key) < other_len ? -1 : ZSTR_LEN(key) > other_len;
+}
+
+static inline zend_bool apc_cache_key_has_prefix(const zend_string *key, const zend_string *prefix) {
+	return ZSTR_LEN(key) >= ZSTR_LEN(prefix)
+		&& memcmp(ZSTR_VAL(key), ZSTR_VAL(prefix), ZSTR_LEN(prefix)) == 0;
+}
+
+/* {{{ apc_cache_index_find
+ Returns the first entry of the prefix index not ordered before key. If links is given, it
+ receives the link pointing to that position on every level */
+static apc_cache_entry_t *apc_cache_index_find(
+		apc_cache_t *cache, const char *key, size_t len, apc_cache_entry_t ***links) {
+	/* successors of the current position, the index heads or the links of an entry */
+	apc_cache_entry_t **next = cache->header->index;
+	int level;
+
+	for (level = APC_CACHE_INDEX_LEVELS - 1; level >= 0; level--) {
+		while (next[level] && apc_cache_index_compare(next[level]->key, key, len) < 0) {
+			next = next[level]->index_next;
+		}
+		if (links) {
+			links[level] = &next[level];
+		}
+	}
+
+	return next[0];
+} /* }}} */
+
+static void apc_cache_wlocked_index_insert(apc_cache_t *cache, apc_cache_entry_t *entry) {
+	apc_cache_entry_t **links[APC_CACHE_INDEX_LEVELS];
+	uint32_t level;
+
+	if (!entry->index_level) {
+		return;
+	}
+
+	apc_cache_index_find(cache, ZSTR_VAL(entry->key), ZSTR_LEN(entry->key), links);
+	for (level = 0; level < entry->index_level; level++) {
+		entry->index_next[level] = *links[level];
+		*links[level] = entry;
+	}
+}
+
+static void apc_cache_wlocked_index_remove(apc_cache_t *cache, apc_cache_entry_t *entry) {
+	apc_cache_entry_t **links[APC_CACHE_INDEX_LEVELS];
+	uint32_t level;
+
+	if (!entry->index_level) {
+		return;
+	}
+
+	apc_cache_index_find(cache, ZSTR_VAL(entry->key), ZSTR_LEN(entry->key), links);
+	for (level = 0; level < entry->index_level; level++) {
+		if (*links[level] == entry) {
+			*links[level] = entry->index_next[level];
+		}
+	}
+}
+
+static inline apc_cache_tag_link_t **apc_cache_tag_bucket(apc_cache_t *cache, const zend_string *tag) {
+	return &cache->header->tags[ZSTR_H(tag) & (APC_CACHE_TAG_BUCKETS - 1)];
+}
+
+static void apc_cache_wlocked_tags_link(apc_cache_t *cache, apc_cache_entry_t *entry) {
+	uint32_t i;
+
+	for (i = 0; i < entry->ntags; i++) {
+		apc_cache_tag_link_t *link = &entry->tags[i];
+		apc_cache_tag_link_t **bucket = apc_cache_tag_bucket(cache, link->tag);
+
+		link->next = *bucket;
+		link->pprev = bucket;
+		if (*bucket) {
+			(*bucket)->pprev = &link->next;
+		}
+		*bucket = link;
+	}
+}
+
+static void apc_cache_wlocked_tags_unlink(apc_cache_entry_t *entry) {
+	uint32_t i;
+
+	for (i = 0; i < entry->ntags; i++) {
+		apc_cache_tag_link_t *link = &entry->tags[i];
+
+		if (!link->pprev) {
+			continue;
+		}
+
+		*link->pprev = link->next;
+		if (link->next) {
+			link->next->pprev = link->pprev;
+		}
+		link->next = NULL;
+		link->pprev = NULL;
+	}
+}
+
 /* {{{ apc_cache_wlocked_remove_entry  */
 static void apc_cache_wlocked_remove_entry(apc_cache_t *cache, apc_cache_entry_t **entry)
 {
@@ -154,20 +329,25 @@ static void apc_cache_wlocked_remove_entry(apc_cache_t *cache, apc_cache_entry_t
 	/* think here is safer */
 	*entry = (*entry)->next;
 
-	/* adjust header info */
-	if (cache->header->mem_size)
-		cache->header->mem_size -= dead->mem_size;
+	apc_cache_wlocked_index_remove(cache, dead);
+	apc_cache_wlocked_tags_unlink(dead);
+
+	/* adjust header info, stale entries were already discounted when the cache was cleared */
+	if (!apc_cache_entry_stale(cache, dead)) {
+		if (cache->header->mem_size)
+			cache->header->mem_size -= dead->mem_size;
 
-	if (cache->header->nentries)
-		cache->header->nentries--;
+		if (cache->header->nentries)
+			cache->header->nentries--;
+	}
 
 	/* remove if there are no references */
-	if (dead->ref_count <= 0) {
+	if (dead->ref_count <= 0 && dead->shared_count <= 0) {
 		free_entry(cache, dead);
 	} else {
 		/* add to gc if there are still refs */
 		dead->next = cache->header->gc;
-		dead->dtime = time(0);
+		dead->dtime = apc_cache_time_pack(time(0));
 		cache->header->gc = dead;
 	}
 }
@@ -180,6 +360,8 @@ static void apc_cache_wlocked_gc(apc_cache_t* cache)
 	 * entry whose reference count is zero  or that has been on the gc
 	 * list for more than cache->gc_ttl seconds
 	 *   (we issue a warning in the latter case).
+	 * Entries whose value is still referenced in place are never deleted,
+	 * whatever the time, see apc_cache_entry_hold.
 	 */
 	if (!cache->header->gc) {
 		return;
@@ -190,9 +372,9 @@ static void apc_cache_wlocked_gc(apc_cache_t* cache)
 		time_t now = time(0);
 
 		while (*entry != NULL) {
-			time_t gc_sec = cache->gc_ttl ? (now - (*entry)->dtime) : 0;
+			time_t gc_sec = cache->gc_ttl ? (now - apc_cache_time_unpack((*entry)->dtime)) : 0;
 
-			if (!(*entry)->ref_count || gc_sec > (time_t)cache->gc_ttl) {
+			if ((*entry)->shared_count <= 0 && (!(*entry)->ref_count || gc_sec > (time_t)cache->gc_ttl)) {
 				apc_cache_entry_t *dead = *entry;
 
 				/* good ol' whining */
@@ -216,6 +398,28 @@ static void apc_cache_wlocked_gc(apc_cache_t* cache)
 }
 /* }}} */
 
+/* Number of slots swept for stale entries on each insertion */
+#define APC_CACHE_SWEEP_SLOTS 64
+
+/* {{{ apc_cache_wlocked_sweep
+ Removes the stale entries of up to count slots, continuing where the last sweep stopped */
+static void apc_cache_wlocked_sweep(apc_cache_t *cache, zend_long count)
+{
+	while (count-- > 0 && cache->header->sweep_slot < cache->nslots) {
+		apc_cache_entry_t **entry = &cache->slots[cache->header->sweep_slot++];
+
+		while (*entry) {
+			if (apc_cache_entry_stale(cache, *entry)) {
+				apc_cache_wlocked_remove_entry(cache, entry);
+				continue;
+			}
+
+			entry = &(*entry)->next;
+		}
+	}
+}
+/* }}} */
+
 /* {{{ php serializer */
 PHP_APCU_API int APC_SERIALIZER_NAME(php) (APC_SERIALIZER_ARGS)
 {
@@ -268,6 +472,19 @@ PHP_APCU_API int APC_UNSERIALIZER_NAME(php) (APC_UNSERIALIZER_ARGS)
 	return 1;
 } /* }}} */
 
+/* {{{ apc_cache_create_locks */
+static void apc_cache_create_locks(apc_cache_t *cache) {
+	int i;
+
+	/* header lock */
+	CREATE_LOCK(&cache->header->lock);
+
+	/* key locks, serializing the generation of entries by apcu_entry */
+	for (i = 0; i < APC_CACHE_KEY_LOCKS; i++) {
+		CREATE_LOCK(&cache->header->key_locks[i]);
+	}
+} /* }}} */
+
 /* {{{ apc_cache_create */
 PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* serializer, zend_long size_hint, zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend) {
 	apc_cache_t* cache;
@@ -280,8 +497,8 @@ PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* ser
 	/* allocate pointer by normal means */
 	cache = pemalloc(sizeof(apc_cache_t), 1);
 
-	/* calculate cache size for shm allocation */
-	cache_size = sizeof(apc_cache_header_t) + nslots*sizeof(apc_cache_entry_t *);
+	/* calculate cache size for shm allocation, leaving room to align the header */
+	cache_size = APC_CACHE_LINE_SIZE + sizeof(apc_cache_header_t) + nslots*sizeof(apc_cache_entry_t *);
 
 	/* allocate shm */
 	cache->shmaddr = apc_sma_malloc(sma, cache_size);
@@ -294,19 +511,24 @@ PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* ser
 	/* zero cache header and hash slots */
 	memset(cache->shmaddr, 0, cache_size);
 
-	/* set default header */
-	cache->header = (apc_cache_header_t*) cache->shmaddr;
+	/* set default header, aligned to a cache line */
+	cache->header = (apc_cache_header_t*) ZEND_MM_ALIGNED_SIZE_EX(
+		(uintptr_t) cache->shmaddr, APC_CACHE_LINE_SIZE);
 
-	cache->header->nhits = 0;
-	cache->header->nmisses = 0;
 	cache->header->nentries = 0;
 	cache->header->nexpunges = 0;
 	cache->header->gc = NULL;
 	cache->header->stime = time(NULL);
 	cache->header->state = 0;
+	cache->header->generation = 0;
+	cache->header->version = 0;
+	cache->header->sweep_slot = nslots;
+	cache->header->clear_scheduled = 0;
+	cache->header->uninitialized_bucket[0] = HT_INVALID_IDX;
+	cache->header->uninitialized_bucket[1] = HT_INVALID_IDX;
 
 	/* set cache options */
-	cache->slots = (apc_cache_entry_t **) (((char*) cache->shmaddr) + sizeof(apc_cache_header_t));
+	cache->slots = (apc_cache_entry_t **) (((char*) cache->header) + sizeof(apc_cache_header_t));
 	cache->sma = sma;
 	cache->serializer = serializer;
 	cache->nslots = nslots;
@@ -314,21 +536,88 @@ PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* ser
 	cache->ttl = ttl;
 	cache->smart = smart;
 	cache->defend = defend;
+	cache->indexed = 0;
+	cache->immutable = 0;
+	cache->compress_threshold = 0;
+	cache->lazy = NULL;
 
-	/* header lock */
-	CREATE_LOCK(&cache->header->lock);
+	apc_cache_create_locks(cache);
+
+	return cache;
+} /* }}} */
+
+/* {{{ apc_cache_attach */
+PHP_APCU_API apc_cache_t* apc_cache_attach(apc_sma_t* sma, apc_serializer_t* serializer, void *shmaddr, zend_long size_hint, zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend, zend_bool recover) {
+	apc_cache_t* cache;
+	zend_long i;
+
+	cache = pemalloc(sizeof(apc_cache_t), 1);
+
+	cache->shmaddr = shmaddr;
+	cache->header = (apc_cache_header_t*) ZEND_MM_ALIGNED_SIZE_EX(
+		(uintptr_t) cache->shmaddr, APC_CACHE_LINE_SIZE);
+	cache->slots = (apc_cache_entry_t **) (((char*) cache->header) + sizeof(apc_cache_header_t));
+	cache->sma = sma;
+	cache->serializer = serializer;
+	cache->nslots = make_prime(size_hint > 0 ? size_hint : 2000);
+	cache->gc_ttl = gc_ttl;
+	cache->ttl = ttl;
+	cache->smart = smart;
+	cache->defend = defend;
+	cache->indexed = 0;
+	cache->immutable = 0;
+	cache->compress_threshold = 0;
+	cache->lazy = NULL;
+
+	if (!recover) {
+		return cache;
+	}
+
+	/* no process holds a lock, a reference or a pending regeneration any longer */
+	apc_cache_create_locks(cache);
+	cache->header->state = 0;
+	cache->header->clear_scheduled = 0;
+	memset(cache->header->slam_keys, 0, sizeof(cache->header->slam_keys));
+
+	for (i = 0; i < cache->nslots; i++) {
+		apc_cache_entry_t *entry;
+
+		for (entry = cache->slots[i]; entry; entry = entry->next) {
+			entry->ref_count = 0;
+			entry->shared_count = 0;
+			entry->refresh_time = 0;
+		}
+	}
+
+	while (cache->header->gc) {
+		apc_cache_entry_t *dead = cache->header->gc;
+
+		cache->header->gc = dead->next;
+		free_entry(cache, dead);
+	}
 
 	return cache;
 } /* }}} */
 
+/* {{{ apc_cache_format */
+PHP_APCU_API void apc_cache_format(char *buf, size_t size, const char *serializer_name, zend_long size_hint, zend_bool indexed) {
+	snprintf(buf, size, "APCu %s PHP %d serializer %s slots %d%s header %zu entry %zu ht %zu",
+		PHP_APCU_VERSION, PHP_VERSION_ID, serializer_name ? serializer_name : "php",
+		make_prime(size_hint > 0 ? size_hint : 2000), indexed ? " indexed" : "",
+		sizeof(apc_cache_header_t), sizeof(apc_cache_entry_t), sizeof(HashTable));
+} /* }}} */
+
 static inline zend_bool apc_cache_wlocked_insert(
 		apc_cache_t *cache, apc_cache_entry_t *new_entry, zend_bool exclusive) {
 	zend_string *key = new_entry->key;
-	time_t t = new_entry->ctime;
+	time_t t = apc_cache_time_unpack(new_entry->ctime);
 
 	/* process deleted list  */
 	apc_cache_wlocked_gc(cache);
 
+	/* reclaim some of the entries left by the last clear */
+	apc_cache_wlocked_sweep(cache, APC_CACHE_SWEEP_SLOTS);
+
 	/* make the insertion */
 	{
 		apc_cache_entry_t **entry;
@@ -346,7 +635,7 @@ static inline zend_bool apc_cache_wlocked_insert(
 				 * an exclusive insert (apc_add) we are going to bail right away if
 				 * the user entry already exists and is hard expired.
 				 */
-				if (exclusive && !apc_cache_entry_hard_expired(*entry, t)) {
+				if (exclusive && !apc_cache_entry_hard_expired(cache, *entry, t)) {
 					return 0;
 				}
 
@@ -367,13 +656,23 @@ static inline zend_bool apc_cache_wlocked_insert(
 			entry = &(*entry)->next;
 		}
 
+		/* a snapshot entry not loaded yet is superseded */
+		if (cache->lazy) {
+			apc_cache_wlocked_lazy_claim(cache, key);
+		}
+
 		/* link in new entry */
+		new_entry->hash = h;
+		new_entry->generation = cache->header->generation;
+		new_entry->version = ++cache->header->version;
 		new_entry->next = *entry;
 		*entry = new_entry;
+		apc_cache_wlocked_index_insert(cache, new_entry);
+		apc_cache_wlocked_tags_link(cache, new_entry);
 
 		cache->header->mem_size += new_entry->mem_size;
 		cache->header->nentries++;
-		cache->header->ninserts++;
+		APC_CACHE_STATS(cache).ninserts++;
 	}
 
 	return 1;
@@ -382,33 +681,6 @@ static inline zend_bool apc_cache_wlocked_insert(
 static void apc_cache_init_entry(
 		apc_cache_entry_t *entry, zend_string *key, const zval* val, const int32_t ttl, time_t t);
 
-/* TODO This function may lead to a deadlock on expunge */
-static inline zend_bool apc_cache_store_internal(
-		apc_cache_t *cache, zend_string *key, const zval *val,
-		const int32_t ttl, const zend_bool exclusive) {
-	apc_cache_entry_t tmp_entry, *entry;
-	time_t t = apc_time();
-
-	if (apc_cache_defense(cache, key, t)) {
-		return 0;
-	}
-
-	/* initialize the entry for insertion */
-	apc_cache_init_entry(&tmp_entry, key, val, ttl, t);
-	entry = apc_persist(cache->sma, cache->serializer, &tmp_entry);
-	if (!entry) {
-		return 0;
-	}
-
-	/* execute an insertion */
-	if (!apc_cache_wlocked_insert(cache, entry, exclusive)) {
-		free_entry(cache, entry);
-		return 0;
-	}
-
-	return 1;
-}
-
 /* Find entry, without updating stat counters or access time */
 static inline apc_cache_entry_t *apc_cache_rlocked_find_nostat(
 		apc_cache_t *cache, zend_string *key, time_t t) {
@@ -423,7 +695,7 @@ static inline apc_cache_entry_t *apc_cache_rlocked_find_nostat(
 		/* check for a matching key by has and identifier */
 		if (apc_entry_key_equals(entry, key, h)) {
 			/* Check to make sure this entry isn't expired by a hard TTL */
-			if (apc_cache_entry_hard_expired(entry, t)) {
+			if (apc_cache_entry_hard_expired(cache, entry, t)) {
 				break;
 			}
 
@@ -436,6 +708,48 @@ static inline apc_cache_entry_t *apc_cache_rlocked_find_nostat(
 	return NULL;
 }
 
+/* Entries with fewer hits than this are counted exactly. From there, hits are sampled:
+ * one hit in 2^n is recorded as 2^n hits, n starting at 1 and growing with the count.
+ * This keeps readers of a hot entry from continuously writing to (and invalidating)
+ * its cache line. */
+#define APC_CACHE_HITS_EXACT 64
+#define APC_CACHE_HITS_MAX_SHIFT 10
+
+static inline uint32_t apc_cache_rand(void) {
+	/* xorshift32, seeded per process */
+	uint32_t x = APCG(rand_seed);
+	if (UNEXPECTED(x == 0)) {
+		x = (uint32_t) getpid() * 2654435761U | 1;
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	APCG(rand_seed) = x;
+	return x;
+}
+
+static inline void apc_cache_rlocked_touch(apc_cache_entry_t *entry, time_t t) {
+	zend_long nhits = entry->nhits;
+	uint32_t atime = apc_cache_time_pack(t);
+
+	if (nhits < APC_CACHE_HITS_EXACT) {
+		ATOMIC_INC_RLOCKED(entry->nhits);
+	} else {
+		uint32_t shift = 1;
+		while (shift < APC_CACHE_HITS_MAX_SHIFT && (nhits >> shift) >= APC_CACHE_HITS_EXACT) {
+			shift++;
+		}
+		if ((apc_cache_rand() & ((1U << shift) - 1)) == 0) {
+			ATOMIC_ADD_RLOCKED(entry->nhits, (zend_long) 1 << shift);
+		}
+	}
+
+	/* The access time only has second resolution, don't rewrite an unchanged value */
+	if (entry->atime != atime) {
+		entry->atime = atime;
+	}
+}
+
 /* Find entry, updating stat counters and access time */
 static inline apc_cache_entry_t *apc_cache_rlocked_find(
 		apc_cache_t *cache, zend_string *key, time_t t) {
@@ -450,13 +764,12 @@ static inline apc_cache_entry_t *apc_cache_rlocked_find(
 		/* check for a matching key by has and identifier */
 		if (apc_entry_key_equals(entry, key, h)) {
 			/* Check to make sure this entry isn't expired by a hard TTL */
-			if (apc_cache_entry_hard_expired(entry, t)) {
+			if (apc_cache_entry_hard_expired(cache, entry, t)) {
 				break;
 			}
 
-			ATOMIC_INC_RLOCKED(cache->header->nhits);
-			ATOMIC_INC_RLOCKED(entry->nhits);
-			entry->atime = t;
+			ATOMIC_INC_RLOCKED(APC_CACHE_STATS(cache).nhits);
+			apc_cache_rlocked_touch(entry, t);
 
 			return entry;
 		}
@@ -464,7 +777,7 @@ static inline apc_cache_entry_t *apc_cache_rlocked_find(
 		entry = entry->next;
 	}
 
-	ATOMIC_INC_RLOCKED(cache->header->nmisses);
+	ATOMIC_INC_RLOCKED(APC_CACHE_STATS(cache).nmisses);
 	return NULL;
 }
 
@@ -479,26 +792,79 @@ static inline apc_cache_entry_t *apc_cache_rlocked_find_incref(
 	return entry;
 }
 
-/* {{{ apc_cache_store */
-PHP_APCU_API zend_bool apc_cache_store(
-		apc_cache_t* cache, zend_string *key, const zval *val,
-		const int32_t ttl, const zend_bool exclusive) {
-	apc_cache_entry_t tmp_entry, *entry;
-	time_t t = apc_time();
-	zend_bool ret = 0;
-
-	if (!cache) {
+/* Whether fetches return the value of the entry without copying it: values persisted
+ * immutable are strings flagged interned, or arrays that are not refcounted */
+static inline zend_bool apc_cache_entry_shared(const apc_cache_t *cache, const apc_cache_entry_t *entry) {
+	if (!cache->immutable) {
 		return 0;
 	}
 
-	/* run cache defense */
-	if (apc_cache_defense(cache, key, t)) {
-		return 0;
+	switch (Z_TYPE(entry->val)) {
+		case IS_STRING:
+			return ZSTR_IS_INTERNED(Z_STR(entry->val));
+		case IS_ARRAY:
+			return !Z_REFCOUNTED(entry->val);
+		default:
+			return 0;
 	}
+}
 
-	/* initialize the entry for insertion */
-	apc_cache_init_entry(&tmp_entry, key, val, ttl, t);
-	entry = apc_persist(cache->sma, cache->serializer, &tmp_entry);
+/* Return the value of a pinned entry, or an element within it, without copying it. The entry
+ * stays pinned until apc_cache_release_shared() as the value may be referenced anywhere. */
+static void apc_cache_entry_share(
+		apc_cache_t *cache, apc_cache_entry_t *entry, const zval *value, zval *dst) {
+	zval zv;
+
+	if (!APCG(shared_entries)) {
+		ALLOC_HASHTABLE(APCG(shared_entries));
+		zend_hash_init(APCG(shared_entries), 8, NULL, NULL, 0);
+	}
+
+	ZVAL_PTR(&zv, cache);
+	if (zend_hash_index_add(APCG(shared_entries), (zend_ulong) (uintptr_t) entry, &zv)) {
+		apc_cache_entry_hold(cache, entry);
+	} else {
+		/* already held by an earlier fetch in this request */
+		apc_cache_entry_release(cache, entry);
+	}
+
+	ZVAL_COPY_VALUE(dst, value);
+}
+
+#ifdef APC_LOCK_SHARED
+/* Small values that don't have to go through the unserializer are cheap enough to copy
+ * while holding the read lock, which avoids writing to the entry's reference count. */
+#define APC_CACHE_FETCH_LOCKED_MAX 4096
+
+static inline zend_bool apc_cache_entry_fetch_locked(const apc_cache_entry_t *entry) {
+	return Z_TYPE(entry->val) != IS_PTR && entry->mem_size <= APC_CACHE_FETCH_LOCKED_MAX;
+}
+#endif
+
+/* Levels of a new entry in the prefix index, each further level with probability 1/4 */
+static zend_long apc_cache_index_level(void) {
+	uint32_t r = apc_cache_rand();
+	zend_long level = 1;
+
+	while (level < APC_CACHE_INDEX_LEVELS && (r & 3) == 0) {
+		level++;
+		r >>= 2;
+	}
+
+	return level;
+}
+
+/* Persist and insert an initialized entry, without holding the lock while persisting */
+static zend_bool apc_cache_store_entry(
+		apc_cache_t *cache, apc_cache_entry_t *tmp_entry, const zend_bool exclusive) {
+	apc_cache_entry_t *entry;
+	zend_bool ret = 0;
+
+	if (cache->indexed) {
+		tmp_entry->index_level = apc_cache_index_level();
+	}
+
+	entry = apc_persist(cache, tmp_entry);
 	if (!entry) {
 		return 0;
 	}
@@ -520,478 +886,2502 @@ PHP_APCU_API zend_bool apc_cache_store(
 	}
 
 	return ret;
+}
+
+/* {{{ apc_cache_store */
+PHP_APCU_API zend_bool apc_cache_store(
+		apc_cache_t* cache, zend_string *key, const zval *val,
+		const int32_t ttl, const zend_bool exclusive) {
+	return apc_cache_store_tagged(cache, key, val, ttl, exclusive, NULL);
 } /* }}} */
 
-#ifndef ZTS
-/* {{{ data_unserialize */
-static zval data_unserialize(const char *filename)
-{
-	zval retval;
-	zend_long len = 0;
-	zend_stat_t sb;
-	char *contents, *tmp;
-	FILE *fp;
-	php_unserialize_data_t var_hash = {0,};
+/* Creates the tag links of entries to be persisted, without duplicate tags.
+ * Returns the number of links. */
+static uint32_t apc_cache_tags_create(HashTable *tags, apc_cache_tag_link_t **links) {
+	uint32_t ntags = 0;
+	zval *ztag;
 
-	if(VCWD_STAT(filename, &sb) == -1) {
-		return EG(uninitialized_zval);
+	*links = NULL;
+	if (!tags || !zend_hash_num_elements(tags)) {
+		return 0;
 	}
 
-	fp = fopen(filename, "rb");
+	*links = ecalloc(zend_hash_num_elements(tags), sizeof(apc_cache_tag_link_t));
+	ZEND_HASH_FOREACH_VAL(tags, ztag) {
+		zend_string *tag = zval_get_string(ztag);
+		uint32_t i;
+
+		for (i = 0; i < ntags; i++) {
+			if (zend_string_equals((*links)[i].tag, tag)) {
+				break;
+			}
+		}
 
-	len = sizeof(char)*sb.st_size;
+		if (i < ntags) {
+			zend_string_release(tag);
+			continue;
+		}
 
-	tmp = contents = malloc(len);
+		/* the bucket is selected by hash, make sure it is computed before persisting */
+		zend_string_hash_val(tag);
+		(*links)[ntags++].tag = tag;
+	} ZEND_HASH_FOREACH_END();
 
-	if(!contents) {
-		fclose(fp);
-		return EG(uninitialized_zval);
+	return ntags;
+}
+
+static void apc_cache_tags_destroy(apc_cache_tag_link_t *links, uint32_t ntags) {
+	uint32_t i;
+
+	if (!links) {
+		return;
 	}
 
-	if(fread(contents, 1, len, fp) < 1) {
-		fclose(fp);
-		free(contents);
-		return EG(uninitialized_zval);
+	for (i = 0; i < ntags; i++) {
+		zend_string_release(links[i].tag);
 	}
+	efree(links);
+}
 
-	ZVAL_UNDEF(&retval);
+/* {{{ apc_cache_store_tagged */
+PHP_APCU_API zend_bool apc_cache_store_tagged(
+		apc_cache_t* cache, zend_string *key, const zval *val,
+		const int32_t ttl, const zend_bool exclusive, HashTable *tags) {
+	apc_cache_entry_t tmp_entry;
+	time_t t = apc_time();
+	zend_bool ret;
 
-	PHP_VAR_UNSERIALIZE_INIT(var_hash);
+	if (!cache) {
+		return 0;
+	}
 
-	/* I wish I could use json */
-	if(!php_var_unserialize(&retval, (const unsigned char**)&tmp, (const unsigned char*)(contents+len), &var_hash)) {
-		fclose(fp);
-		free(contents);
-		return EG(uninitialized_zval);
+	/* run cache defense */
+	if (apc_cache_defense(cache, key, t)) {
+		return 0;
 	}
 
-	PHP_VAR_UNSERIALIZE_DESTROY(var_hash);
+	/* initialize the entry for insertion */
+	apc_cache_init_entry(&tmp_entry, key, val, ttl, t);
+	tmp_entry.ntags = apc_cache_tags_create(tags, &tmp_entry.tags);
 
-	free(contents);
-	fclose(fp);
+	ret = apc_cache_store_entry(cache, &tmp_entry, exclusive);
 
-	return retval;
-}
+	apc_cache_tags_destroy(tmp_entry.tags, tmp_entry.ntags);
 
-static int apc_load_data(apc_cache_t* cache, const char *data_file)
-{
-	char *p;
-	char key[MAXPATHLEN] = {0,};
-	size_t key_len;
-	zval data;
+	return ret;
+} /* }}} */
 
-	p = strrchr(data_file, DEFAULT_SLASH);
+/* {{{ apc_cache_store_if_version */
+PHP_APCU_API zend_bool apc_cache_store_if_version(
+		apc_cache_t *cache, zend_string *key, const zval *val, zend_long version, const int32_t ttl) {
+	apc_cache_entry_t tmp_entry, *entry, *current;
+	time_t t = apc_time();
+	zend_bool ret = 0;
 
-	if(p && p[1]) {
-		strlcpy(key, p+1, sizeof(key));
-		p = strrchr(key, '.');
+	if (!cache) {
+		return 0;
+	}
 
-		if(p) {
-			p[0] = '\0';
-			key_len = strlen(key);
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
 
-			data = data_unserialize(data_file);
-			if(Z_TYPE(data) != IS_UNDEF) {
-				zend_string *name = zend_string_init(key, key_len, 0);
-				apc_cache_store(
-					cache, name, &data, 0, 1);
-				zend_string_release(name);
-				zval_dtor(&data);
-			}
-			return 1;
-		}
+	/* no slam defense, a store that lost the race is reported by the version check */
+	apc_cache_init_entry(&tmp_entry, key, val, ttl, t);
+	if (cache->indexed) {
+		tmp_entry.index_level = apc_cache_index_level();
 	}
 
-	return 0;
-}
-#endif
+	/* persisted before taking the lock, like any store */
+	entry = apc_persist(cache, &tmp_entry);
+	if (!entry) {
+		return 0;
+	}
 
-/* {{{ apc_cache_preload shall load the prepared data files in path into the specified cache */
-PHP_APCU_API zend_bool apc_cache_preload(apc_cache_t* cache, const char *path)
-{
-#ifndef ZTS
-	zend_bool result = 0;
-	char file[MAXPATHLEN]={0,};
+	if (!APC_WLOCK(cache->header)) {
+		free_entry(cache, entry);
+		return 0;
+	}
+
+	php_apc_try {
+		current = apc_cache_rlocked_find_nostat(cache, key, t);
+		if ((current ? current->version : 0) == version) {
+			ret = apc_cache_wlocked_insert(cache, entry, 0);
+		}
+	} php_apc_finally {
+		APC_WUNLOCK(cache->header);
+	} php_apc_end_try();
+
+	if (!ret) {
+		free_entry(cache, entry);
+	}
+
+	return ret;
+} /* }}} */
+
+/* {{{ apc_cache_store_multi */
+PHP_APCU_API void apc_cache_store_multi(
+		apc_cache_t* cache, HashTable *values, const int32_t ttl,
+		const zend_bool exclusive, HashTable *tags, HashTable *failed) {
+	apc_cache_entry_t tmp_entry;
+	apc_cache_tag_link_t *tag_links;
+	uint32_t ntags;
+	apc_cache_entry_t **entries;
+	zend_string **keys;
+	zend_bool *stored;
+	uint32_t nkeys = 0, i;
+	time_t t = apc_time();
+	zend_string *hkey;
+	zend_ulong hkey_idx;
+	zval *hentry;
+	zval fail_zv;
+
+	if (!zend_hash_num_elements(values)) {
+		return;
+	}
+
+	entries = safe_emalloc(zend_hash_num_elements(values), sizeof(apc_cache_entry_t *), 0);
+	keys = safe_emalloc(zend_hash_num_elements(values), sizeof(zend_string *), 0);
+	stored = ecalloc(zend_hash_num_elements(values), sizeof(zend_bool));
+
+	/* the tag links are shared by all entries, persisting copies them */
+	ntags = apc_cache_tags_create(tags, &tag_links);
+
+	php_apc_try {
+		/* persist all entries before taking the lock */
+		ZEND_HASH_FOREACH_KEY_VAL(values, hkey_idx, hkey, hentry) {
+			ZVAL_DEREF(hentry);
+			if (hkey) {
+				zend_string_addref(hkey);
+			} else {
+				hkey = zend_long_to_str(hkey_idx);
+			}
+
+			i = nkeys++;
+			keys[i] = hkey;
+			entries[i] = NULL;
+			if (cache && !apc_cache_defense(cache, hkey, t)) {
+				apc_cache_init_entry(&tmp_entry, hkey, hentry, ttl, t);
+				tmp_entry.tags = tag_links;
+				tmp_entry.ntags = ntags;
+				if (cache->indexed) {
+					tmp_entry.index_level = apc_cache_index_level();
+				}
+
+				entries[i] = apc_persist(cache, &tmp_entry);
+			}
+		} ZEND_HASH_FOREACH_END();
+
+		/* link all of them with a single lock acquisition */
+		if (cache && APC_WLOCK(cache->header)) {
+			php_apc_try {
+				for (i = 0; i < nkeys; i++) {
+					if (entries[i]) {
+						stored[i] = apc_cache_wlocked_insert(cache, entries[i], exclusive);
+					}
+				}
+			} php_apc_finally {
+				APC_WUNLOCK(cache->header);
+			} php_apc_end_try();
+		}
+
+		/* only keys that failed are reported */
+		ZVAL_LONG(&fail_zv, -1);
+		for (i = 0; i < nkeys; i++) {
+			if (!stored[i] && failed) {
+				zend_symtable_add_new(failed, keys[i], &fail_zv);
+			}
+		}
+	} php_apc_finally {
+		for (i = 0; i < nkeys; i++) {
+			if (entries[i] && !stored[i]) {
+				free_entry(cache, entries[i]);
+			}
+			zend_string_release(keys[i]);
+		}
+		efree(stored);
+		efree(keys);
+		efree(entries);
+		apc_cache_tags_destroy(tag_links, ntags);
+	} php_apc_end_try();
+} /* }}} */
+
+/* Preloading reads the data files on a few threads that only call into libc, so that the
+ * disk is kept busy while this thread unserializes and persists the files read before:
+ * both of these need the engine, which only ever runs here. */
+#define APC_CACHE_PRELOAD_BATCH  256
+#define APC_CACHE_PRELOAD_WINDOW 64
+
+typedef struct apc_preload_file_t {
+	char *path;
+	zend_string *key;
+	char *data;          /* contents, NULL if the file could not be read */
+	size_t len;
+	zend_bool done;      /* read by a thread, under lock */
+} apc_preload_file_t;
+
+typedef struct apc_preload_t {
+	apc_preload_file_t *files;
+	int nfiles;
+	int next;            /* next file to read */
+	int consumed;        /* files decoded so far, reading stays within a window of it */
+#ifdef APC_PRELOAD_THREADS
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+} apc_preload_t;
+
+/* {{{ apc_preload_read */
+static void apc_preload_read(apc_preload_file_t *file)
+{
+#ifndef PHP_WIN32
+	struct stat sb;
+	int fd = open(file->path, O_RDONLY);
+
+	if (fd == -1) {
+		return;
+	}
+
+	if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+		char *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data != MAP_FAILED) {
+			volatile char touch;
+			size_t offset;
+
+			/* fault the pages in here, rather than on the thread decoding them */
+			for (offset = 0; offset < (size_t) sb.st_size; offset += 4096) {
+				touch = data[offset];
+			}
+			(void) touch;
+
+			file->data = data;
+			file->len = sb.st_size;
+		}
+	}
+
+	close(fd);
+#else
+	zend_stat_t sb;
+	FILE *fp;
+
+	if (VCWD_STAT(file->path, &sb) == -1 || sb.st_size <= 0) {
+		return;
+	}
+
+	if (!(fp = fopen(file->path, "rb"))) {
+		return;
+	}
+
+	file->data = malloc(sb.st_size);
+	if (file->data && fread(file->data, 1, sb.st_size, fp) == (size_t) sb.st_size) {
+		file->len = sb.st_size;
+	} else {
+		free(file->data);
+		file->data = NULL;
+	}
+
+	fclose(fp);
+#endif
+} /* }}} */
+
+/* {{{ apc_preload_release */
+static void apc_preload_release(apc_preload_file_t *file)
+{
+	if (file->data) {
+#ifndef PHP_WIN32
+		munmap(file->data, file->len);
+#else
+		free(file->data);
+#endif
+		file->data = NULL;
+	}
+} /* }}} */
+
+#ifdef APC_PRELOAD_THREADS
+/* {{{ apc_preload_reader */
+static void *apc_preload_reader(void *arg)
+{
+	apc_preload_t *preload = (apc_preload_t *) arg;
+	int i;
+
+	pthread_mutex_lock(&preload->lock);
+	while (preload->next < preload->nfiles) {
+		if (preload->next >= preload->consumed + APC_CACHE_PRELOAD_WINDOW) {
+			pthread_cond_wait(&preload->cond, &preload->lock);
+			continue;
+		}
+
+		i = preload->next++;
+		pthread_mutex_unlock(&preload->lock);
+
+		apc_preload_read(&preload->files[i]);
+
+		pthread_mutex_lock(&preload->lock);
+		preload->files[i].done = 1;
+		pthread_cond_broadcast(&preload->cond);
+	}
+	pthread_mutex_unlock(&preload->lock);
+
+	return NULL;
+} /* }}} */
+#endif
+
+/* {{{ apc_preload_wait shall return once file i has been read, reading it here if no thread took it yet */
+static void apc_preload_wait(apc_preload_t *preload, int i)
+{
+#ifdef APC_PRELOAD_THREADS
+	pthread_mutex_lock(&preload->lock);
+	preload->consumed = i;
+	pthread_cond_broadcast(&preload->cond);
+
+	while (!preload->files[i].done) {
+		if (preload->next == i) {
+			preload->next++;
+			pthread_mutex_unlock(&preload->lock);
+			apc_preload_read(&preload->files[i]);
+			pthread_mutex_lock(&preload->lock);
+			preload->files[i].done = 1;
+			break;
+		}
+		pthread_cond_wait(&preload->cond, &preload->lock);
+	}
+	pthread_mutex_unlock(&preload->lock);
+#else
+	apc_preload_read(&preload->files[i]);
+	preload->files[i].done = 1;
+#endif
+} /* }}} */
+
+/* {{{ apc_preload_unserialize */
+static zend_bool apc_preload_unserialize(zval *retval, const apc_preload_file_t *file)
+{
+	const unsigned char *tmp = (const unsigned char *) file->data;
+	php_unserialize_data_t var_hash;
+	zend_bool result;
+
+	ZVAL_UNDEF(retval);
+
+	PHP_VAR_UNSERIALIZE_INIT(var_hash);
+	/* I wish I could use json */
+	result = php_var_unserialize(retval, &tmp, tmp + file->len, &var_hash);
+	PHP_VAR_UNSERIALIZE_DESTROY(var_hash);
+
+	if (!result) {
+		zval_ptr_dtor(retval);
+		ZVAL_UNDEF(retval);
+	}
+
+	return result;
+} /* }}} */
+
+/* {{{ apc_cache_preload shall load the prepared data files in path into the specified cache */
+PHP_APCU_API zend_bool apc_cache_preload(apc_cache_t* cache, const char *path)
+{
+	zend_bool result = 0;
+	apc_preload_t preload;
+	HashTable batch;
+	zval data;
 	int ndir, i;
 	char *p = NULL;
 	struct dirent **namelist = NULL;
+#ifdef APC_PRELOAD_THREADS
+	pthread_t *threads = NULL;
+	zend_long nthreads = 0, started = 0;
+#endif
+
+	if ((ndir = php_scandir(path, &namelist, 0, php_alphasort)) <= 0) {
+		return 0;
+	}
+
+	memset(&preload, 0, sizeof(preload));
+	preload.files = ecalloc(ndir, sizeof(apc_preload_file_t));
+
+	for (i = 0; i < ndir; i++) {
+		/* check for extension, the rest of the name is the key */
+		p = strrchr(namelist[i]->d_name, '.');
+		if (p && p != namelist[i]->d_name && !strcmp(p, ".data")) {
+			apc_preload_file_t *file = &preload.files[preload.nfiles++];
+
+			spprintf(&file->path, 0, "%s%c%s", path, DEFAULT_SLASH, namelist[i]->d_name);
+			file->key = zend_string_init(namelist[i]->d_name, p - namelist[i]->d_name, 0);
+		}
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	if (!preload.nfiles) {
+		efree(preload.files);
+		return 0;
+	}
+
+#ifdef APC_PRELOAD_THREADS
+	pthread_mutex_init(&preload.lock, NULL);
+	pthread_cond_init(&preload.cond, NULL);
+
+	nthreads = MIN(APCG(preload_threads), preload.nfiles);
+	if (nthreads > 0) {
+		threads = emalloc(nthreads * sizeof(pthread_t));
+		/* if a thread cannot be started, the others and this one read its share */
+		while (started < nthreads &&
+				pthread_create(&threads[started], NULL, apc_preload_reader, &preload) == 0) {
+			started++;
+		}
+	}
+#endif
+
+	zend_hash_init(&batch, APC_CACHE_PRELOAD_BATCH, NULL, ZVAL_PTR_DTOR, 0);
+
+	for (i = 0; i < preload.nfiles; i++) {
+		apc_preload_file_t *file = &preload.files[i];
+
+		apc_preload_wait(&preload, i);
+
+		if (file->data && apc_preload_unserialize(&data, file)) {
+			zend_hash_update(&batch, file->key, &data);
+		}
+		apc_preload_release(file);
+		result = 1;
+
+		/* persisted files are inserted with a single lock acquisition per batch */
+		if (zend_hash_num_elements(&batch) == APC_CACHE_PRELOAD_BATCH || i == preload.nfiles - 1) {
+			apc_cache_store_multi(cache, &batch, 0, 1, NULL, NULL);
+			zend_hash_clean(&batch);
+		}
+	}
+
+	zend_hash_destroy(&batch);
+
+#ifdef APC_PRELOAD_THREADS
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	if (threads) {
+		efree(threads);
+	}
+	pthread_cond_destroy(&preload.cond);
+	pthread_mutex_destroy(&preload.lock);
+#endif
+
+	for (i = 0; i < preload.nfiles; i++) {
+		efree(preload.files[i].path);
+		zend_string_release(preload.files[i].key);
+	}
+	efree(preload.files);
+
+	return result;
+} /* }}} */
+
+/* Snapshot files start with this magic and the format of the cache they were taken from,
+ * followed by one record per entry: its size as 64-bit integer and then its whole allocation,
+ * with pointers relative to its start (see apc_persist_rebase). A record of size 0 ends it. */
+#define APC_CACHE_SNAPSHOT_MAGIC "APCUSNAP"
+#define APC_CACHE_SNAPSHOT_FORMAT_SIZE 128
+
+/* Number of restored entries inserted per write lock acquisition */
+#define APC_CACHE_RESTORE_BATCH 256
+
+static void apc_cache_snapshot_format(apc_cache_t *cache, char *buf) {
+	memset(buf, 0, APC_CACHE_SNAPSHOT_FORMAT_SIZE);
+	snprintf(buf, APC_CACHE_SNAPSHOT_FORMAT_SIZE, "APCu %s PHP %d serializer %s%s entry %zu bucket %zu",
+		PHP_APCU_VERSION, PHP_VERSION_ID, cache->serializer ? cache->serializer->name : "none",
+		cache->indexed ? " indexed" : "", sizeof(apc_cache_entry_t), sizeof(Bucket));
+}
+
+/* Number of entries pinned per read lock acquisition while writing a snapshot */
+#define APC_CACHE_SNAPSHOT_CHUNK 100
+
+/* Snapshots are written to and read from files or streams through these, which fail
+ * unless all of len is transferred */
+typedef zend_bool (*apc_cache_snapshot_write_f)(void *handle, const void *buf, size_t len);
+typedef zend_bool (*apc_cache_snapshot_read_f)(void *handle, void *buf, size_t len);
+
+static zend_bool apc_cache_file_write(void *handle, const void *buf, size_t len) {
+	return fwrite(buf, len, 1, (FILE *) handle) == 1;
+}
+
+static zend_bool apc_cache_file_read(void *handle, void *buf, size_t len) {
+	return fread(buf, len, 1, (FILE *) handle) == 1;
+}
+
+/* sockets and pipes may transfer less than asked for */
+static zend_bool apc_cache_stream_write(void *handle, const void *buf, size_t len) {
+	while (len) {
+		ssize_t n = (ssize_t) php_stream_write((php_stream *) handle, buf, len);
+
+		if (n <= 0) {
+			return 0;
+		}
+		buf = (const char *) buf + n;
+		len -= n;
+	}
+	return 1;
+}
+
+static zend_bool apc_cache_stream_read(void *handle, void *buf, size_t len) {
+	while (len) {
+		ssize_t n = (ssize_t) php_stream_read((php_stream *) handle, buf, len);
+
+		if (n <= 0) {
+			return 0;
+		}
+		buf = (char *) buf + n;
+		len -= n;
+	}
+	return 1;
+}
+
+static zend_bool apc_cache_lazy_write(
+		apc_cache_t *cache, apc_cache_snapshot_write_f write, void *handle,
+		apc_cache_entry_predicate_t predicate, void *data, time_t t, zend_long *count);
+
+/* {{{ apc_cache_snapshot_write writes the live entries for which predicate returns true,
+   or all of them if it is NULL. A chunk of entries is pinned at a time, the read lock
+   is never held while writing. */
+static zend_long apc_cache_snapshot_write(
+		apc_cache_t *cache, apc_cache_snapshot_write_f write, void *handle,
+		apc_cache_entry_predicate_t predicate, void *data)
+{
+	char format[APC_CACHE_SNAPSHOT_FORMAT_SIZE];
+	apc_cache_entry_t **entries = NULL;
+	zend_long nentries = 0, capacity = 0, slot = 0, count = 0, i;
+	char *buf = NULL;
+	size_t buf_size = 0;
+	uint64_t size;
+	time_t t = apc_time();
+	zend_bool ok;
+
+	apc_cache_snapshot_format(cache, format);
+	ok = write(handle, APC_CACHE_SNAPSHOT_MAGIC, sizeof(APC_CACHE_SNAPSHOT_MAGIC) - 1)
+		&& write(handle, format, sizeof(format));
+
+	php_apc_try {
+		/* snapshot entries not loaded yet go first, so that the ones loaded or replaced
+		 * meanwhile are written after them and win when the snapshot is read */
+		if (ok && cache->lazy) {
+			ok = apc_cache_lazy_write(cache, write, handle, predicate, data, t, &count);
+		}
+
+		while (ok && slot < cache->nslots) {
+			if (!APC_RLOCK(cache->header)) {
+				ok = 0;
+				break;
+			}
+
+			/* pin the live entries of the next slots, they are copied without holding the lock */
+			php_apc_try {
+				for (; slot < cache->nslots && nentries < APC_CACHE_SNAPSHOT_CHUNK; slot++) {
+					apc_cache_entry_t *entry;
+
+					for (entry = cache->slots[slot]; entry; entry = entry->next) {
+						if (apc_cache_entry_hard_expired(cache, entry, t)
+								|| (predicate && !predicate(entry, data))) {
+							continue;
+						}
+
+						if (nentries == capacity) {
+							capacity = capacity ? capacity * 2 : APC_CACHE_SNAPSHOT_CHUNK;
+							entries = safe_erealloc(entries, capacity, sizeof(apc_cache_entry_t *), 0);
+						}
+
+						ATOMIC_INC_RLOCKED(entry->ref_count);
+						entries[nentries++] = entry;
+					}
+				}
+			} php_apc_finally {
+				APC_RUNLOCK(cache->header);
+			} php_apc_end_try();
+
+			for (i = 0; i < nentries; i++) {
+				apc_cache_entry_t *entry = entries[i], *copy;
+
+				if (!ok) {
+					apc_cache_entry_release(cache, entry);
+					entries[i] = NULL;
+					continue;
+				}
+
+				size = entry->mem_size;
+				if (size > buf_size) {
+					buf = erealloc(buf, size);
+					buf_size = size;
+				}
+
+				memcpy(buf, entry, size);
+				apc_cache_entry_release(cache, entry);
+				entries[i] = NULL;
+
+				/* the copy is taken while other processes may update its statistics */
+				copy = (apc_cache_entry_t *) buf;
+				copy->ref_count = 0;
+				copy->shared_count = 0;
+				copy->refresh_time = 0;
+				copy->generation = 0;
+				copy->version = 0;
+
+				if (!apc_persist_rebase(cache, copy, size, entry, NULL)) {
+					continue;
+				}
+
+				ok = write(handle, &size, sizeof(size)) && write(handle, buf, size);
+				count++;
+			}
+			nentries = 0;
+		}
+
+		size = 0;
+		ok = ok && write(handle, &size, sizeof(size));
+	} php_apc_finally {
+		for (i = 0; i < nentries; i++) {
+			if (entries[i]) {
+				apc_cache_entry_release(cache, entries[i]);
+			}
+		}
+		if (buf) {
+			efree(buf);
+		}
+		if (entries) {
+			efree(entries);
+		}
+	} php_apc_end_try();
+
+	return ok ? count : -1;
+} /* }}} */
+
+/* {{{ apc_cache_snapshot_read adds the entries of a snapshot up to its end record */
+static zend_long apc_cache_snapshot_read(
+		apc_cache_t *cache, apc_cache_snapshot_read_f read, void *handle, const char *name)
+{
+	char magic[sizeof(APC_CACHE_SNAPSHOT_MAGIC) - 1];
+	char format[APC_CACHE_SNAPSHOT_FORMAT_SIZE], expected[APC_CACHE_SNAPSHOT_FORMAT_SIZE];
+	apc_cache_entry_t *entries[APC_CACHE_RESTORE_BATCH];
+	zend_long count = 0;
+	uint32_t nbatch = 0, i;
+	uint64_t size;
+	time_t t = apc_time();
+	zend_bool done = 0;
+
+	apc_cache_snapshot_format(cache, expected);
+	if (!read(handle, magic, sizeof(magic)) || memcmp(magic, APC_CACHE_SNAPSHOT_MAGIC, sizeof(magic))
+			|| !read(handle, format, sizeof(format)) || memcmp(format, expected, sizeof(format))) {
+		apc_warning("%s is not a snapshot of a cache with this configuration", name);
+		return -1;
+	}
+
+	php_apc_try {
+		while (!done) {
+			/* allocate and read a batch outside of the lock */
+			while (nbatch < APC_CACHE_RESTORE_BATCH) {
+				apc_cache_entry_t *entry;
+
+				if (!read(handle, &size, sizeof(size)) || size > cache->sma->size) {
+					apc_warning("Snapshot in %s is truncated or corrupted", name);
+					done = 1;
+					break;
+				}
+
+				if (size == 0) {
+					done = 1;
+					break;
+				}
+
+				entry = apc_cache_entry_alloc(cache, size);
+				if (!entry) {
+					apc_warning("Not enough shared memory to restore all of %s", name);
+					done = 1;
+					break;
+				}
+
+				if (!read(handle, entry, size) || !apc_persist_rebase(cache, entry, size, NULL, entry)) {
+					apc_warning("Snapshot in %s is truncated or corrupted", name);
+					free_entry(cache, entry);
+					done = 1;
+					break;
+				}
+
+				entry->generation = cache->header->generation;
+				if (apc_cache_entry_hard_expired(cache, entry, t)) {
+					free_entry(cache, entry);
+					continue;
+				}
+
+				entries[nbatch++] = entry;
+			}
+
+			if (!nbatch || !APC_WLOCK(cache->header)) {
+				continue;
+			}
+
+			/* entries stored since the cache started are kept */
+			php_apc_try {
+				for (i = 0; i < nbatch; i++) {
+					if (apc_cache_wlocked_insert(cache, entries[i], 1)) {
+						entries[i] = NULL;
+						count++;
+					}
+				}
+			} php_apc_finally {
+				APC_WUNLOCK(cache->header);
+			} php_apc_end_try();
+
+			for (i = 0; i < nbatch; i++) {
+				if (entries[i]) {
+					free_entry(cache, entries[i]);
+				}
+			}
+			nbatch = 0;
+		}
+	} php_apc_finally {
+		for (i = 0; i < nbatch; i++) {
+			if (entries[i]) {
+				free_entry(cache, entries[i]);
+			}
+		}
+	} php_apc_end_try();
+
+	return count;
+} /* }}} */
+
+/* {{{ apc_cache_dump */
+PHP_APCU_API zend_long apc_cache_dump(apc_cache_t *cache, const char *path)
+{
+	zend_long count = -1;
+	char *tmp_path;
+	FILE *fp;
+
+	if (!cache) {
+		return -1;
+	}
+
+	spprintf(&tmp_path, 0, "%s.tmp", path);
+
+	fp = VCWD_FOPEN(tmp_path, "wb");
+	if (!fp) {
+		apc_warning("Unable to open %s for writing", tmp_path);
+		efree(tmp_path);
+		return -1;
+	}
+
+	php_apc_try {
+		count = apc_cache_snapshot_write(cache, apc_cache_file_write, fp, NULL, NULL);
+	} php_apc_finally {
+		if (fclose(fp) != 0) {
+			count = -1;
+		}
+
+		if (count < 0) {
+			apc_warning("Unable to write snapshot to %s", tmp_path);
+			VCWD_UNLINK(tmp_path);
+		} else if (VCWD_RENAME(tmp_path, path) != 0) {
+			apc_warning("Unable to rename %s to %s", tmp_path, path);
+			VCWD_UNLINK(tmp_path);
+			count = -1;
+		}
+		efree(tmp_path);
+	} php_apc_end_try();
+
+	return count;
+} /* }}} */
+
+/* {{{ apc_cache_restore */
+PHP_APCU_API zend_long apc_cache_restore(apc_cache_t *cache, const char *path)
+{
+	zend_long count = -1;
+	FILE *fp;
+
+	if (!cache) {
+		return -1;
+	}
+
+	fp = VCWD_FOPEN(path, "rb");
+	if (!fp) {
+		apc_warning("Unable to open %s for reading", path);
+		return -1;
+	}
+
+	php_apc_try {
+		count = apc_cache_snapshot_read(cache, apc_cache_file_read, fp, path);
+	} php_apc_finally {
+		fclose(fp);
+	} php_apc_end_try();
+
+	return count;
+} /* }}} */
+
+/* {{{ apc_cache_export */
+PHP_APCU_API zend_long apc_cache_export(
+		apc_cache_t *cache, php_stream *stream, apc_cache_entry_predicate_t predicate, void *data)
+{
+	zend_long count;
+
+	if (!cache) {
+		return -1;
+	}
+
+	count = apc_cache_snapshot_write(cache, apc_cache_stream_write, stream, predicate, data);
+	if (count < 0) {
+		apc_warning("Unable to write snapshot to stream");
+	}
+
+	return count;
+} /* }}} */
+
+/* {{{ apc_cache_import */
+PHP_APCU_API zend_long apc_cache_import(apc_cache_t *cache, php_stream *stream)
+{
+	if (!cache) {
+		return -1;
+	}
+
+	return apc_cache_snapshot_read(cache, apc_cache_stream_read, stream, "stream");
+} /* }}} */
+
+/* {{{ struct definition: apc_cache_lazy_record_t */
+typedef struct apc_cache_lazy_record_t {
+	size_t offset;          /* offset of the entry in the snapshot */
+	size_t size;            /* size of the entry */
+	zend_bool tagged;       /* whether the entry has tags */
+} apc_cache_lazy_record_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_lazy_t */
+struct apc_cache_lazy_t {
+	apc_segment_t segment;            /* read only mapping of the snapshot */
+	HashTable index;                  /* record number by key, built at startup */
+	apc_cache_lazy_record_t *records; /* records of the snapshot */
+	zend_long nrecords;               /* number of records */
+	zend_bool *claimed;               /* per record, loaded or superseded (stored in SHM) */
+}; /* }}} */
+
+/* Returns the string at offset in a snapshot entry of size bytes, or NULL if it does not lie within it */
+static const zend_string *apc_cache_lazy_str(const char *entry, size_t size, size_t offset) {
+	const zend_string *str;
+
+	if (offset > size - sizeof(zend_string)) {
+		return NULL;
+	}
+
+	str = (const zend_string *) (entry + offset);
+	if (ZSTR_LEN(str) >= size - offset - sizeof(zend_string)) {
+		return NULL;
+	}
+
+	return str;
+}
+
+#if APC_MMAP
+static void apc_cache_lazy_destroy(apc_cache_lazy_t *lazy) {
+	zend_hash_destroy(&lazy->index);
+	if (lazy->records) {
+		pefree(lazy->records, 1);
+	}
+	apc_unmap(&lazy->segment);
+	pefree(lazy, 1);
+}
+
+/* {{{ apc_cache_restore_lazy */
+PHP_APCU_API zend_long apc_cache_restore_lazy(apc_cache_t *cache, const char *path)
+{
+	char expected[APC_CACHE_SNAPSHOT_FORMAT_SIZE];
+	size_t header_size = sizeof(APC_CACHE_SNAPSHOT_MAGIC) - 1 + APC_CACHE_SNAPSHOT_FORMAT_SIZE;
+	size_t pos = header_size;
+	zend_long capacity = 0;
+	apc_cache_lazy_t *lazy;
+	time_t t = apc_time();
+	const char *base;
+	uint64_t size;
+
+	if (!cache || cache->lazy) {
+		return -1;
+	}
+
+	lazy = pecalloc(1, sizeof(apc_cache_lazy_t), 1);
+	lazy->segment = apc_mmap_readonly(path);
+	base = lazy->segment.shmaddr;
+
+	apc_cache_snapshot_format(cache, expected);
+	if (!base || lazy->segment.size < header_size
+			|| memcmp(base, APC_CACHE_SNAPSHOT_MAGIC, sizeof(APC_CACHE_SNAPSHOT_MAGIC) - 1)
+			|| memcmp(base + sizeof(APC_CACHE_SNAPSHOT_MAGIC) - 1, expected, APC_CACHE_SNAPSHOT_FORMAT_SIZE)) {
+		apc_warning("%s is not a snapshot of a cache with this configuration", path);
+		if (base) {
+			apc_unmap(&lazy->segment);
+		}
+		pefree(lazy, 1);
+		return -1;
+	}
+
+	/* only the entry headers and keys are read here, values are paged in when loaded */
+	zend_hash_init(&lazy->index, 0, NULL, NULL, 1);
+	while (pos + sizeof(size) <= lazy->segment.size) {
+		const apc_cache_entry_t *entry;
+		const zend_string *key;
+		zval n;
+
+		memcpy(&size, base + pos, sizeof(size));
+		pos += sizeof(size);
+		if (size == 0) {
+			break;
+		}
+
+		if (size < sizeof(apc_cache_entry_t) || size > lazy->segment.size - pos) {
+			apc_warning("Snapshot %s is truncated or corrupted", path);
+			break;
+		}
+
+		entry = (const apc_cache_entry_t *) (base + pos);
+		if (!(key = apc_cache_lazy_str(base + pos, size, (size_t) (uintptr_t) entry->key))) {
+			apc_warning("Snapshot %s is truncated or corrupted", path);
+			break;
+		}
+
+		if (!entry->ttl || apc_cache_time_unpack(entry->ctime) + entry->ttl >= t) {
+			if (lazy->nrecords == capacity) {
+				capacity = capacity ? capacity * 2 : 1024;
+				lazy->records = perealloc(lazy->records, capacity * sizeof(apc_cache_lazy_record_t), 1);
+			}
+
+			lazy->records[lazy->nrecords].offset = pos;
+			lazy->records[lazy->nrecords].size = size;
+			lazy->records[lazy->nrecords].tagged = entry->ntags > 0;
+
+			ZVAL_LONG(&n, lazy->nrecords);
+			zend_hash_str_update(&lazy->index, ZSTR_VAL(key), ZSTR_LEN(key), &n);
+			lazy->nrecords++;
+		}
+
+		pos += size;
+	}
+
+	if (!lazy->nrecords) {
+		apc_cache_lazy_destroy(lazy);
+		return 0;
+	}
+
+	lazy->claimed = apc_sma_malloc(cache->sma, lazy->nrecords);
+	if (!lazy->claimed) {
+		apc_warning("Not enough shared memory to restore %s", path);
+		apc_cache_lazy_destroy(lazy);
+		return -1;
+	}
+
+	memset(lazy->claimed, 0, lazy->nrecords);
+	cache->lazy = lazy;
+
+	return lazy->nrecords;
+} /* }}} */
+#endif
+
+/* Marks the snapshot entry of key as superseded, called with the write lock held */
+static void apc_cache_wlocked_lazy_claim(apc_cache_t *cache, zend_string *key) {
+	zval *n = zend_hash_find(&cache->lazy->index, key);
+
+	if (n) {
+		cache->lazy->claimed[Z_LVAL_P(n)] = 1;
+	}
+}
+
+/* Marks the snapshot entries of keys with the prefix, or all of them if it is NULL, as superseded,
+ * called with the write lock held */
+static void apc_cache_wlocked_lazy_claim_all(apc_cache_t *cache, zend_string *prefix) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+	zend_string *key;
+	zval *n;
+
+	if (!prefix) {
+		memset(lazy->claimed, 1, lazy->nrecords);
+		return;
+	}
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&lazy->index, key, n) {
+		if (apc_cache_key_has_prefix(key, prefix)) {
+			lazy->claimed[Z_LVAL_P(n)] = 1;
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+
+/* Fills entry with the fields of the snapshot entry of record n, as predicates see it:
+ * with the key of the index, but without its value or any link */
+static void apc_cache_lazy_entry(apc_cache_t *cache, zend_long n, zend_string *key, apc_cache_entry_t *entry) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+
+	memcpy(entry, (char *) lazy->segment.shmaddr + lazy->records[n].offset, sizeof(apc_cache_entry_t));
+	entry->next = NULL;
+	entry->key = key;
+	ZVAL_NULL(&entry->val);
+	entry->index_next = NULL;
+	entry->index_level = 0;
+	entry->tags = NULL;
+	entry->ntags = 0;
+	entry->generation = cache->header->generation;
+}
+
+/* Marks the snapshot entries predicate returns true for as superseded, called with the write
+ * lock held. Returns their number. */
+static zend_long apc_cache_wlocked_lazy_claim_matching(
+		apc_cache_t *cache, apc_cache_entry_predicate_t predicate, void *data) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+	zend_long count = 0;
+	zend_string *key;
+	zval *n;
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&lazy->index, key, n) {
+		apc_cache_entry_t entry;
+
+		if (lazy->claimed[Z_LVAL_P(n)]) {
+			continue;
+		}
+
+		apc_cache_lazy_entry(cache, Z_LVAL_P(n), key, &entry);
+		if (predicate(&entry, data)) {
+			lazy->claimed[Z_LVAL_P(n)] = 1;
+			count++;
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	return count;
+}
+
+/* Whether the snapshot entry of record n carries one of the tags, read from the snapshot.
+ * Entries whose tags cannot be read are taken to. */
+static zend_bool apc_cache_lazy_tagged(apc_cache_lazy_t *lazy, zend_long n, zend_string **tags, uint32_t ntags) {
+	apc_cache_lazy_record_t *record = &lazy->records[n];
+	const char *base = (const char *) lazy->segment.shmaddr + record->offset;
+	const apc_cache_entry_t *entry = (const apc_cache_entry_t *) base;
+	size_t offset = (size_t) (uintptr_t) entry->tags;
+	const apc_cache_tag_link_t *links;
+	uint32_t i, j;
+
+	if (!record->tagged) {
+		return 0;
+	}
+
+	if (entry->ntags > record->size / sizeof(apc_cache_tag_link_t)
+			|| offset > record->size - entry->ntags * sizeof(apc_cache_tag_link_t)) {
+		return 1;
+	}
+
+	links = (const apc_cache_tag_link_t *) (base + offset);
+	for (i = 0; i < entry->ntags; i++) {
+		const zend_string *tag = apc_cache_lazy_str(base, record->size, (size_t) (uintptr_t) links[i].tag);
+
+		if (!tag) {
+			return 1;
+		}
+
+		for (j = 0; j < ntags; j++) {
+			if (ZSTR_LEN(tag) == ZSTR_LEN(tags[j]) && !memcmp(ZSTR_VAL(tag), ZSTR_VAL(tags[j]), ZSTR_LEN(tag))) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Marks the snapshot entries carrying one of the tags as superseded, called with the write
+ * lock held. Returns their number. */
+static zend_long apc_cache_wlocked_lazy_claim_tagged(apc_cache_t *cache, zend_string **tags, uint32_t ntags) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+	zend_long count = 0, n;
+
+	for (n = 0; n < lazy->nrecords; n++) {
+		if (!lazy->claimed[n] && apc_cache_lazy_tagged(lazy, n, tags, ntags)) {
+			lazy->claimed[n] = 1;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Writes the snapshot entries neither loaded nor superseded yet straight from the snapshot,
+ * where they are stored as snapshot records already */
+static zend_bool apc_cache_lazy_write(
+		apc_cache_t *cache, apc_cache_snapshot_write_f write, void *handle,
+		apc_cache_entry_predicate_t predicate, void *data, time_t t, zend_long *count) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+	zend_string *key;
+	zval *n;
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&lazy->index, key, n) {
+		apc_cache_lazy_record_t *record = &lazy->records[Z_LVAL_P(n)];
+		apc_cache_entry_t entry;
+		uint64_t size = record->size;
+
+		if (lazy->claimed[Z_LVAL_P(n)]) {
+			continue;
+		}
+
+		apc_cache_lazy_entry(cache, Z_LVAL_P(n), key, &entry);
+		if (apc_cache_entry_hard_expired(cache, &entry, t) || (predicate && !predicate(&entry, data))) {
+			continue;
+		}
+
+		if (!write(handle, &size, sizeof(size))
+				|| !write(handle, (char *) lazy->segment.shmaddr + record->offset, record->size)) {
+			return 0;
+		}
+		(*count)++;
+	} ZEND_HASH_FOREACH_END();
+
+	return 1;
+}
+
+/* Copies the snapshot entry of key into the cache, unless it was loaded or superseded */
+static void apc_cache_lazy_load(apc_cache_t *cache, zend_string *key, time_t t) {
+	apc_cache_lazy_t *lazy = cache->lazy;
+	apc_cache_lazy_record_t *record;
+	apc_cache_entry_t *entry;
+	zend_bool inserted = 0;
+	zend_long n;
+	zval *zn;
+
+	zn = zend_hash_find(&lazy->index, key);
+	if (!zn || lazy->claimed[Z_LVAL_P(zn)]) {
+		return;
+	}
+
+	n = Z_LVAL_P(zn);
+	record = &lazy->records[n];
+	entry = apc_cache_entry_alloc(cache, record->size);
+	if (!entry) {
+		return;
+	}
+
+	memcpy(entry, (char *) lazy->segment.shmaddr + record->offset, record->size);
+	if (!apc_persist_rebase(cache, entry, record->size, NULL, entry)) {
+		free_entry(cache, entry);
+		lazy->claimed[n] = 1;
+		return;
+	}
+
+	if (!APC_WLOCK(cache->header)) {
+		free_entry(cache, entry);
+		return;
+	}
+
+	php_apc_try {
+		if (!lazy->claimed[n]) {
+			lazy->claimed[n] = 1;
+			entry->generation = cache->header->generation;
+			inserted = !apc_cache_entry_hard_expired(cache, entry, t)
+				&& apc_cache_wlocked_insert(cache, entry, 1);
+		}
+	} php_apc_finally {
+		APC_WUNLOCK(cache->header);
+	} php_apc_end_try();
+
+	if (!inserted) {
+		free_entry(cache, entry);
+	}
+}
+
+/* Copies the snapshot entries of keys with the prefix into the cache */
+static void apc_cache_lazy_load_prefix(apc_cache_t *cache, zend_string *prefix, time_t t) {
+	zend_string *key;
+	zval *n;
+
+	ZEND_HASH_FOREACH_STR_KEY_VAL(&cache->lazy->index, key, n) {
+		if (!cache->lazy->claimed[Z_LVAL_P(n)] && apc_cache_key_has_prefix(key, prefix)) {
+			apc_cache_lazy_load(cache, key, t);
+		}
+	} ZEND_HASH_FOREACH_END();
+}
+
+/* {{{ apc_cache_entry_release */
+PHP_APCU_API void apc_cache_entry_release(apc_cache_t *cache, apc_cache_entry_t *entry)
+{
+	ATOMIC_DEC(entry->ref_count);
+}
+/* }}} */
+
+/* {{{ apc_cache_entry_hold */
+PHP_APCU_API void apc_cache_entry_hold(apc_cache_t *cache, apc_cache_entry_t *entry)
+{
+	/* taken before the reference to the entry is dropped, so that one always remains */
+	ATOMIC_INC(entry->shared_count);
+	ATOMIC_DEC(entry->ref_count);
+}
+/* }}} */
+
+/* {{{ apc_cache_entry_release_held */
+PHP_APCU_API void apc_cache_entry_release_held(apc_cache_t *cache, apc_cache_entry_t *entry)
+{
+	ATOMIC_DEC(entry->shared_count);
+}
+/* }}} */
+
+/* {{{ apc_cache_detach */
+PHP_APCU_API void apc_cache_detach(apc_cache_t *cache)
+{
+	/* Important: This function should not clean up anything that's in shared memory,
+	 * only detach our process-local use of it. In particular locks cannot be destroyed
+	 * here. */
+
+	if (!cache) {
+		return;
+	}
+
+#if APC_MMAP
+	if (cache->lazy) {
+		apc_cache_lazy_destroy(cache->lazy);
+	}
+#endif
+
+	free(cache);
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_real_expunge */
+static void apc_cache_wlocked_real_expunge(apc_cache_t* cache) {
+	/* increment counter */
+	cache->header->nexpunges++;
+
+	/* drop the prefix index and the tag buckets at once, rather than entry by entry */
+	memset(cache->header->index, 0, sizeof(cache->header->index));
+	memset(cache->header->tags, 0, sizeof(cache->header->tags));
+
+	/* expunge */
+	{
+		zend_ulong i;
+
+		for (i = 0; i < cache->nslots; i++) {
+			apc_cache_entry_t **entry = &cache->slots[i];
+			while (*entry) {
+				/* the neighbouring links may already be freed, don't unlink from them */
+				uint32_t j;
+				for (j = 0; j < (*entry)->ntags; j++) {
+					(*entry)->tags[j].pprev = NULL;
+				}
+
+				apc_cache_wlocked_remove_entry(cache, entry);
+			}
+		}
+	}
+
+	/* every slot is empty now */
+	cache->header->sweep_slot = cache->nslots;
+
+	/* set new time so counters make sense */
+	cache->header->stime = apc_time();
+
+	/* reset counters */
+	cache->header->nentries = 0;
+	memset(cache->header->stats, 0, sizeof(cache->header->stats));
+	memset(&cache->header->compression, 0, sizeof(cache->header->compression));
+
+	/* resets slam keys */
+	memset(cache->header->slam_keys, 0, sizeof(cache->header->slam_keys));
+} /* }}} */
+
+/* {{{ apc_cache_clear */
+PHP_APCU_API void apc_cache_clear(apc_cache_t* cache)
+{
+	if (!cache) {
+		return;
+	}
+
+	/* lock header */
+	if (!APC_WLOCK(cache->header)) {
+		return;
+	}
+
+	/* Start a new generation rather than removing every entry under the lock. The entries
+	 * of older generations are treated as missing, and swept by subsequent insertions. */
+	cache->header->generation++;
+	cache->header->sweep_slot = 0;
+	cache->header->clear_scheduled = 0;
+
+	/* the snapshot entries not loaded yet go with the rest */
+	if (cache->lazy) {
+		apc_cache_wlocked_lazy_claim_all(cache, NULL);
+	}
+
+	/* reset counters */
+	cache->header->nentries = 0;
+	cache->header->mem_size = 0;
+	memset(cache->header->stats, 0, sizeof(cache->header->stats));
+	memset(&cache->header->compression, 0, sizeof(cache->header->compression));
+
+	/* resets slam keys */
+	memset(cache->header->slam_keys, 0, sizeof(cache->header->slam_keys));
+
+	/* set info */
+	cache->header->stime = apc_time();
+	cache->header->nexpunges = 0;
+
+	/* unlock header */
+	APC_WUNLOCK(cache->header);
+}
+/* }}} */
+
+/* {{{ apc_cache_schedule_clear */
+PHP_APCU_API void apc_cache_schedule_clear(apc_cache_t* cache)
+{
+	if (cache) {
+		cache->header->clear_scheduled = 1;
+	}
+}
+/* }}} */
+
+/* {{{ apc_cache_run_scheduled_clear */
+PHP_APCU_API void apc_cache_run_scheduled_clear(apc_cache_t* cache)
+{
+	if (cache && cache->header->clear_scheduled) {
+		apc_cache_clear(cache);
+	}
+}
+/* }}} */
+
+/* {{{ apc_cache_default_expunge */
+PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size)
+{
+	time_t t;
+	size_t suitable = 0L;
+	size_t available = 0L;
+
+	if (!cache) {
+		return;
+	}
+
+	/* apc_time() depends on globals, don't read it if there's no cache. This may happen if SHM
+	 * is too small and the initial cache creation during MINIT triggers an expunge. */
+	t = apc_time();
+
+	/* get the lock for header */
+	if (!APC_WLOCK(cache->header)) {
+		return;
+	}
+
+	/* make suitable selection */
+	suitable = (cache->smart > 0L) ? (size_t) (cache->smart * size) : (size_t) (cache->sma->size/2);
+
+	/* gc */
+	apc_cache_wlocked_gc(cache);
+
+	/* entries left by the last clear go first */
+	apc_cache_wlocked_sweep(cache, cache->nslots);
+
+	/* get available */
+	available = apc_sma_get_avail_mem(cache->sma);
+
+	/* perform expunge processing */
+	if (!cache->ttl) {
+		/* check it is necessary to expunge */
+		if (available < suitable) {
+			apc_cache_wlocked_real_expunge(cache);
+		}
+	} else {
+		/* check that expunge is necessary */
+		if (available < suitable) {
+			zend_ulong i;
+
+			/* look for junk */
+			for (i = 0; i < cache->nslots; i++) {
+				apc_cache_entry_t **entry = &cache->slots[i];
+				while (*entry) {
+					if (apc_cache_entry_expired(cache, *entry, t)) {
+						apc_cache_wlocked_remove_entry(cache, entry);
+						continue;
+					}
+
+					/* grab next entry */
+					entry = &(*entry)->next;
+				}
+			}
+
+			/* if the cache now has space, then reset slam keys */
+			if (apc_sma_get_avail_size(cache->sma, size)) {
+				/* wipe slam keys */
+				memset(cache->header->slam_keys, 0, sizeof(cache->header->slam_keys));
+			} else {
+				/* with not enough space left in cache, we are forced to expunge */
+				apc_cache_wlocked_real_expunge(cache);
+			}
+		}
+	}
+
+	/* unlock header */
+	APC_WUNLOCK(cache->header);
+}
+/* }}} */
+
+/* {{{ apc_cache_find */
+PHP_APCU_API apc_cache_entry_t *apc_cache_find(apc_cache_t* cache, zend_string *key, time_t t)
+{
+	apc_cache_entry_t *entry;
+
+	if (!cache) {
+		return NULL;
+	}
+
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+	APC_RLOCK(cache->header);
+	entry = apc_cache_rlocked_find_incref(cache, key, t);
+	APC_RUNLOCK(cache->header);
+
+	return entry;
+}
+/* }}} */
+
+/* A value kept in process memory by the local cache, see apc.local_size. It is handed out
+ * as long as the version of the entry it was copied from is the one found in the cache. */
+typedef struct apc_cache_local_t {
+	apc_cache_t *cache;              /* cache the entry was fetched from */
+	zend_long version;               /* version of that entry */
+	zval *value;                     /* immutable copy, see apc_persist_local */
+	size_t size;                     /* memory used by the copy */
+	zend_ulong used;                 /* APCG(local_clock) of the last request fetching it */
+	struct apc_cache_local_t *next;  /* next retired value */
+} apc_cache_local_t;
+
+static void apc_cache_local_free(apc_cache_local_t *local) {
+	pefree(local->value, 1);
+	pefree(local, 1);
+}
+
+/* Remove a stale value, which is freed after the request as it may still be referenced */
+static void apc_cache_local_retire(zend_string *key, apc_cache_local_t *local) {
+	zend_hash_del(APCG(local), key);
+	APCG(local_mem) -= local->size;
+
+	local->next = APCG(local_retired);
+	APCG(local_retired) = local;
+}
+
+static void apc_cache_local_store(
+		apc_cache_t *cache, zend_string *key, zend_long version, const zval *value) {
+	apc_cache_local_t *local;
+	size_t size;
+	zval *copy = apc_persist_local(value, (size_t) APCG(local_size), &size);
+
+	if (!copy) {
+		return;
+	}
+
+	if (!APCG(local)) {
+		APCG(local) = pemalloc(sizeof(HashTable), 1);
+		zend_hash_init(APCG(local), 64, NULL, NULL, 1);
+	}
+
+	local = pemalloc(sizeof(apc_cache_local_t), 1);
+	local->cache = cache;
+	local->version = version;
+	local->value = copy;
+	local->size = size;
+	local->used = APCG(local_clock);
+	local->next = NULL;
+
+	/* the key is copied, the table outlives the request */
+	zend_hash_str_update_ptr(APCG(local), ZSTR_VAL(key), ZSTR_LEN(key), local);
+	APCG(local_mem) += size;
+}
+
+/* Fetch through the local cache: the version check replaces the copy out of shared memory */
+static zend_bool apc_cache_fetch_local(apc_cache_t *cache, zend_string *key, time_t t, zval *dst)
+{
+	apc_cache_local_t *local = APCG(local) ? zend_hash_find_ptr(APCG(local), key) : NULL;
+	apc_cache_entry_t *entry;
+	zend_long version = 0;
+	zend_bool retval = 0;
+
+	APC_RLOCK(cache->header);
+	php_apc_try {
+		entry = apc_cache_rlocked_find(cache, key, t);
+		if (entry && local && local->cache == cache && local->version == entry->version) {
+			ZVAL_COPY_VALUE(dst, local->value);
+			local->used = APCG(local_clock);
+			retval = 1;
+			entry = NULL;
+		} else if (entry) {
+			version = entry->version;
+			ATOMIC_INC_RLOCKED(entry->ref_count);
+		}
+	} php_apc_finally {
+		APC_RUNLOCK(cache->header);
+	} php_apc_end_try();
+
+	if (retval) {
+		return 1;
+	}
+
+	if (local) {
+		apc_cache_local_retire(key, local);
+	}
+
+	if (!entry) {
+		return 0;
+	}
+
+	if (apc_cache_entry_shared(cache, entry)) {
+		apc_cache_entry_share(cache, entry, &entry->val, dst);
+		return 1;
+	}
+
+	php_apc_try {
+		retval = apc_cache_entry_fetch_zval(cache, entry, dst);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	if (retval && (Z_TYPE_P(dst) == IS_STRING || Z_TYPE_P(dst) == IS_ARRAY)) {
+		apc_cache_local_store(cache, key, version, dst);
+	}
+
+	return retval;
+}
+
+#if PHP_VERSION_ID >= 80000
+static int apc_cache_local_compare(Bucket *a, Bucket *b) {
+#else
+static int apc_cache_local_compare(const void *a, const void *b) {
+#endif
+	zend_ulong used_a = ((apc_cache_local_t *) Z_PTR(((const Bucket *) a)->val))->used;
+	zend_ulong used_b = ((apc_cache_local_t *) Z_PTR(((const Bucket *) b)->val))->used;
+
+	return used_a < used_b ? -1 : used_a > used_b;
+}
+
+static int apc_cache_local_evict(zval *zv) {
+	apc_cache_local_t *local = Z_PTR_P(zv);
+
+	if (APCG(local_mem) <= (size_t) APCG(local_size)) {
+		return ZEND_HASH_APPLY_STOP;
+	}
+
+	APCG(local_mem) -= local->size;
+	apc_cache_local_free(local);
+	return ZEND_HASH_APPLY_REMOVE;
+}
+
+/* {{{ apc_cache_local_collect */
+PHP_APCU_API void apc_cache_local_collect(void)
+{
+	apc_cache_local_t *local;
+
+	while ((local = APCG(local_retired))) {
+		APCG(local_retired) = local->next;
+		apc_cache_local_free(local);
+	}
+
+	APCG(local_clock)++;
+
+	/* the least recently fetched values go first */
+	if (APCG(local) && APCG(local_mem) > (size_t) APCG(local_size)) {
+		zend_hash_sort(APCG(local), apc_cache_local_compare, 0);
+		zend_hash_apply(APCG(local), apc_cache_local_evict);
+	}
+} /* }}} */
+
+/* {{{ apc_cache_local_destroy */
+PHP_APCU_API void apc_cache_local_destroy(void)
+{
+	apc_cache_local_t *local;
+
+	apc_cache_local_collect();
+	if (!APCG(local)) {
+		return;
+	}
 
-	if ((ndir = php_scandir(path, &namelist, 0, php_alphasort)) > 0) {
-		for (i = 0; i < ndir; i++) {
-			/* check for extension */
-			if (!(p = strrchr(namelist[i]->d_name, '.'))
-					|| (p && strcmp(p, ".data"))) {
-				free(namelist[i]);
+	ZEND_HASH_FOREACH_PTR(APCG(local), local) {
+		apc_cache_local_free(local);
+	} ZEND_HASH_FOREACH_END();
+
+	zend_hash_destroy(APCG(local));
+	pefree(APCG(local), 1);
+	APCG(local) = NULL;
+	APCG(local_mem) = 0;
+} /* }}} */
+
+/* {{{ apc_cache_fetch */
+PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, time_t t, zval *dst)
+{
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+
+	if (!cache) {
+		return 0;
+	}
+
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+	if (APC_CACHE_IMMUTABLE && APCG(local_size) > 0) {
+		return apc_cache_fetch_local(cache, key, t, dst);
+	}
+
+	APC_RLOCK(cache->header);
+#ifdef APC_LOCK_SHARED
+	php_apc_try {
+		entry = apc_cache_rlocked_find(cache, key, t);
+		if (entry && !apc_cache_entry_shared(cache, entry) && apc_cache_entry_fetch_locked(entry)) {
+			/* Copied while holding the read lock, no need to pin the entry */
+			retval = apc_cache_entry_fetch_zval(cache, entry, dst);
+			entry = NULL;
+		} else if (entry) {
+			ATOMIC_INC_RLOCKED(entry->ref_count);
+		}
+	} php_apc_finally {
+		APC_RUNLOCK(cache->header);
+	} php_apc_end_try();
+#else
+	entry = apc_cache_rlocked_find_incref(cache, key, t);
+	APC_RUNLOCK(cache->header);
+#endif
+
+	if (!entry) {
+		return retval;
+	}
+
+	if (apc_cache_entry_shared(cache, entry)) {
+		apc_cache_entry_share(cache, entry, &entry->val, dst);
+		return 1;
+	}
+
+	php_apc_try {
+		retval = apc_cache_entry_fetch_zval(cache, entry, dst);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	return retval;
+} /* }}} */
+
+/* {{{ apc_cache_fetch_if_changed */
+PHP_APCU_API zend_bool apc_cache_fetch_if_changed(
+		apc_cache_t *cache, zend_string *key, zend_long *version, time_t t, zval *dst)
+{
+	apc_cache_entry_t *entry = NULL;
+	zend_long known = *version;
+	zend_bool retval = 0;
+
+	*version = 0;
+	if (!cache) {
+		return 0;
+	}
+
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+	APC_RLOCK(cache->header);
+	php_apc_try {
+		entry = apc_cache_rlocked_find(cache, key, t);
+		if (entry) {
+			*version = entry->version;
+			if (*version == known) {
+				/* the caller holds this value already */
+				entry = NULL;
+			} else {
+				ATOMIC_INC_RLOCKED(entry->ref_count);
+			}
+		}
+	} php_apc_finally {
+		APC_RUNLOCK(cache->header);
+	} php_apc_end_try();
+
+	if (!entry) {
+		return 0;
+	}
+
+	php_apc_try {
+		retval = apc_cache_entry_fetch_value(cache, entry, &entry->val, dst);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	return retval;
+} /* }}} */
+
+/* {{{ apc_cache_fetch_multi */
+PHP_APCU_API void apc_cache_fetch_multi(
+		apc_cache_t *cache, zend_string **keys, size_t nkeys, time_t t, HashTable *dst)
+{
+	apc_cache_entry_t **entries;
+	zend_ulong *hashes;
+	size_t *pending;
+	zval *values;
+	size_t npending = 0, i;
+	volatile size_t npinned = 0;
+	volatile zend_bool locked = 1;
+	zend_long nhits = 0;
+
+	if (!cache || !nkeys) {
+		return;
+	}
+
+	if (cache->lazy) {
+		for (i = 0; i < nkeys; i++) {
+			apc_cache_lazy_load(cache, keys[i], t);
+		}
+	}
+
+	entries = safe_emalloc(nkeys, sizeof(apc_cache_entry_t *), 0);
+	hashes = safe_emalloc(nkeys, sizeof(zend_ulong), 0);
+	pending = safe_emalloc(nkeys, sizeof(size_t), 0);
+	values = safe_emalloc(nkeys, sizeof(zval), 0);
+
+	/* hash every key before taking the lock */
+	for (i = 0; i < nkeys; i++) {
+		zend_ulong s;
+
+		apc_cache_hash_slot(cache, keys[i], &hashes[i], &s);
+		APC_PREFETCH(&cache->slots[s]);
+		ZVAL_UNDEF(&values[i]);
+	}
+
+	APC_RLOCK(cache->header);
+	php_apc_try {
+		for (i = 0; i < nkeys; i++) {
+			entries[i] = cache->slots[hashes[i] % cache->nslots];
+			if (entries[i]) {
+				APC_PREFETCH(entries[i]);
+				pending[npending++] = i;
+			}
+		}
+
+		/* Walk all chains one step at a time, so that the entries of the next step are
+		 * being loaded while the current ones are compared, rather than one after another. */
+		while (npending) {
+			size_t n = 0, j;
+
+			for (j = 0; j < npending; j++) {
+				size_t k = pending[j];
+				apc_cache_entry_t *entry = entries[k];
+
+				if (apc_entry_key_equals(entry, keys[k], hashes[k])) {
+					if (apc_cache_entry_hard_expired(cache, entry, t)) {
+						entries[k] = NULL;
+					}
+					continue;
+				}
+
+				entries[k] = entry->next;
+				if (entries[k]) {
+					APC_PREFETCH(entries[k]);
+					pending[n++] = k;
+				}
+			}
+
+			npending = n;
+		}
+
+		/* Entries before npinned are pinned or copied already, a bailout releases those */
+		for (i = 0; i < nkeys; i++) {
+			apc_cache_entry_t *entry = entries[i];
+
+			npinned = i;
+			if (!entry) {
+				continue;
+			}
+
+			nhits++;
+			apc_cache_rlocked_touch(entry, t);
+#ifdef APC_LOCK_SHARED
+			if (!apc_cache_entry_shared(cache, entry) && apc_cache_entry_fetch_locked(entry)) {
+				/* Copied while holding the read lock, no need to pin the entry */
+				apc_cache_entry_fetch_zval(cache, entry, &values[i]);
+				entries[i] = NULL;
 				continue;
 			}
+#endif
+			ATOMIC_INC_RLOCKED(entry->ref_count);
+		}
+		npinned = nkeys;
 
-			snprintf(file, MAXPATHLEN, "%s%c%s",
-					path, DEFAULT_SLASH, namelist[i]->d_name);
+		ATOMIC_ADD_RLOCKED(APC_CACHE_STATS(cache).nhits, nhits);
+		ATOMIC_ADD_RLOCKED(APC_CACHE_STATS(cache).nmisses, (zend_long) nkeys - nhits);
 
-			if(apc_load_data(cache, file)) {
-				result = 1;
+		APC_RUNLOCK(cache->header);
+		locked = 0;
+
+		for (i = 0; i < nkeys; i++) {
+			if (entries[i] && apc_cache_entry_shared(cache, entries[i])) {
+				apc_cache_entry_share(cache, entries[i], &entries[i]->val, &values[i]);
+				entries[i] = NULL;
+			} else if (entries[i]) {
+				apc_cache_entry_fetch_zval(cache, entries[i], &values[i]);
+			}
+			if (Z_TYPE(values[i]) != IS_UNDEF) {
+				zend_hash_update(dst, keys[i], &values[i]);
+				ZVAL_UNDEF(&values[i]);
+			}
+		}
+	} php_apc_finally {
+		if (locked) {
+			APC_RUNLOCK(cache->header);
+		}
+		for (i = 0; i < nkeys; i++) {
+			if (i < npinned && entries[i]) {
+				apc_cache_entry_release(cache, entries[i]);
 			}
-			free(namelist[i]);
+			zval_ptr_dtor(&values[i]);
 		}
-		free(namelist);
+		efree(values);
+		efree(pending);
+		efree(hashes);
+		efree(entries);
+	} php_apc_end_try();
+}
+/* }}} */
+
+/* Fetch an entry without updating stat counters or access time */
+static zend_bool apc_cache_fetch_nostat(apc_cache_t *cache, zend_string *key, time_t t, zval *dst)
+{
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+
+	APC_RLOCK(cache->header);
+	entry = apc_cache_rlocked_find_nostat(cache, key, t);
+	if (entry) {
+		ATOMIC_INC_RLOCKED(entry->ref_count);
 	}
-	return result;
-#else
-	apc_error("Cannot load data from apc.preload_path=%s in thread-safe mode", path);
-	return 0;
-#endif
-} /* }}} */
+	APC_RUNLOCK(cache->header);
 
-/* {{{ apc_cache_entry_release */
-PHP_APCU_API void apc_cache_entry_release(apc_cache_t *cache, apc_cache_entry_t *entry)
+	if (!entry) {
+		return 0;
+	}
+
+	php_apc_try {
+		retval = apc_cache_entry_fetch_zval(cache, entry, dst);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	return retval;
+}
+
+/* {{{ apc_cache_exists */
+PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, time_t t)
 {
-	ATOMIC_DEC(entry->ref_count);
+	apc_cache_entry_t *entry;
+
+	if (!cache) {
+		return 0;
+	}
+
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+	APC_RLOCK(cache->header);
+	entry = apc_cache_rlocked_find_nostat(cache, key, t);
+	APC_RUNLOCK(cache->header);
+
+	return entry != NULL;
 }
 /* }}} */
 
-/* {{{ apc_cache_detach */
-PHP_APCU_API void apc_cache_detach(apc_cache_t *cache)
+/* {{{ apc_cache_update */
+PHP_APCU_API zend_bool apc_cache_update(
+		apc_cache_t *cache, zend_string *key, apc_cache_updater_t updater, void *data,
+		zend_bool insert_if_not_found, zend_long ttl)
 {
-	/* Important: This function should not clean up anything that's in shared memory,
-	 * only detach our process-local use of it. In particular locks cannot be destroyed
-	 * here. */
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+	time_t t = apc_time();
 
 	if (!cache) {
-		return;
+		return 0;
 	}
 
-	free(cache);
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+retry_update:
+	if (!APC_WLOCK(cache->header)) {
+		return 0;
+	}
+
+	entry = apc_cache_rlocked_find_nostat(cache, key, t);
+	if (entry) {
+		/* Only allow changes to simple values */
+		if (Z_TYPE(entry->val) < IS_STRING) {
+			retval = updater(cache, entry, data);
+			entry->mtime = apc_cache_time_pack(t);
+			if (retval) {
+				entry->version = ++cache->header->version;
+			}
+		}
+
+		APC_WUNLOCK(cache->header);
+		return retval;
+	}
+
+	APC_WUNLOCK(cache->header);
+	if (insert_if_not_found) {
+		/* Failed to find matching entry. Add key with value 0 and run the updater again. */
+		zval val;
+		ZVAL_LONG(&val, 0);
+
+		/* We do not check the return value of the exclusive-store (add), as the entry might have
+		 * been added between the cache unlock and the store call. In this case we just want to
+		 * update the entry created by a different process. */
+		apc_cache_store(cache, key, &val, ttl, 1);
+
+		/* Only attempt to perform insertion once. */
+		insert_if_not_found = 0;
+		goto retry_update;
+	}
+
+	return 0;
 }
 /* }}} */
 
-/* {{{ apc_cache_wlocked_real_expunge */
-static void apc_cache_wlocked_real_expunge(apc_cache_t* cache) {
-	/* increment counter */
-	cache->header->nexpunges++;
+/* {{{ apc_cache_atomic_update_long */
+PHP_APCU_API zend_bool apc_cache_atomic_update_long(
+		apc_cache_t *cache, zend_string *key, apc_cache_atomic_updater_t updater, void *data,
+		zend_bool insert_if_not_found, zend_long ttl)
+{
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+	time_t t = apc_time();
 
-	/* expunge */
-	{
-		zend_ulong i;
+	if (!cache) {
+		return 0;
+	}
 
-		for (i = 0; i < cache->nslots; i++) {
-			apc_cache_entry_t **entry = &cache->slots[i];
-			while (*entry) {
-				apc_cache_wlocked_remove_entry(cache, entry);
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, t);
+	}
+
+retry_update:
+	APC_RLOCK(cache->header);
+	entry = apc_cache_rlocked_find_nostat(cache, key, t);
+	if (entry) {
+		/* Only supports integers */
+		if (Z_TYPE(entry->val) == IS_LONG) {
+			retval = updater(cache, &Z_LVAL(entry->val), data);
+			entry->mtime = apc_cache_time_pack(t);
+			if (retval) {
+				/* after the value: a version read before copying it is never newer.
+				 * Concurrent updates may store theirs in any order, keep the highest */
+				zend_long version = ATOMIC_INC(cache->header->version), old;
+				do {
+					old = entry->version;
+				} while (old < version && !ATOMIC_CAS(entry->version, old, version));
 			}
 		}
+
+		APC_RUNLOCK(cache->header);
+		return retval;
 	}
 
-	/* set new time so counters make sense */
-	cache->header->stime = apc_time();
+	APC_RUNLOCK(cache->header);
+	if (insert_if_not_found) {
+		/* Failed to find matching entry. Add key with value 0 and run the updater again. */
+		zval val;
+		ZVAL_LONG(&val, 0);
+
+		/* We do not check the return value of the exclusive-store (add), as the entry might have
+		 * been added between the cache unlock and the store call. In this case we just want to
+		 * update the entry created by a different process. */
+		apc_cache_store(cache, key, &val, ttl, 1);
 
-	/* reset counters */
-	cache->header->ninserts = 0;
-	cache->header->nentries = 0;
-	cache->header->nhits = 0;
-	cache->header->nmisses = 0;
+		/* Only attempt to perform insertion once. */
+		insert_if_not_found = 0;
+		goto retry_update;
+	}
 
-	/* resets lastkey */
-	memset(&cache->header->lastkey, 0, sizeof(apc_cache_slam_key_t));
-} /* }}} */
+	return 0;
+}
+/* }}} */
 
-/* {{{ apc_cache_clear */
-PHP_APCU_API void apc_cache_clear(apc_cache_t* cache)
+/* {{{ apc_cache_delete */
+PHP_APCU_API zend_bool apc_cache_delete(apc_cache_t *cache, zend_string *key)
 {
+	apc_cache_entry_t **entry;
+	zend_ulong h, s;
+
 	if (!cache) {
-		return;
+		return 0;
 	}
 
-	/* lock header */
+	/* calculate hash and slot */
+	apc_cache_hash_slot(cache, key, &h, &s);
+
+	/* lock cache */
 	if (!APC_WLOCK(cache->header)) {
-		return;
+		return 0;
 	}
 
-	/* expunge cache */
-	apc_cache_wlocked_real_expunge(cache);
+	if (cache->lazy) {
+		apc_cache_wlocked_lazy_claim(cache, key);
+	}
 
-	/* set info */
-	cache->header->stime = apc_time();
-	cache->header->nexpunges = 0;
+	/* find head */
+	entry = &cache->slots[s];
+
+	while (*entry) {
+		/* check for a match by hash and identifier */
+		if (apc_entry_key_equals(*entry, key, h)) {
+			/* a stale entry is already gone as far as callers are concerned */
+			zend_bool stale = apc_cache_entry_stale(cache, *entry);
+
+			/* executing removal */
+			apc_cache_wlocked_remove_entry(cache, entry);
+
+			/* unlock header */
+			APC_WUNLOCK(cache->header);
+			return !stale;
+		}
+
+		entry = &(*entry)->next;
+	}
 
 	/* unlock header */
 	APC_WUNLOCK(cache->header);
+	return 0;
 }
 /* }}} */
 
-/* {{{ apc_cache_default_expunge */
-PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size)
+/* {{{ apc_cache_delete_multi */
+PHP_APCU_API void apc_cache_delete_multi(
+		apc_cache_t *cache, zend_string **keys, size_t nkeys, zend_bool *deleted)
 {
-	time_t t;
-	size_t suitable = 0L;
-	size_t available = 0L;
+	zend_ulong *hashes;
+	size_t i;
 
-	if (!cache) {
+	memset(deleted, 0, nkeys * sizeof(zend_bool));
+	if (!cache || !nkeys) {
 		return;
 	}
 
-	/* apc_time() depends on globals, don't read it if there's no cache. This may happen if SHM
-	 * is too small and the initial cache creation during MINIT triggers an expunge. */
-	t = apc_time();
+	/* hash every key before taking the lock */
+	hashes = safe_emalloc(nkeys, sizeof(zend_ulong), 0);
+	for (i = 0; i < nkeys; i++) {
+		zend_ulong s;
 
-	/* get the lock for header */
-	if (!APC_WLOCK(cache->header)) {
-		return;
+		apc_cache_hash_slot(cache, keys[i], &hashes[i], &s);
+		APC_PREFETCH(&cache->slots[s]);
 	}
 
-	/* make suitable selection */
-	suitable = (cache->smart > 0L) ? (size_t) (cache->smart * size) : (size_t) (cache->sma->size/2);
+	/* lock cache */
+	if (APC_WLOCK(cache->header)) {
+		for (i = 0; i < nkeys; i++) {
+			apc_cache_entry_t **entry = &cache->slots[hashes[i] % cache->nslots];
 
-	/* gc */
-	apc_cache_wlocked_gc(cache);
+			if (cache->lazy) {
+				apc_cache_wlocked_lazy_claim(cache, keys[i]);
+			}
 
-	/* get available */
-	available = apc_sma_get_avail_mem(cache->sma);
+			while (*entry) {
+				if (apc_entry_key_equals(*entry, keys[i], hashes[i])) {
+					/* a stale entry is already gone as far as callers are concerned */
+					deleted[i] = !apc_cache_entry_stale(cache, *entry);
+					apc_cache_wlocked_remove_entry(cache, entry);
+					break;
+				}
 
-	/* perform expunge processing */
-	if (!cache->ttl) {
-		/* check it is necessary to expunge */
-		if (available < suitable) {
-			apc_cache_wlocked_real_expunge(cache);
+				entry = &(*entry)->next;
+			}
 		}
-	} else {
-		/* check that expunge is necessary */
-		if (available < suitable) {
-			zend_ulong i;
 
-			/* look for junk */
-			for (i = 0; i < cache->nslots; i++) {
+		/* unlock header */
+		APC_WUNLOCK(cache->header);
+	}
+
+	efree(hashes);
+}
+/* }}} */
+
+/* Number of slots apc_cache_delete_matching scans per write lock acquisition, so that
+ * readers get a chance to run during the scan of a large cache */
+#define APC_CACHE_DELETE_STRIPE 1024
+
+/* {{{ apc_cache_delete_matching */
+PHP_APCU_API zend_long apc_cache_delete_matching(
+		apc_cache_t *cache, apc_cache_entry_predicate_t predicate, void *data)
+{
+	zend_long count = 0;
+	zend_long start;
+
+	if (!cache) {
+		return 0;
+	}
+
+	for (start = 0; start < cache->nslots; start += APC_CACHE_DELETE_STRIPE) {
+		zend_long end = MIN(start + APC_CACHE_DELETE_STRIPE, cache->nslots);
+		zend_long i;
+
+		/* lock cache */
+		if (!APC_WLOCK(cache->header)) {
+			break;
+		}
+
+		php_apc_try {
+			/* snapshot entries not loaded yet are matched as stored in the snapshot */
+			if (start == 0 && cache->lazy) {
+				count += apc_cache_wlocked_lazy_claim_matching(cache, predicate, data);
+			}
+
+			for (i = start; i < end; i++) {
 				apc_cache_entry_t **entry = &cache->slots[i];
+
 				while (*entry) {
-					if (apc_cache_entry_expired(cache, *entry, t)) {
+					if (predicate(*entry, data)) {
+						if (!apc_cache_entry_stale(cache, *entry)) {
+							count++;
+						}
 						apc_cache_wlocked_remove_entry(cache, entry);
 						continue;
 					}
 
-					/* grab next entry */
 					entry = &(*entry)->next;
 				}
 			}
-
-			/* if the cache now has space, then reset last key */
-			if (apc_sma_get_avail_size(cache->sma, size)) {
-				/* wipe lastkey */
-				memset(&cache->header->lastkey, 0, sizeof(apc_cache_slam_key_t));
-			} else {
-				/* with not enough space left in cache, we are forced to expunge */
-				apc_cache_wlocked_real_expunge(cache);
-			}
-		}
+		} php_apc_finally {
+			APC_WUNLOCK(cache->header);
+		} php_apc_end_try();
 	}
 
-	/* unlock header */
-	APC_WUNLOCK(cache->header);
+	return count;
 }
 /* }}} */
 
-/* {{{ apc_cache_find */
-PHP_APCU_API apc_cache_entry_t *apc_cache_find(apc_cache_t* cache, zend_string *key, time_t t)
-{
-	apc_cache_entry_t *entry;
+/* Removes an entry found through one of the indexes, rather than through its slot.
+ * Returns whether the entry was found and was not stale. */
+static zend_bool apc_cache_wlocked_unlink(apc_cache_t *cache, apc_cache_entry_t *entry) {
+	apc_cache_entry_t **link;
+	zend_ulong h, s;
+	zend_bool stale = apc_cache_entry_stale(cache, entry);
 
-	if (!cache) {
-		return NULL;
+	apc_cache_hash_slot(cache, entry->key, &h, &s);
+	link = &cache->slots[s];
+	while (*link && *link != entry) {
+		link = &(*link)->next;
 	}
 
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_incref(cache, key, t);
-	APC_RUNLOCK(cache->header);
+	if (!*link) {
+		return 0;
+	}
 
-	return entry;
+	apc_cache_wlocked_remove_entry(cache, link);
+	return !stale;
 }
-/* }}} */
 
-/* {{{ apc_cache_fetch */
-PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, time_t t, zval *dst)
+/* {{{ apc_cache_invalidate_tags */
+PHP_APCU_API zend_long apc_cache_invalidate_tags(apc_cache_t *cache, HashTable *tags)
 {
-	apc_cache_entry_t *entry;
-	zend_bool retval = 0;
+	zend_long count = 0;
+	zend_string **strings;
+	uint32_t ntags = 0, i;
+	zval *ztag;
 
-	if (!cache) {
+	if (!cache || !zend_hash_num_elements(tags)) {
 		return 0;
 	}
 
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_incref(cache, key, t);
-	APC_RUNLOCK(cache->header);
+	/* convert the tags before locking, this may call into userland */
+	strings = safe_emalloc(zend_hash_num_elements(tags), sizeof(zend_string *), 0);
+	ZEND_HASH_FOREACH_VAL(tags, ztag) {
+		strings[ntags] = zval_get_string(ztag);
+		zend_string_hash_val(strings[ntags]);
+		ntags++;
+	} ZEND_HASH_FOREACH_END();
 
-	if (!entry) {
-		return 0;
-	}
+	/* lock cache */
+	if (APC_WLOCK(cache->header)) {
+		/* tags of snapshot entries not loaded yet are not linked, they are read from the snapshot */
+		if (cache->lazy) {
+			count += apc_cache_wlocked_lazy_claim_tagged(cache, strings, ntags);
+		}
 
-	php_apc_try {
-		retval = apc_cache_entry_fetch_zval(cache, entry, dst);
-	} php_apc_finally {
-		apc_cache_entry_release(cache, entry);
-	} php_apc_end_try();
+		for (i = 0; i < ntags; i++) {
+			zend_string *tag = strings[i];
+			apc_cache_tag_link_t **bucket = apc_cache_tag_bucket(cache, tag);
 
-	return retval;
-} /* }}} */
+			/* removing an entry unlinks all of its tags, so restart from the bucket head */
+			for (;;) {
+				apc_cache_tag_link_t *link = *bucket;
 
-/* {{{ apc_cache_exists */
-PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, time_t t)
-{
-	apc_cache_entry_t *entry;
+				while (link && !(ZSTR_H(link->tag) == ZSTR_H(tag) && zend_string_equals(link->tag, tag))) {
+					link = link->next;
+				}
 
-	if (!cache) {
-		return 0;
+				if (!link) {
+					break;
+				}
+
+				if (apc_cache_wlocked_unlink(cache, link->entry)) {
+					count++;
+				} else if (link->pprev) {
+					/* not reachable through its slot anymore, drop it from the buckets only */
+					apc_cache_wlocked_tags_unlink(link->entry);
+				}
+			}
+		}
+
+		APC_WUNLOCK(cache->header);
 	}
 
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_nostat(cache, key, t);
-	APC_RUNLOCK(cache->header);
+	for (i = 0; i < ntags; i++) {
+		zend_string_release(strings[i]);
+	}
+	efree(strings);
 
-	return entry != NULL;
+	return count;
 }
 /* }}} */
 
-/* {{{ apc_cache_update */
-PHP_APCU_API zend_bool apc_cache_update(
-		apc_cache_t *cache, zend_string *key, apc_cache_updater_t updater, void *data,
-		zend_bool insert_if_not_found, zend_long ttl)
+/* {{{ apc_cache_delete_prefix */
+PHP_APCU_API zend_long apc_cache_delete_prefix(apc_cache_t *cache, zend_string *prefix)
 {
-	apc_cache_entry_t *entry;
-	zend_bool retval = 0;
-	time_t t = apc_time();
+	zend_long count = 0;
 
 	if (!cache) {
 		return 0;
 	}
 
-retry_update:
+	/* lock cache */
 	if (!APC_WLOCK(cache->header)) {
 		return 0;
 	}
 
-	entry = apc_cache_rlocked_find_nostat(cache, key, t);
-	if (entry) {
-		/* Only allow changes to simple values */
-		if (Z_TYPE(entry->val) < IS_STRING) {
-			retval = updater(cache, entry, data);
-			entry->mtime = t;
+	if (cache->lazy) {
+		apc_cache_wlocked_lazy_claim_all(cache, prefix);
+	}
+
+	if (cache->indexed) {
+		apc_cache_entry_t *entry = apc_cache_index_find(cache, ZSTR_VAL(prefix), ZSTR_LEN(prefix), NULL);
+
+		while (entry && apc_cache_key_has_prefix(entry->key, prefix)) {
+			apc_cache_entry_t *next = entry->index_next[0];
+
+			if (apc_cache_wlocked_unlink(cache, entry)) {
+				count++;
+			}
+
+			entry = next;
 		}
+	} else {
+		zend_ulong i;
 
-		APC_WUNLOCK(cache->header);
-		return retval;
+		for (i = 0; i < cache->nslots; i++) {
+			apc_cache_entry_t **entry = &cache->slots[i];
+			while (*entry) {
+				if (apc_cache_key_has_prefix((*entry)->key, prefix)) {
+					if (!apc_cache_entry_stale(cache, *entry)) {
+						count++;
+					}
+					apc_cache_wlocked_remove_entry(cache, entry);
+					continue;
+				}
+
+				entry = &(*entry)->next;
+			}
+		}
 	}
 
+	/* unlock header */
 	APC_WUNLOCK(cache->header);
-	if (insert_if_not_found) {
-		/* Failed to find matching entry. Add key with value 0 and run the updater again. */
-		zval val;
-		ZVAL_LONG(&val, 0);
+	return count;
+}
+/* }}} */
+
+/* {{{ apc_cache_fetch_prefix */
+PHP_APCU_API zend_bool apc_cache_fetch_prefix(apc_cache_t *cache, zend_string *prefix, time_t t, zval *dst)
+{
+	apc_cache_entry_t **entries = NULL;
+	size_t count = 0, size = 0, i;
+
+	ZVAL_NULL(dst);
+	if (!cache) {
+		return 0;
+	}
+
+	if (cache->lazy) {
+		apc_cache_lazy_load_prefix(cache, prefix, t);
+	}
+
+	/* pin the matching entries, values are copied without holding the lock */
+	APC_RLOCK(cache->header);
+	php_apc_try {
+		if (cache->indexed) {
+			apc_cache_entry_t *entry = apc_cache_index_find(cache, ZSTR_VAL(prefix), ZSTR_LEN(prefix), NULL);
+
+			for (; entry && apc_cache_key_has_prefix(entry->key, prefix); entry = entry->index_next[0]) {
+				if (apc_cache_entry_hard_expired(cache, entry, t)) {
+					continue;
+				}
+				if (count == size) {
+					size = size ? size * 2 : 16;
+					entries = erealloc(entries, size * sizeof(apc_cache_entry_t *));
+				}
+				ATOMIC_INC_RLOCKED(entry->ref_count);
+				entries[count++] = entry;
+			}
+		} else {
+			for (i = 0; i < (size_t) cache->nslots; i++) {
+				apc_cache_entry_t *entry;
+
+				for (entry = cache->slots[i]; entry; entry = entry->next) {
+					if (apc_cache_entry_hard_expired(cache, entry, t)
+							|| !apc_cache_key_has_prefix(entry->key, prefix)) {
+						continue;
+					}
+					if (count == size) {
+						size = size ? size * 2 : 16;
+						entries = erealloc(entries, size * sizeof(apc_cache_entry_t *));
+					}
+					ATOMIC_INC_RLOCKED(entry->ref_count);
+					entries[count++] = entry;
+				}
+			}
+		}
+	} php_apc_finally {
+		APC_RUNLOCK(cache->header);
+	} php_apc_end_try();
+
+	array_init_size(dst, (uint32_t) count);
+
+	php_apc_try {
+		for (i = 0; i < count; i++) {
+			zval zv;
+
+			ZVAL_UNDEF(&zv);
+			if (apc_cache_entry_fetch_zval(cache, entries[i], &zv)) {
+				zend_symtable_str_update(Z_ARRVAL_P(dst),
+					ZSTR_VAL(entries[i]->key), ZSTR_LEN(entries[i]->key), &zv);
+			}
+		}
+	} php_apc_finally {
+		for (i = 0; i < count; i++) {
+			apc_cache_entry_release(cache, entries[i]);
+		}
+		if (entries) {
+			efree(entries);
+		}
+	} php_apc_end_try();
+
+	return 1;
+}
+/* }}} */
+
+/* {{{ apc_cache_entry_fetch_zval */
+PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
+		apc_cache_t *cache, apc_cache_entry_t *entry, zval *dst)
+{
+	return apc_unpersist(dst, &entry->val, cache);
+}
+/* }}} */
 
-		/* We do not check the return value of the exclusive-store (add), as the entry might have
-		 * been added between the cache unlock and the store call. In this case we just want to
-		 * update the entry created by a different process. */
-		apc_cache_store(cache, key, &val, ttl, 1);
+/* {{{ apc_cache_entry_fetch_value */
+PHP_APCU_API zend_bool apc_cache_entry_fetch_value(
+		apc_cache_t *cache, apc_cache_entry_t *entry, const zval *value, zval *dst)
+{
+	if (Z_TYPE_P(value) < IS_STRING) {
+		ZVAL_COPY_VALUE(dst, value);
+		return 1;
+	}
 
-		/* Only attempt to perform insertion once. */
-		insert_if_not_found = 0;
-		goto retry_update;
+	if (apc_cache_entry_shared(cache, entry)) {
+		/* shared values keep a pin of their own */
+		ATOMIC_INC(entry->ref_count);
+		apc_cache_entry_share(cache, entry, value, dst);
+		return 1;
 	}
 
-	return 0;
+	return apc_unpersist(dst, value, cache);
 }
 /* }}} */
 
-/* {{{ apc_cache_atomic_update_long */
-PHP_APCU_API zend_bool apc_cache_atomic_update_long(
-		apc_cache_t *cache, zend_string *key, apc_cache_atomic_updater_t updater, void *data,
-		zend_bool insert_if_not_found, zend_long ttl)
+/* {{{ apc_cache_value_find */
+PHP_APCU_API zval *apc_cache_value_find(const HashTable *ht, const zval *offset)
 {
-	apc_cache_entry_t *entry;
-	zend_bool retval = 0;
-	time_t t = apc_time();
+	zval *zv;
 
-	if (!cache) {
-		return 0;
+	/* empty arrays may have no hash part to look into */
+	if (ht->nNumUsed == 0) {
+		return NULL;
 	}
 
-retry_update:
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_nostat(cache, key, t);
-	if (entry) {
-		/* Only supports integers */
-		if (Z_TYPE(entry->val) == IS_LONG) {
-			retval = updater(cache, &Z_LVAL(entry->val), data);
-			entry->mtime = t;
-		}
-
-		APC_RUNLOCK(cache->header);
-		return retval;
+	/* offsets are converted as for arrays, lookups never write to the array */
+	switch (Z_TYPE_P(offset)) {
+		case IS_LONG:
+			zv = zend_hash_index_find(ht, Z_LVAL_P(offset));
+			break;
+		case IS_STRING:
+			zv = zend_symtable_find(ht, Z_STR_P(offset));
+			break;
+		case IS_NULL:
+			zv = zend_hash_str_find(ht, "", 0);
+			break;
+		case IS_FALSE:
+			zv = zend_hash_index_find(ht, 0);
+			break;
+		case IS_TRUE:
+			zv = zend_hash_index_find(ht, 1);
+			break;
+		case IS_DOUBLE:
+			zv = zend_hash_index_find(ht, zend_dval_to_lval(Z_DVAL_P(offset)));
+			break;
+		default:
+			return NULL;
 	}
 
-	APC_RUNLOCK(cache->header);
-	if (insert_if_not_found) {
-		/* Failed to find matching entry. Add key with value 0 and run the updater again. */
-		zval val;
-		ZVAL_LONG(&val, 0);
-
-		/* We do not check the return value of the exclusive-store (add), as the entry might have
-		 * been added between the cache unlock and the store call. In this case we just want to
-		 * update the entry created by a different process. */
-		apc_cache_store(cache, key, &val, ttl, 1);
-
-		/* Only attempt to perform insertion once. */
-		insert_if_not_found = 0;
-		goto retry_update;
+	if (zv) {
+		ZVAL_DEREF(zv);
 	}
 
-	return 0;
+	return zv;
 }
 /* }}} */
 
-/* {{{ apc_cache_delete */
-PHP_APCU_API zend_bool apc_cache_delete(apc_cache_t *cache, zend_string *key)
-{
-	apc_cache_entry_t **entry;
-	zend_ulong h, s;
+/* Walk path, a list of offsets into nested arrays, from value */
+static zval *apc_cache_value_walk(zval *value, HashTable *path) {
+	zval *offset;
 
-	if (!cache) {
-		return 0;
-	}
+	ZEND_HASH_FOREACH_VAL(path, offset) {
+		ZVAL_DEREF(offset);
+		if (Z_TYPE_P(value) != IS_ARRAY || !(value = apc_cache_value_find(Z_ARRVAL_P(value), offset))) {
+			return NULL;
+		}
+	} ZEND_HASH_FOREACH_END();
 
-	/* calculate hash and slot */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	return value;
+}
 
-	/* lock cache */
-	if (!APC_WLOCK(cache->header)) {
+/* {{{ apc_cache_fetch_path */
+PHP_APCU_API zend_bool apc_cache_fetch_path(
+		apc_cache_t *cache, zend_string *key, HashTable *path, time_t t, zval *dst)
+{
+	apc_cache_entry_t *entry = apc_cache_find(cache, key, t);
+	zend_bool retval = 0;
+
+	if (!entry) {
 		return 0;
 	}
 
-	/* find head */
-	entry = &cache->slots[s];
-
-	while (*entry) {
-		/* check for a match by hash and identifier */
-		if (apc_entry_key_equals(*entry, key, h)) {
-			/* executing removal */
-			apc_cache_wlocked_remove_entry(cache, entry);
+	php_apc_try {
+		if (Z_TYPE(entry->val) == IS_PTR) {
+			/* serialized values can only be walked once copied in whole */
+			zval tmp, *value;
+
+			ZVAL_UNDEF(&tmp);
+			if (apc_cache_entry_fetch_zval(cache, entry, &tmp)
+					&& (value = apc_cache_value_walk(&tmp, path))) {
+				ZVAL_COPY(dst, value);
+				retval = 1;
+			}
+			zval_ptr_dtor(&tmp);
+		} else {
+			zval *value = apc_cache_value_walk(&entry->val, path);
 
-			/* unlock header */
-			APC_WUNLOCK(cache->header);
-			return 1;
+			if (value) {
+				retval = apc_cache_entry_fetch_value(cache, entry, value, dst);
+			}
 		}
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
 
-		entry = &(*entry)->next;
-	}
-
-	/* unlock header */
-	APC_WUNLOCK(cache->header);
-	return 0;
-}
-/* }}} */
-
-/* {{{ apc_cache_entry_fetch_zval */
-PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
-		apc_cache_t *cache, apc_cache_entry_t *entry, zval *dst)
-{
-	return apc_unpersist(dst, &entry->val, cache->serializer);
+	return retval;
 }
 /* }}} */
 
@@ -1000,17 +3390,28 @@ static void apc_cache_init_entry(
 		apc_cache_entry_t *entry, zend_string *key, const zval *val, const int32_t ttl, time_t t)
 {
 	entry->ttl = ttl;
+	entry->grace = 0;
+	entry->compute_time = 0;
 	entry->key = key;
 	ZVAL_COPY_VALUE(&entry->val, val);
 
 	entry->next = NULL;
+	entry->hash = 0;
+	entry->generation = 0;
+	entry->version = 0;
 	entry->ref_count = 0;
+	entry->shared_count = 0;
 	entry->mem_size = 0;
 	entry->nhits = 0;
-	entry->ctime = t;
-	entry->mtime = t;
-	entry->atime = t;
+	entry->ctime = apc_cache_time_pack(t);
+	entry->mtime = entry->ctime;
+	entry->atime = entry->ctime;
 	entry->dtime = 0;
+	entry->refresh_time = 0;
+	entry->index_next = NULL;
+	entry->index_level = 0;
+	entry->tags = NULL;
+	entry->ntags = 0;
 }
 /* }}} */
 
@@ -1037,11 +3438,11 @@ static zval apc_cache_link_info(apc_cache_t *cache, apc_cache_entry_t *p)
 
 	array_add_long(&link, apc_str_ttl, p->ttl);
 	array_add_double(&link, apc_str_num_hits, (double) p->nhits);
-	array_add_long(&link, apc_str_mtime, p->mtime);
-	array_add_long(&link, apc_str_creation_time, p->ctime);
-	array_add_long(&link, apc_str_deletion_time, p->dtime);
-	array_add_long(&link, apc_str_access_time, p->atime);
-	array_add_long(&link, apc_str_ref_count, p->ref_count);
+	array_add_long(&link, apc_str_mtime, apc_cache_time_unpack(p->mtime));
+	array_add_long(&link, apc_str_creation_time, apc_cache_time_unpack(p->ctime));
+	array_add_long(&link, apc_str_deletion_time, apc_cache_time_unpack(p->dtime));
+	array_add_long(&link, apc_str_access_time, apc_cache_time_unpack(p->atime));
+	array_add_long(&link, apc_str_ref_count, p->ref_count + p->shared_count);
 	array_add_long(&link, apc_str_mem_size, p->mem_size);
 
 	return link;
@@ -1064,17 +3465,39 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
 
 	APC_RLOCK(cache->header);
 	php_apc_try {
+		zend_long nhits = 0, nmisses = 0, ninserts = 0;
+
+		for (i = 0; i < APC_CACHE_STATS_SHARDS; i++) {
+			nhits += cache->header->stats[i].nhits;
+			nmisses += cache->header->stats[i].nmisses;
+			ninserts += cache->header->stats[i].ninserts;
+		}
+
 		array_init(info);
 		add_assoc_long(info, "num_slots", cache->nslots);
 		array_add_long(info, apc_str_ttl, cache->ttl);
-		array_add_double(info, apc_str_num_hits, (double) cache->header->nhits);
-		add_assoc_double(info, "num_misses", (double) cache->header->nmisses);
-		add_assoc_double(info, "num_inserts", (double) cache->header->ninserts);
+		array_add_double(info, apc_str_num_hits, (double) nhits);
+		add_assoc_double(info, "num_misses", (double) nmisses);
+		add_assoc_double(info, "num_inserts", (double) ninserts);
 		add_assoc_long(info,   "num_entries", cache->header->nentries);
 		add_assoc_double(info, "expunges", (double) cache->header->nexpunges);
 		add_assoc_long(info, "start_time", cache->header->stime);
 		array_add_double(info, apc_str_mem_size, (double) cache->header->mem_size);
 
+		/* compression statistics, sizes are those of the values stored compressed */
+		{
+			const apc_cache_compression_t *compression = &cache->header->compression;
+
+			add_assoc_long(info, "num_compressed", compression->ncompressed);
+			add_assoc_double(info, "compressed_original_size", (double) compression->size_in);
+			add_assoc_double(info, "compressed_size", (double) compression->size_out);
+			add_assoc_double(info, "compression_ratio", compression->size_out
+				? (double) compression->size_in / (double) compression->size_out : 0.0);
+			add_assoc_double(info, "compress_time", (double) compression->compress_time / 1000000.0);
+			add_assoc_long(info, "num_decompressed", compression->ndecompressed);
+			add_assoc_double(info, "decompress_time", (double) compression->decompress_time / 1000000.0);
+		}
+
 #if APC_MMAP
 		add_assoc_stringl(info, "memory_type", "mmap", sizeof("mmap")-1);
 #else
@@ -1090,7 +3513,13 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
 				p = cache->slots[i];
 				j = 0;
 				for (; p != NULL; p = p->next) {
-					zval link = apc_cache_link_info(cache, p);
+					zval link;
+
+					if (apc_cache_entry_stale(cache, p)) {
+						continue;
+					}
+
+					link = apc_cache_link_info(cache, p);
 					add_next_index_zval(&list, &link);
 					j++;
 				}
@@ -1130,6 +3559,10 @@ PHP_APCU_API void apc_cache_stat(apc_cache_t *cache, zend_string *key, zval *sta
 		return;
 	}
 
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, apc_time());
+	}
+
 	/* calculate hash and slot */
 	apc_cache_hash_slot(cache, key, &h, &s);
 
@@ -1141,14 +3574,18 @@ PHP_APCU_API void apc_cache_stat(apc_cache_t *cache, zend_string *key, zval *sta
 		while (entry) {
 			/* check for a matching key by has and identifier */
 			if (apc_entry_key_equals(entry, key, h)) {
+				if (apc_cache_entry_stale(cache, entry)) {
+					break;
+				}
+
 				array_init(stat);
 				array_add_long(stat, apc_str_hits, entry->nhits);
-				array_add_long(stat, apc_str_access_time, entry->atime);
-				array_add_long(stat, apc_str_mtime, entry->mtime);
-				array_add_long(stat, apc_str_creation_time, entry->ctime);
-				array_add_long(stat, apc_str_deletion_time, entry->dtime);
+				array_add_long(stat, apc_str_access_time, apc_cache_time_unpack(entry->atime));
+				array_add_long(stat, apc_str_mtime, apc_cache_time_unpack(entry->mtime));
+				array_add_long(stat, apc_str_creation_time, apc_cache_time_unpack(entry->ctime));
+				array_add_long(stat, apc_str_deletion_time, apc_cache_time_unpack(entry->dtime));
 				array_add_long(stat, apc_str_ttl, entry->ttl);
-				array_add_long(stat, apc_str_refs, entry->ref_count);
+				array_add_long(stat, apc_str_refs, entry->ref_count + entry->shared_count);
 				break;
 			}
 
@@ -1166,30 +3603,37 @@ PHP_APCU_API zend_bool apc_cache_defense(apc_cache_t *cache, zend_string *key, t
 	/* only continue if slam defense is enabled */
 	if (cache->defend) {
 
-		/* for copy of locking key struct */
-		apc_cache_slam_key_t *last = &cache->header->lastkey;
+		/* keys are tracked in a small table, so slams of many keys are caught at once */
+		zend_ulong hash = ZSTR_HASH(key);
+		apc_cache_slam_key_t *last =
+			&cache->header->slam_keys[hash & (APC_CACHE_SLAM_KEYS - 1)];
 		pid_t owner_pid = getpid();
 #ifdef ZTS
 		void ***owner_thread = TSRMLS_CACHE;
 #endif
 
 		/* check the hash and length match */
-		/* check the time (last second considered slam) and context */
-		if (last->hash == ZSTR_HASH(key) &&
+		/* check the time (last second considered slam) */
+		if (last->hash == hash &&
 			last->len == ZSTR_LEN(key) &&
-			last->mtime == t &&
-			(last->owner_pid != owner_pid
+			last->mtime == t
+		) {
+			/* check the context */
+			if (last->owner_pid != owner_pid
 #if ZTS
 			 || last->owner_thread != owner_thread
 #endif
-			)
-		) {
-			/* potential cache slam */
-			return 1;
+			) {
+				/* potential cache slam */
+				return 1;
+			}
+
+			/* already recorded for us, don't rewrite the shared slot */
+			return 0;
 		}
 
 		/* sets enough information for an educated guess, but is not exact */
-		last->hash = ZSTR_HASH(key);
+		last->hash = hash;
 		last->len = ZSTR_LEN(key);
 		last->mtime = t;
 		last->owner_pid = owner_pid;
@@ -1202,6 +3646,16 @@ PHP_APCU_API zend_bool apc_cache_defense(apc_cache_t *cache, zend_string *key, t
 }
 /* }}} */
 
+/* {{{ apc_cache_select_stats_shard */
+PHP_APCU_API void apc_cache_select_stats_shard(void)
+{
+	zend_ulong id = (zend_ulong) getpid();
+#ifdef ZTS
+	id ^= (zend_ulong) (uintptr_t) TSRMLS_CACHE >> 4;
+#endif
+	APCG(stats_shard) = id & (APC_CACHE_STATS_SHARDS - 1);
+} /* }}} */
+
 /* {{{ apc_cache_serializer */
 PHP_APCU_API void apc_cache_serializer(apc_cache_t* cache, const char* name) {
 	if (cache && !cache->serializer) {
@@ -1209,62 +3663,302 @@ PHP_APCU_API void apc_cache_serializer(apc_cache_t* cache, const char* name) {
 	}
 } /* }}} */
 
-PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long now, zval *return_value) {/*{{{*/
-	apc_cache_entry_t *entry = NULL;
+/* A regeneration claim older than this is considered abandoned and may be taken over */
+#define APC_CACHE_REFRESH_TIMEOUT 30
+
+/* {{{ apc_cache_refresh_t
+   A regeneration deferred to the end of the request */
+typedef struct apc_cache_refresh_t {
+	apc_cache_t *cache;
+	zend_string *key;
+	zval callback;
+	zend_long ttl;
+	zend_long grace;
+} apc_cache_refresh_t; /* }}} */
+
+/* XFetch: regenerate early with a probability growing as the expiry approaches, scaled by
+ * the time the value took to generate. */
+static zend_bool apc_cache_entry_refresh_early(apc_cache_entry_t *entry, time_t t, double beta) {
+	double delta;
+
+	if (beta <= 0 || !entry->ttl || !entry->compute_time) {
+		return 0;
+	}
+
+	delta = (double) entry->compute_time / 1000.0;
+	return (double) t - delta * beta * log(php_combined_lcg())
+		>= (double) (apc_cache_time_unpack(entry->ctime) + entry->ttl);
+}
+
+/* Only one worker at a time may hold the claim to regenerate an entry */
+static zend_bool apc_cache_entry_claim_refresh(apc_cache_entry_t *entry, time_t t) {
+	zend_long claimed = entry->refresh_time;
+
+	if (claimed && claimed + APC_CACHE_REFRESH_TIMEOUT > (zend_long) t) {
+		return 0;
+	}
+
+	return ATOMIC_CAS(entry->refresh_time, claimed, (zend_long) t);
+}
+
+/* {{{ apc_cache_entry_fetch_stale
+   Looks up key for apc_cache_entry, serving entries through their grace period.
+   *refresh is set if the caller claimed the regeneration of the entry, in which case
+   the current value is only copied to dst if the regeneration is deferred. */
+static zend_bool apc_cache_entry_fetch_stale(
+		apc_cache_t *cache, zend_string *key, time_t t, double beta, zend_bool defer,
+		zval *dst, zend_bool *refresh) {
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+	zend_ulong h, s;
+
+	*refresh = 0;
+
+	/* calculate hash and slot */
+	apc_cache_hash_slot(cache, key, &h, &s);
+
+	APC_RLOCK(cache->header);
+	entry = cache->slots[s];
+	while (entry && !apc_entry_key_equals(entry, key, h)) {
+		entry = entry->next;
+	}
+
+	if (!entry || apc_cache_entry_grace_expired(cache, entry, t)) {
+		ATOMIC_INC_RLOCKED(APC_CACHE_STATS(cache).nmisses);
+		APC_RUNLOCK(cache->header);
+		return 0;
+	}
+
+	if (apc_cache_entry_hard_expired(cache, entry, t) || apc_cache_entry_refresh_early(entry, t, beta)) {
+		*refresh = apc_cache_entry_claim_refresh(entry, t);
+	}
+
+	if (*refresh && !defer) {
+		APC_RUNLOCK(cache->header);
+		return 0;
+	}
+
+	ATOMIC_INC_RLOCKED(APC_CACHE_STATS(cache).nhits);
+	apc_cache_rlocked_touch(entry, t);
+	ATOMIC_INC_RLOCKED(entry->ref_count);
+	APC_RUNLOCK(cache->header);
+
+	php_apc_try {
+		retval = apc_cache_entry_fetch_zval(cache, entry, dst);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	return retval;
+} /* }}} */
+
+static inline double apc_cache_entry_clock(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double) tv.tv_sec * 1000.0 + (double) tv.tv_usec / 1000.0;
+}
+
+/* {{{ apc_cache_entry_call
+   Calls the generator of an entry, returns the time it took in milliseconds, or -1 on failure */
+static zend_long apc_cache_entry_call(
+		zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zval *return_value) {
+	int result;
+	double start = apc_cache_entry_clock();
+	zval params[1];
+	ZVAL_STR_COPY(&params[0], key);
+
+	fci->retval = return_value;
+	fci->param_count = 1;
+	fci->params = params;
+
+	result = zend_call_function(fci, fcc);
+
+	zval_ptr_dtor(&params[0]);
+
+	if (result != SUCCESS || EG(exception)) {
+		return -1;
+	}
+
+	return (zend_long) (apc_cache_entry_clock() - start);
+} /* }}} */
+
+/* {{{ apc_cache_entry_regenerate
+   Regenerates an entry without holding the cache lock, replacing the current value */
+static void apc_cache_entry_regenerate(
+		apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc,
+		zend_long ttl, zend_long grace, zval *return_value) {
+	apc_cache_entry_t tmp_entry;
+	zend_long compute_time = apc_cache_entry_call(key, fci, fcc, return_value);
+
+	if (compute_time < 0) {
+		return;
+	}
+
+	apc_cache_init_entry(&tmp_entry, key, return_value, (int32_t) ttl, apc_time());
+	tmp_entry.grace = (int32_t) grace;
+	tmp_entry.compute_time = (uint32_t) compute_time;
+	apc_cache_store_entry(cache, &tmp_entry, 0);
+} /* }}} */
+
+static void apc_cache_refresh_dtor(void *data) {
+	apc_cache_refresh_t *refresh = (apc_cache_refresh_t *) data;
+	zend_string_release(refresh->key);
+	zval_ptr_dtor(&refresh->callback);
+}
+
+static void apc_cache_entry_defer(
+		apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_long ttl, zend_long grace) {
+	apc_cache_refresh_t refresh;
+
+	if (!APCG(deferred_refresh)) {
+		APCG(deferred_refresh) = emalloc(sizeof(zend_llist));
+		zend_llist_init(APCG(deferred_refresh), sizeof(apc_cache_refresh_t), apc_cache_refresh_dtor, 0);
+	}
+
+	refresh.cache = cache;
+	refresh.key = zend_string_copy(key);
+	ZVAL_COPY(&refresh.callback, &fci->function_name);
+	refresh.ttl = ttl;
+	refresh.grace = grace;
+
+	zend_llist_add_element(APCG(deferred_refresh), &refresh);
+}
+
+PHP_APCU_API void apc_cache_entry(
+		apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc,
+		zend_long ttl, zend_long grace, double beta, zend_bool defer, zend_long now, zval *return_value) {/*{{{*/
+	apc_lock_t *key_lock;
 
 	if (!cache) {
 		return;
 	}
 
-#ifndef APC_LOCK_RECURSIVE
+	if (cache->lazy) {
+		apc_cache_lazy_load(cache, key, now);
+	}
+
+	if (grace > 0 || beta > 0) {
+		zend_bool refresh;
+
+		if (apc_cache_entry_fetch_stale(cache, key, now, beta, defer, return_value, &refresh)) {
+			if (refresh) {
+				apc_cache_entry_defer(cache, key, fci, ttl, grace);
+			}
+			return;
+		}
+
+		if (refresh) {
+			apc_cache_entry_regenerate(cache, key, fci, fcc, ttl, grace, return_value);
+			return;
+		}
+	} else if (apc_cache_fetch(cache, key, now, return_value)) {
+		return;
+	}
+
+	/* Generators may take long, only callers of keys sharing the same key lock wait for them.
+	 * Nested calls don't take a key lock: two workers generating nested keys in opposite
+	 * order would otherwise deadlock. */
+	key_lock = &cache->header->key_locks[ZSTR_HASH(key) & (APC_CACHE_KEY_LOCKS - 1)];
 	if (APCG(recursion)++ == 0) {
-		if (!APC_WLOCK(cache->header)) {
+		if (!WLOCK(key_lock)) {
 			APCG(recursion)--;
 			return;
 		}
 	}
-#else
-	if (!APC_WLOCK(cache->header)) {
-		return;
-	}
-#endif
 
 	php_apc_try {
-		entry = apc_cache_rlocked_find_incref(cache, key, now);
-		if (!entry) {
-			int result;
-			zval params[1];
-			ZVAL_STR_COPY(&params[0], key);
+		/* Another caller may have generated the entry while we were waiting */
+		if (!apc_cache_fetch_nostat(cache, key, now, return_value)) {
+			zend_long compute_time = apc_cache_entry_call(key, fci, fcc, return_value);
 
-			fci->retval = return_value;
-			fci->param_count = 1;
-			fci->params = params;
+			if (compute_time >= 0) {
+				apc_cache_entry_t tmp_entry;
 
-			result = zend_call_function(fci, fcc);
-
-			zval_ptr_dtor(&params[0]);
-
-			if (result == SUCCESS && !EG(exception)) {
-				apc_cache_store_internal(
-					cache, key, return_value, (uint32_t) ttl, 1);
+				apc_cache_init_entry(&tmp_entry, key, return_value, (int32_t) ttl, apc_time());
+				tmp_entry.grace = (int32_t) grace;
+				tmp_entry.compute_time = (uint32_t) compute_time;
+				apc_cache_store_entry(cache, &tmp_entry, 1);
 			}
-		} else {
-			apc_cache_entry_fetch_zval(cache, entry, return_value);
-			apc_cache_entry_release(cache, entry);
 		}
 	} php_apc_finally {
-#ifndef APC_LOCK_RECURSIVE
 		if (--APCG(recursion) == 0) {
-			APC_WUNLOCK(cache->header);
+			WUNLOCK(key_lock);
 		}
-#else
-		APC_WUNLOCK(cache->header);
-#endif
-
 	} php_apc_end_try();
 }
 /*}}}*/
 
+static void apc_cache_refresh_run(void *data) {
+	apc_cache_refresh_t *refresh = (apc_cache_refresh_t *) data;
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	zval retval;
+
+	if (zend_fcall_info_init(&refresh->callback, 0, &fci, &fcc, NULL, NULL) != SUCCESS) {
+		return;
+	}
+
+	ZVAL_UNDEF(&retval);
+	apc_cache_entry_regenerate(
+		refresh->cache, refresh->key, &fci, &fcc, refresh->ttl, refresh->grace, &retval);
+	zval_ptr_dtor(&retval);
+
+	if (EG(exception)) {
+		apc_warning("Deferred regeneration of entry '%s' failed", ZSTR_VAL(refresh->key));
+		zend_clear_exception();
+	}
+}
+
+/* {{{ apc_cache_entry_run_deferred */
+PHP_APCU_API void apc_cache_entry_run_deferred(void)
+{
+	zend_llist *deferred = APCG(deferred_refresh);
+
+	if (!deferred) {
+		return;
+	}
+
+	php_apc_try {
+		zend_llist_apply(deferred, apc_cache_refresh_run);
+	} php_apc_finally {
+		apc_cache_entry_discard_deferred();
+	} php_apc_end_try();
+} /* }}} */
+
+/* {{{ apc_cache_entry_discard_deferred */
+PHP_APCU_API void apc_cache_entry_discard_deferred(void)
+{
+	zend_llist *deferred = APCG(deferred_refresh);
+
+	if (!deferred) {
+		return;
+	}
+
+	zend_llist_destroy(deferred);
+	efree(deferred);
+	APCG(deferred_refresh) = NULL;
+} /* }}} */
+
+/* {{{ apc_cache_release_shared */
+PHP_APCU_API void apc_cache_release_shared(void)
+{
+	HashTable *shared = APCG(shared_entries);
+	zend_ulong entry;
+	zval *cache;
+
+	if (!shared) {
+		return;
+	}
+
+	ZEND_HASH_FOREACH_NUM_KEY_VAL(shared, entry, cache) {
+		apc_cache_entry_release_held(Z_PTR_P(cache), (apc_cache_entry_t *) (uintptr_t) entry);
+	} ZEND_HASH_FOREACH_END();
+
+	zend_hash_destroy(shared);
+	FREE_HASHTABLE(shared);
+	APCG(shared_entries) = NULL;
+} /* }}} */
+
 /*
  * Local variables:
  * tab-width: 4
@@ -40,39 +40,150 @@ struct apc_cache_slam_key_t {
 #endif
 };
 
-/* {{{ struct definition: apc_cache_entry_t */
 typedef struct apc_cache_entry_t apc_cache_entry_t;
+
+/* {{{ struct definition: apc_cache_tag_link_t
+   Links an entry into the list of entries carrying a tag, allocated with the entry */
+typedef struct apc_cache_tag_link_t apc_cache_tag_link_t;
+struct apc_cache_tag_link_t {
+	zend_string *tag;                /* the tag */
+	apc_cache_entry_t *entry;        /* the tagged entry */
+	apc_cache_tag_link_t *next;      /* next link in the tag bucket */
+	apc_cache_tag_link_t **pprev;    /* link pointing to this one, NULL while not linked */
+}; /* }}} */
+
+/* Entry times are stored as 32-bit offsets from this epoch (2020-01-01), lasting until 2156 */
+#define APC_CACHE_TIME_EPOCH ((time_t) 1577836800)
+
+/* Size of a CPU cache line, used to keep independently written data apart */
+#define APC_CACHE_LINE_SIZE 64
+
+/* {{{ struct definition: apc_cache_entry_t
+   Entries are allocated on a cache line, see apc_cache_entry_alloc. The fields lookups
+   write take the first line on their own, the fields compared while walking a slot chain
+   fill the second one on 64-bit platforms. The key is allocated right after the entry.
+   Times are packed, see apc_cache_time_pack. */
 struct apc_cache_entry_t {
+	/* Fields that lookups may write */
+	zend_long ref_count;     /* the reference count of this entry */
+	zend_long shared_count;  /* references to the value itself, see apc_cache_entry_hold */
+	zend_long nhits;         /* number of hits to this entry (sampled once hot) */
+	zend_long refresh_time;  /* time a worker claimed the regeneration of this entry, or 0 */
+	uint32_t atime;          /* time entry was last accessed (second resolution) */
+	char padding[APC_CACHE_LINE_SIZE - 4 * sizeof(zend_long) - sizeof(uint32_t)];
+
+	/* Fields read by every lookup */
+	apc_cache_entry_t *next; /* next entry in linked list */
+	zend_ulong hash;         /* hash of the key, compared before the key itself */
 	zend_string *key;        /* entry key */
+	int32_t ttl;             /* the ttl on this specific entry */
+	uint32_t ctime;          /* time entry was initialized */
+	uint32_t generation;     /* cache generation the entry was inserted in */
+	int32_t grace;           /* seconds past the ttl the entry may still be served by apcu_entry */
 	zval val;                /* the zval copied at store time */
-	apc_cache_entry_t *next; /* next entry in linked list */
-	zend_long ttl;           /* the ttl on this specific entry */
-	zend_long ref_count;     /* the reference count of this entry */
-	zend_long nhits;         /* number of hits to this entry */
-	time_t ctime;            /* time entry was initialized */
-	time_t mtime;            /* the mtime of this cached entry */
-	time_t dtime;            /* time entry was removed from cache */
-	time_t atime;            /* time entry was last accessed */
+	uint32_t mtime;          /* the mtime of this cached entry */
+	uint32_t dtime;          /* time entry was removed from cache */
+
+	/* Other fields that are only read by lookups */
 	zend_long mem_size;      /* memory used */
+	zend_long version;       /* unique to the value, given by apc_cache_header_t.version on insertion */
+	apc_cache_entry_t **index_next; /* successors in the prefix index, one per level */
+	apc_cache_tag_link_t *tags; /* links of this entry into the tag buckets */
+	uint32_t index_level;    /* number of levels of this entry in the prefix index */
+	uint32_t ntags;          /* number of tags */
+	uint32_t compute_time;   /* milliseconds apcu_entry took to generate the value */
 };
 /* }}} */
 
-/* {{{ struct definition: apc_cache_header_t
-   Any values that must be shared among processes should go in here. */
-typedef struct _apc_cache_header_t {
-	apc_lock_t lock;                /* header lock */
+/* Values stored compressed, see apc.compress_threshold, are IS_PTR like serialized values.
+ * The u2 of their zval tells what they decompress to, and is 0 for any other value.
+ * The data starts with the size of the value as size_t, followed by an LZ4 block. */
+#define APC_CACHE_COMPRESSED_SERIALIZED 1
+#define APC_CACHE_COMPRESSED_STRING 2
+
+/* Packs a time into an entry time field, 0 is kept to mean unset */
+static zend_always_inline uint32_t apc_cache_time_pack(time_t t) {
+	return t > APC_CACHE_TIME_EPOCH ? (uint32_t) (t - APC_CACHE_TIME_EPOCH) : 0;
+}
+
+static zend_always_inline time_t apc_cache_time_unpack(uint32_t t) {
+	return t ? APC_CACHE_TIME_EPOCH + (time_t) t : 0;
+}
+
+/* Number of statistics counter shards, must be a power of two */
+#define APC_CACHE_STATS_SHARDS 16
+
+/* Maximum number of levels of the prefix index (a skiplist ordered by key) */
+#define APC_CACHE_INDEX_LEVELS 16
+
+/* Number of tag buckets, must be a power of two */
+#define APC_CACHE_TAG_BUCKETS 1024
+
+/* Number of keys tracked by slam defense, must be a power of two */
+#define APC_CACHE_SLAM_KEYS 256
+
+/* Number of locks serializing the generation of entries, must be a power of two */
+#define APC_CACHE_KEY_LOCKS 64
+
+/* Immutable arrays the engine copies on write, which values fetched without copying rely on */
+#if PHP_VERSION_ID >= 70300
+# define APC_CACHE_IMMUTABLE 1
+#else
+# define APC_CACHE_IMMUTABLE 0
+#endif
+
+/* {{{ struct definition: apc_cache_stats_t
+   A shard of the statistics counters, occupying exactly one cache line.
+   Workers update the shard selected by APCG(stats_shard), readers sum all shards. */
+typedef struct apc_cache_stats_t {
 	zend_long nhits;                /* hit count */
 	zend_long nmisses;              /* miss count */
 	zend_long ninserts;             /* insert count */
+	char padding[APC_CACHE_LINE_SIZE - 3 * sizeof(zend_long)];
+} apc_cache_stats_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_compression_t
+   Statistics of compression, updated atomically without holding the lock */
+typedef struct apc_cache_compression_t {
+	zend_long ncompressed;          /* values stored compressed */
+	zend_long size_in;              /* their size before compression */
+	zend_long size_out;             /* their size once compressed */
+	zend_long compress_time;        /* microseconds spent compressing, counting values left as they were */
+	zend_long ndecompressed;        /* values decompressed by fetches */
+	zend_long decompress_time;      /* microseconds spent decompressing */
+} apc_cache_compression_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_header_t
+   Any values that must be shared among processes should go in here.
+   The header is cache line aligned: the lock, each statistics shard and the
+   remaining fields start on their own line. Apart from the key locks, the slam
+   keys and the compression statistics, those are only written under the write lock. */
+typedef struct _apc_cache_header_t {
+	apc_lock_t lock;                /* header lock */
+	char lock_padding[APC_CACHE_LINE_SIZE - sizeof(apc_lock_t) % APC_CACHE_LINE_SIZE];
+	apc_cache_stats_t stats[APC_CACHE_STATS_SHARDS]; /* sharded statistics counters */
 	zend_long nexpunges;            /* expunge count */
 	zend_long nentries;             /* entry count */
 	zend_long mem_size;             /* used */
 	time_t stime;                   /* start time */
 	unsigned short state;           /* cache state */
-	apc_cache_slam_key_t lastkey;   /* last key inserted (not necessarily without error) */
+	uint32_t generation;            /* entries of older generations are treated as missing */
+	zend_long version;              /* version of the last entry inserted or updated */
+	zend_long sweep_slot;           /* next slot swept for entries of older generations */
+	volatile int clear_scheduled;   /* set by apc_cache_schedule_clear */
 	apc_cache_entry_t *gc;          /* gc list */
+	apc_cache_entry_t *index[APC_CACHE_INDEX_LEVELS]; /* heads of the prefix index levels */
+	apc_cache_tag_link_t *tags[APC_CACHE_TAG_BUCKETS]; /* tagged entries, by tag hash */
+	apc_lock_t key_locks[APC_CACHE_KEY_LOCKS]; /* locks held by apcu_entry generators, by key hash */
+	apc_cache_slam_key_t slam_keys[APC_CACHE_SLAM_KEYS]; /* last keys inserted, by key hash (not necessarily without error) */
+	apc_cache_compression_t compression; /* compression statistics */
+	uint32_t uninitialized_bucket[-HT_MIN_MASK]; /* hash of persisted empty arrays, valid wherever the segment is mapped */
 } apc_cache_header_t; /* }}} */
 
+/* {{{ struct definition: apc_cache_lazy_t
+   Entries of a snapshot loaded on first access, see apc_cache_restore_lazy */
+typedef struct apc_cache_lazy_t apc_cache_lazy_t; /* }}} */
+
 /* {{{ struct definition: apc_cache_t */
 typedef struct _apc_cache_t {
 	void* shmaddr;                /* process (local) address of shared cache */
@@ -85,6 +196,10 @@ typedef struct _apc_cache_t {
 	zend_long ttl;               /* if slot is needed and entry's access time is older than this ttl, remove it */
 	zend_long smart;             /* smart parameter for gc */
 	zend_bool defend;             /* defense parameter for runtime */
+	zend_bool indexed;            /* maintain the prefix index, must be set before the first insertion */
+	zend_bool immutable;          /* persist values immutable and fetch them without copying, see apc.immutable_fetch */
+	zend_long compress_threshold; /* size from which strings and serialized values are compressed, 0 never */
+	apc_cache_lazy_t *lazy;       /* snapshot entries not loaded yet, if any */
 } apc_cache_t; /* }}} */
 
 /* {{{ typedef: apc_cache_updater_t */
@@ -93,6 +208,9 @@ typedef zend_bool (*apc_cache_updater_t)(apc_cache_t*, apc_cache_entry_t*, void*
 /* {{{ typedef: apc_cache_atomic_updater_t */
 typedef zend_bool (*apc_cache_atomic_updater_t)(apc_cache_t*, zend_long*, void* data); /* }}} */
 
+/* {{{ typedef: apc_cache_entry_predicate_t */
+typedef zend_bool (*apc_cache_entry_predicate_t)(apc_cache_entry_t*, void* data); /* }}} */
+
 /*
  * apc_cache_create creates the shared memory cache.
  *
@@ -122,11 +240,71 @@ typedef zend_bool (*apc_cache_atomic_updater_t)(apc_cache_t*, zend_long*, void*
 PHP_APCU_API apc_cache_t* apc_cache_create(
         apc_sma_t* sma, apc_serializer_t* serializer, zend_long size_hint,
         zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend);
+
+/*
+ * apc_cache_attach attaches to a cache created by apc_cache_create, found at shmaddr
+ * in a named segment (see apc_sma_init_file).
+ *
+ * recover is set if the segment was left behind by processes that are gone: locks are
+ * then recreated and all references, regenerations and the gc list are dropped, no
+ * process is left to hold them. Otherwise the cache is shared with its other users.
+ */
+PHP_APCU_API apc_cache_t* apc_cache_attach(
+        apc_sma_t* sma, apc_serializer_t* serializer, void *shmaddr, zend_long size_hint,
+        zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend, zend_bool recover);
+
+/*
+ * apc_cache_format writes the string identifying the layout of a cache created with
+ * these options by this build to buf, for apc_sma_init_file
+ */
+PHP_APCU_API void apc_cache_format(
+        char *buf, size_t size, const char *serializer_name, zend_long size_hint, zend_bool indexed);
+
 /*
 * apc_cache_preload preloads the data at path into the specified cache
 */
 PHP_APCU_API zend_bool apc_cache_preload(apc_cache_t* cache, const char* path);
 
+/*
+ * apc_cache_dump writes a snapshot of all live entries of the cache to path, without
+ * holding the lock while writing, returning the number of entries or -1 on failure
+ */
+PHP_APCU_API zend_long apc_cache_dump(apc_cache_t *cache, const char *path);
+
+/*
+ * apc_cache_restore adds the entries of a snapshot written by apc_cache_dump to the cache,
+ * which must be configured the same way, returning the number of entries or -1 on failure.
+ * Entries already in the cache are kept.
+ */
+PHP_APCU_API zend_long apc_cache_restore(apc_cache_t *cache, const char *path);
+
+/*
+ * apc_cache_export writes the live entries for which predicate returns true (all of them
+ * if it is NULL) to stream in the format of apc_cache_dump, returning their number or -1
+ * on failure. Entries are pinned a chunk at a time, the lock is released while writing.
+ * The predicate is called with the read lock held, it must not call back into the cache.
+ */
+PHP_APCU_API zend_long apc_cache_export(
+        apc_cache_t *cache, php_stream *stream, apc_cache_entry_predicate_t predicate, void *data);
+
+/*
+ * apc_cache_import adds the entries written by apc_cache_export to stream, reading up to the
+ * end of the export, like apc_cache_restore does
+ */
+PHP_APCU_API zend_long apc_cache_import(apc_cache_t *cache, php_stream *stream);
+
+#if APC_MMAP
+/*
+ * apc_cache_restore_lazy maps a snapshot written by apc_cache_dump and indexes its keys,
+ * returning their number or -1 on failure. Each entry is only copied into the cache when
+ * its key is first accessed, unless the key was written to or deleted since.
+ *
+ * Entries not loaded yet are not visible to cache info or iterators.
+ * Should be called once, at startup, before any process uses the cache.
+ */
+PHP_APCU_API zend_long apc_cache_restore_lazy(apc_cache_t *cache, const char *path);
+#endif
+
 /*
  * apc_cache_detach detaches from the shared memory cache and cleans up
  * local allocations. Under apache, this function can be safely called by
@@ -136,15 +314,57 @@ PHP_APCU_API void apc_cache_detach(apc_cache_t* cache);
 
 /*
  * apc_cache_clear empties a cache. This can safely be called at any time.
+ * It only starts a new generation: entries of the previous ones are treated as
+ * missing and their memory is reclaimed by later insertions and expunges.
  */
 PHP_APCU_API void apc_cache_clear(apc_cache_t* cache);
 
+/*
+ * apc_cache_schedule_clear requests that the cache be cleared, by the next process
+ * calling apc_cache_run_scheduled_clear. It takes no lock and is async-signal-safe.
+ */
+PHP_APCU_API void apc_cache_schedule_clear(apc_cache_t* cache);
+
+/*
+ * apc_cache_run_scheduled_clear clears the cache if a clear was scheduled
+ */
+PHP_APCU_API void apc_cache_run_scheduled_clear(apc_cache_t* cache);
+
 /*
  * apc_cache_store creates key, entry and context in which to make an insertion of val into the specified cache
  */
 PHP_APCU_API zend_bool apc_cache_store(
         apc_cache_t* cache, zend_string *key, const zval *val,
         const int32_t ttl, const zend_bool exclusive);
+
+/*
+ * apc_cache_store_tagged is apc_cache_store, attaching the tags (strings) to the entry
+ */
+PHP_APCU_API zend_bool apc_cache_store_tagged(
+        apc_cache_t* cache, zend_string *key, const zval *val,
+        const int32_t ttl, const zend_bool exclusive, HashTable *tags);
+
+/*
+ * apc_cache_store_multi stores all key/value pairs of values, persisting them before
+ * taking the write lock once to insert them. Keys that could not be stored are added
+ * to failed, with the value -1, unless it is NULL.
+ */
+PHP_APCU_API void apc_cache_store_multi(
+        apc_cache_t* cache, HashTable *values, const int32_t ttl,
+        const zend_bool exclusive, HashTable *tags, HashTable *failed);
+
+/*
+ * apc_cache_store_if_version stores the value only if the version of the entry of key is still
+ * version, 0 meaning that there is no such entry. Versions are given by apc_cache_fetch_if_changed.
+ */
+PHP_APCU_API zend_bool apc_cache_store_if_version(
+        apc_cache_t *cache, zend_string *key, const zval *val, zend_long version, const int32_t ttl);
+
+/*
+ * apc_cache_invalidate_tags deletes all entries carrying any of the tags,
+ * and returns the number of deleted entries.
+ */
+PHP_APCU_API zend_long apc_cache_invalidate_tags(apc_cache_t* cache, HashTable *tags);
 /*
  * apc_cache_update updates an entry in place. The updater function must not bailout.
  * The update is performed under write-lock and doesn't have to be atomic.
@@ -174,6 +394,21 @@ PHP_APCU_API apc_cache_entry_t* apc_cache_find(apc_cache_t* cache, zend_string *
  */
 PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, time_t t, zval *dst);
 
+/*
+ * apc_cache_fetch_if_changed fetches an entry into dst unless its version is *version, which
+ * is set to the version found, 0 if there is no entry. Every store or in place update of an
+ * entry gives it a new version, greater than any given before in the cache.
+ */
+PHP_APCU_API zend_bool apc_cache_fetch_if_changed(
+        apc_cache_t *cache, zend_string *key, zend_long *version, time_t t, zval *dst);
+
+/*
+ * apc_cache_fetch_multi fetches the entries of all keys into dst, taking the lock once.
+ * Keys that are not found are left out of dst.
+ */
+PHP_APCU_API void apc_cache_fetch_multi(
+        apc_cache_t *cache, zend_string **keys, size_t nkeys, time_t t, HashTable *dst);
+
 /*
  * apc_cache_exists searches for a cache entry by its hashed identifier,
  * and returns whether the entry exists.
@@ -185,11 +420,63 @@ PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, ti
  */
 PHP_APCU_API zend_bool apc_cache_delete(apc_cache_t* cache, zend_string *key);
 
+/*
+ * apc_cache_delete_multi deletes the entries of all keys, taking the lock once.
+ * deleted[i] is set to whether the entry of keys[i] was found and deleted.
+ */
+PHP_APCU_API void apc_cache_delete_multi(
+        apc_cache_t* cache, zend_string **keys, size_t nkeys, zend_bool *deleted);
+
+/*
+ * apc_cache_delete_matching deletes all entries for which predicate returns true,
+ * in a single scan of the slots, and returns how many were deleted.
+ * The predicate is called with the write lock held, it must not call back into the cache.
+ */
+PHP_APCU_API zend_long apc_cache_delete_matching(
+        apc_cache_t* cache, apc_cache_entry_predicate_t predicate, void *data);
+
+/*
+ * apc_cache_delete_prefix deletes all entries whose key starts with prefix,
+ * and returns the number of deleted entries.
+ * With the prefix index this takes time proportional to the number of matching keys,
+ * otherwise all slots are scanned.
+ */
+PHP_APCU_API zend_long apc_cache_delete_prefix(apc_cache_t* cache, zend_string *prefix);
+
+/*
+ * apc_cache_fetch_prefix fetches all entries whose key starts with prefix into
+ * the array dst, indexed by key (in key order if the prefix index is used).
+ */
+PHP_APCU_API zend_bool apc_cache_fetch_prefix(apc_cache_t* cache, zend_string *prefix, time_t t, zval *dst);
+
 /* apc_cache_fetch_zval copies a cache entry value to be usable at runtime.
  */
 PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
 		apc_cache_t *cache, apc_cache_entry_t *entry, zval *dst);
 
+/*
+ * apc_cache_entry_fetch_value copies value, the value of entry or an element within it, to be
+ * usable at runtime. The entry must be pinned. With cache->immutable, values persisted immutable
+ * are returned without copying, the entry then stays pinned until the end of the request.
+ */
+PHP_APCU_API zend_bool apc_cache_entry_fetch_value(
+		apc_cache_t *cache, apc_cache_entry_t *entry, const zval *value, zval *dst);
+
+/*
+ * apc_cache_value_find looks up offset in ht, a persisted array, converting offset as array
+ * offsets are converted. Returns the dereferenced element, or NULL if there is none or offset
+ * is of an illegal type. The array is only read, it can be shared with other processes.
+ */
+PHP_APCU_API zval *apc_cache_value_find(const HashTable *ht, const zval *offset);
+
+/*
+ * apc_cache_fetch_path fetches the element at path, a list of offsets into nested arrays,
+ * of the value stored at key into dst. Only that element is copied, unless the value was
+ * serialized. Returns 0 if there is no such element.
+ */
+PHP_APCU_API zend_bool apc_cache_fetch_path(
+		apc_cache_t *cache, zend_string *key, HashTable *path, time_t t, zval *dst);
+
 /*
  * apc_cache_entry_release decrements the reference count associated with a cache
  * entry. Calling apc_cache_find automatically increments the reference count,
@@ -214,7 +501,8 @@ PHP_APCU_API void apc_cache_stat(apc_cache_t *cache, zend_string *key, zval *sta
 /*
 * apc_cache_defense: guard against slamming a key
 *  will return true if the following conditions are met:
-*	the key provided has a matching hash and length to the last key inserted into cache
+*	the key provided has a matching hash and length to the last key inserted into its slot
+*	of the slam key table during the same second
 *   the last key has a different owner
 * in ZTS mode, TSRM determines owner
 * in non-ZTS mode, PID determines owner
@@ -222,6 +510,13 @@ PHP_APCU_API void apc_cache_stat(apc_cache_t *cache, zend_string *key, zval *sta
 */
 PHP_APCU_API zend_bool apc_cache_defense(apc_cache_t *cache, zend_string *key, time_t t);
 
+/*
+* apc_cache_select_stats_shard
+* selects the statistics counter shard updated by the calling worker (process or thread)
+* Note: should be called once per request, after the worker has been forked
+*/
+PHP_APCU_API void apc_cache_select_stats_shard(void);
+
 /*
 * apc_cache_serializer
 * sets the serializer for a cache, and by proxy contexts created for the cache
@@ -267,9 +562,59 @@ PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size);
 /*
 * apc_cache_entry: generate and create or fetch an entry
 *
+* The generator runs under a key lock only, callers of other keys are not blocked by it.
+* grace is the number of seconds an expired entry is still returned while a single
+* worker regenerates it, beta (> 0) enables probabilistic early regeneration of entries
+* about to expire (XFetch), and defer postpones the regeneration until the end of the
+* request, returning the current value meanwhile.
+*
 * @see https://github.com/krakjoe/apcu/issues/142
 */
-PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long now, zval *return_value);
+PHP_APCU_API void apc_cache_entry(
+		apc_cache_t *cache, zend_string *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc,
+		zend_long ttl, zend_long grace, double beta, zend_bool defer, zend_long now, zval *return_value);
+
+/*
+* apc_cache_entry_run_deferred: run the regenerations deferred by apc_cache_entry
+* Note: called by apcu_entry_run_deferred(), which is registered as a shutdown function
+*/
+PHP_APCU_API void apc_cache_entry_run_deferred(void);
+
+/*
+* apc_cache_entry_discard_deferred: drop the regenerations deferred by apc_cache_entry without running them
+* Note: called on request shutdown, their claims time out
+*/
+PHP_APCU_API void apc_cache_entry_discard_deferred(void);
+
+/*
+* apc_cache_entry_hold: turn the reference apc_cache_find took on an entry into one on its value
+* Note: for values used in place until the request ends or an object is freed. Unlike references
+*  to the entry, those are never dropped by the garbage collection after apc.gc_ttl
+*/
+PHP_APCU_API void apc_cache_entry_hold(apc_cache_t *cache, apc_cache_entry_t *entry);
+
+/*
+* apc_cache_entry_release_held: release a reference taken with apc_cache_entry_hold
+*/
+PHP_APCU_API void apc_cache_entry_release_held(apc_cache_t *cache, apc_cache_entry_t *entry);
+
+/*
+* apc_cache_release_shared: release the entries whose values fetches returned without copying
+* Note: called once the engine is done with the request data, values in it may point into them
+*/
+PHP_APCU_API void apc_cache_release_shared(void);
+
+/*
+* apc_cache_local_collect: free the stale values of the local cache and evict the least
+* recently fetched ones until it fits in apc.local_size
+* Note: called once the engine is done with the request data, like apc_cache_release_shared
+*/
+PHP_APCU_API void apc_cache_local_collect(void);
+
+/*
+* apc_cache_local_destroy: free the whole local cache of this process
+*/
+PHP_APCU_API void apc_cache_local_destroy(void);
 
 #endif
 
@@ -48,6 +48,8 @@ ZEND_BEGIN_MODULE_GLOBALS(apcu)
 
 #if APC_MMAP
 	char *mmap_file_mask;   /* mktemp-style file-mask to pass to mmap */
+	char *persist_file;     /* file backing the main cache across restarts */
+	char *shm_name;         /* named segment holding the main cache, shared between servers */
 #endif
 
 	/* module variables */
@@ -56,13 +58,32 @@ ZEND_BEGIN_MODULE_GLOBALS(apcu)
 	zend_bool slam_defense;      /* true for user cache slam defense */
 
 	char *preload_path;          /* preload path */
+	zend_long preload_threads;   /* threads reading the files in preload_path */
+	char *restore_file;          /* snapshot restored at startup */
+	zend_bool restore_lazy;      /* load entries of the snapshot on first access */
 	zend_bool coredump_unmap;    /* trap signals that coredump and unmap shared memory */
 	zend_bool use_request_time;  /* use the SAPI request start time for TTL */
 	time_t request_time;         /* cached request time */
 
 	char *serializer_name;       /* the serializer config option */
+	zend_bool prefix_index;      /* maintain an ordered index of keys for prefix operations */
+	zend_bool immutable_fetch;   /* fetch strings and arrays without copying them out of shared memory */
+	zend_long local_size;        /* memory of the process local cache, 0 disables it */
+	zend_long compress_threshold; /* size from which values are stored compressed, 0 disables it */
 
-	volatile unsigned recursion;
+	char *pools;                 /* named pools to create, as name:size[,name:size...] */
+	char *pool_name;             /* pool used by requests, defaults to the main cache */
+	apc_cache_t *cache;          /* cache of the pool selected by the current request */
+
+	volatile unsigned recursion; /* nesting level of apcu_entry generators */
+	uint32_t rand_seed;          /* state of the cheap random numbers used by the cache */
+	zend_ulong stats_shard;      /* statistics counter shard used by this worker */
+	zend_llist *deferred_refresh; /* entry regenerations deferred to the shutdown functions */
+	HashTable *shared_entries;   /* entries pinned by fetches that did not copy their value */
+	HashTable *local;            /* values kept across requests by this process, by key */
+	size_t local_mem;            /* memory used by the values in local */
+	zend_ulong local_clock;      /* number of requests served, orders local values by last use */
+	struct apc_cache_local_t *local_retired; /* stale local values, freed after the request */
 ZEND_END_MODULE_GLOBALS(apcu)
 
 /* (the following is defined in php_apc.c) */
@@ -75,6 +96,20 @@ ZEND_EXTERN_MODULE_GLOBALS(apcu)
 #endif
 
 extern apc_cache_t* apc_user_cache;
+
+/* {{{ struct definition: apc_pool_t
+   A named cache with its own shared memory, lock and slots, see apc.pools */
+typedef struct apc_pool_t {
+	char *name;                  /* name of the pool */
+	apc_sma_t sma;               /* shared memory of the pool */
+	apc_cache_t *cache;          /* cache of the pool */
+} apc_pool_t; /* }}} */
+
+extern apc_pool_t* apc_pools;
+extern int apc_npools;
+
+/* (the following is defined in php_apc.c) */
+apc_cache_t* apc_pool_find(const char *name, size_t len);
 #endif
 
 /*
@@ -0,0 +1,340 @@
+/*
+  +----------------------------------------------------------------------+
+  | APCu                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 The PHP Group                                     |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+ */
+
+/*
+ * apcu-inspect prints what a named segment (see apc.shm_name) holds, without PHP:
+ *
+ *   apcu-inspect [-n count] [-s size|hits] name
+ *
+ * The segment is mapped read only and no lock is ever taken, so this works while
+ * the processes using it are stuck, at the price of figures that may not add up
+ * exactly while they write. Every pointer read from the segment is checked to stay
+ * within it, and every walk is bounded, so a torn read cannot crash it.
+ */
+
+#include "apc.h"
+#include "apc_sma.h"
+#include "apc_cache_api.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* Longest chain walked, anything longer is considered corrupted */
+#define APC_INSPECT_MAX_WALK (1 << 24)
+
+/* Chain lengths counted separately, longer ones are counted with the last */
+#define APC_INSPECT_CHAINS 8
+
+typedef struct apc_inspect_t {
+	const char *map;         /* the segment, as mapped here */
+	const char *base;        /* the address its users map it at */
+	size_t size;
+} apc_inspect_t;
+
+typedef struct apc_inspect_entry_t {
+	const zend_string *key;
+	zend_long mem_size;
+	zend_long nhits;
+	int32_t ttl;
+} apc_inspect_entry_t;
+
+/* {{{ apc_inspect_at: the local address of len bytes at ptr in the segment, NULL if they are not within it */
+static const void *apc_inspect_at(const apc_inspect_t *inspect, const void *ptr, size_t len)
+{
+	size_t offset = (const char *) ptr - inspect->base;
+
+	if (!ptr || (const char *) ptr < inspect->base || offset > inspect->size || len > inspect->size - offset) {
+		return NULL;
+	}
+
+	return inspect->map + offset;
+} /* }}} */
+
+/* {{{ apc_inspect_key */
+static const zend_string *apc_inspect_key(const apc_inspect_t *inspect, const zend_string *key)
+{
+	const zend_string *local = apc_inspect_at(inspect, key, sizeof(zend_string));
+
+	if (!local || ZSTR_LEN(local) > inspect->size
+			|| !apc_inspect_at(inspect, key, _ZSTR_STRUCT_SIZE(ZSTR_LEN(local)))) {
+		return NULL;
+	}
+
+	return local;
+} /* }}} */
+
+/* {{{ apc_inspect_map */
+static int apc_inspect_map(apc_inspect_t *inspect, const char *name)
+{
+	struct stat sb;
+	void *map;
+	int fd;
+
+	if (strstr(name, ".shm")) {
+		fd = shm_open(name, O_RDONLY, 0);
+	} else {
+		fd = open(name, O_RDONLY);
+	}
+
+	if (fd == -1) {
+		fprintf(stderr, "apcu-inspect: cannot open %s: %s\n", name, strerror(errno));
+		return 0;
+	}
+
+	if (fstat(fd, &sb) < 0 || (size_t) sb.st_size < sizeof(sma_header_t)) {
+		fprintf(stderr, "apcu-inspect: %s is not an APCu segment\n", name);
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "apcu-inspect: cannot map %s: %s\n", name, strerror(errno));
+		return 0;
+	}
+
+	inspect->map = map;
+	inspect->size = sb.st_size;
+	inspect->base = ((const sma_header_t *) map)->base;
+
+	return 1;
+} /* }}} */
+
+/* {{{ apc_inspect_sma prints the usage of the segment and how fragmented its free memory is */
+static void apc_inspect_sma(const apc_inspect_t *inspect)
+{
+	const sma_header_t *header = (const sma_header_t *) inspect->map;
+	size_t offset = ALIGNWORD(sizeof(sma_header_t));
+	size_t nfree = 0, free_size = 0, largest = 0;
+	size_t small = 0, medium = 0, large = 0;
+	const block_t *block;
+
+	/* the first block is a sentinel heading the free list, a zero-size one ends it */
+	while ((block = apc_inspect_at(inspect, inspect->base + offset, sizeof(block_t))) && block->fnext) {
+		offset = block->fnext;
+		block = apc_inspect_at(inspect, inspect->base + offset, sizeof(block_t));
+		if (block && block->size == 0) {
+			break;
+		}
+		if (!block || ++nfree > APC_INSPECT_MAX_WALK) {
+			printf("free list:        cut short, the segment is being written\n");
+			break;
+		}
+
+		free_size += block->size;
+		largest = MAX(largest, block->size);
+		if (block->size < 1024) {
+			small++;
+		} else if (block->size < 1024 * 1024) {
+			medium++;
+		} else {
+			large++;
+		}
+	}
+
+	printf("segment size:     %zu\n", header->segsize);
+	printf("available:        %zu\n", header->avail);
+	printf("free blocks:      %zu (%zu < 1K, %zu < 1M, %zu larger)\n", nfree, small, medium, large);
+	printf("largest free:     %zu\n", largest);
+	printf("fragmentation:    %.1f%%\n",
+		free_size ? 100.0 * (double) (free_size - largest) / (double) free_size : 0.0);
+} /* }}} */
+
+/* {{{ apc_inspect_top keeps the count entries that rank highest, top is sorted in descending order */
+static void apc_inspect_top(
+		apc_inspect_entry_t *top, zend_long count, zend_long *ntop,
+		const apc_inspect_entry_t *entry, zend_bool by_hits)
+{
+	zend_long rank = by_hits ? entry->nhits : entry->mem_size;
+	zend_long i;
+
+	if (*ntop == count) {
+		i = count - 1;
+		if ((by_hits ? top[i].nhits : top[i].mem_size) >= rank) {
+			return;
+		}
+	} else {
+		i = (*ntop)++;
+	}
+
+	for (; i > 0 && (by_hits ? top[i - 1].nhits : top[i - 1].mem_size) < rank; i--) {
+		top[i] = top[i - 1];
+	}
+	top[i] = *entry;
+} /* }}} */
+
+/* {{{ apc_inspect_cache prints the cache header, how long the slot chains are and the top entries */
+static void apc_inspect_cache(const apc_inspect_t *inspect, zend_long count, zend_bool by_hits)
+{
+	const sma_header_t *sma = (const sma_header_t *) inspect->map;
+	const apc_cache_header_t *header;
+	apc_cache_entry_t * const *slots;
+	apc_inspect_entry_t *top;
+	zend_long nslots = 0, ntop = 0, i;
+	zend_long nhits = 0, nmisses = 0, ninserts = 0;
+	size_t chains[APC_INSPECT_CHAINS] = {0};
+	size_t nentries = 0, longest = 0, ngc = 0;
+	const char *slots_format = strstr(sma->format, " slots ");
+	const apc_cache_entry_t *entry;
+
+	header = apc_inspect_at(inspect,
+		(const void *) ZEND_MM_ALIGNED_SIZE_EX((uintptr_t) sma->root, APC_CACHE_LINE_SIZE),
+		sizeof(apc_cache_header_t));
+	if (slots_format) {
+		nslots = ZEND_STRTOL(slots_format + sizeof(" slots ") - 1, NULL, 10);
+	}
+	if (!header || nslots <= 0) {
+		printf("cache:            not created yet\n");
+		return;
+	}
+
+	slots = apc_inspect_at(inspect,
+		sma->root ? (const char *) ZEND_MM_ALIGNED_SIZE_EX((uintptr_t) sma->root, APC_CACHE_LINE_SIZE) + sizeof(apc_cache_header_t) : NULL,
+		nslots * sizeof(apc_cache_entry_t *));
+	if (!slots) {
+		printf("cache:            slots out of the segment\n");
+		return;
+	}
+
+	for (i = 0; i < APC_CACHE_STATS_SHARDS; i++) {
+		nhits += header->stats[i].nhits;
+		nmisses += header->stats[i].nmisses;
+		ninserts += header->stats[i].ninserts;
+	}
+
+	for (entry = header->gc; entry && ngc < APC_INSPECT_MAX_WALK; entry = entry->next) {
+		if (!(entry = apc_inspect_at(inspect, entry, sizeof(apc_cache_entry_t)))) {
+			break;
+		}
+		ngc++;
+	}
+
+	printf("start time:       %ld\n", (long) header->stime);
+	printf("entries:          " ZEND_LONG_FMT "\n", header->nentries);
+	printf("memory used:      " ZEND_LONG_FMT "\n", header->mem_size);
+	printf("hits:             " ZEND_LONG_FMT "\n", nhits);
+	printf("misses:           " ZEND_LONG_FMT "\n", nmisses);
+	printf("inserts:          " ZEND_LONG_FMT "\n", ninserts);
+	printf("expunges:         " ZEND_LONG_FMT "\n", header->nexpunges);
+	printf("generation:       %u\n", header->generation);
+	printf("compressed:       " ZEND_LONG_FMT " (" ZEND_LONG_FMT " bytes to " ZEND_LONG_FMT ")\n",
+		header->compression.ncompressed, header->compression.size_in, header->compression.size_out);
+	printf("gc list:          %zu\n", ngc);
+
+	top = calloc(count, sizeof(apc_inspect_entry_t));
+
+	for (i = 0; i < nslots; i++) {
+		size_t length = 0;
+
+		for (entry = slots[i]; entry && length < APC_INSPECT_MAX_WALK; entry = entry->next) {
+			apc_inspect_entry_t found;
+
+			if (!(entry = apc_inspect_at(inspect, entry, sizeof(apc_cache_entry_t)))) {
+				break;
+			}
+			length++;
+
+			found.key = entry->key;
+			found.mem_size = entry->mem_size;
+			found.nhits = entry->nhits;
+			found.ttl = entry->ttl;
+			if (top && count > 0) {
+				apc_inspect_top(top, count, &ntop, &found, by_hits);
+			}
+		}
+
+		nentries += length;
+		longest = MAX(longest, length);
+		chains[MIN(length, APC_INSPECT_CHAINS - 1)]++;
+	}
+
+	printf("slots:            " ZEND_LONG_FMT " (load %.2f, longest chain %zu)\n",
+		nslots, (double) nentries / (double) nslots, longest);
+	for (i = 0; i < APC_INSPECT_CHAINS; i++) {
+		printf("  chains of %s%-2ld    %zu\n", i == APC_INSPECT_CHAINS - 1 ? ">=" : "  ", (long) i, chains[i]);
+	}
+
+	printf("top entries by %s:\n", by_hits ? "hits" : "size");
+	for (i = 0; i < ntop; i++) {
+		const zend_string *key = apc_inspect_key(inspect, top[i].key);
+
+		printf("  %10" ZEND_LONG_FMT_SPEC " bytes %10" ZEND_LONG_FMT_SPEC " hits  ttl %-6d %.*s\n",
+			top[i].mem_size, top[i].nhits, top[i].ttl,
+			key ? (int) MIN(ZSTR_LEN(key), 80) : 9, key ? ZSTR_VAL(key) : "(changed)");
+	}
+
+	free(top);
+} /* }}} */
+
+int main(int argc, char **argv)
+{
+	apc_inspect_t inspect;
+	zend_long count = 10;
+	zend_bool by_hits = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+			case 'n':
+				count = ZEND_STRTOL(optarg, NULL, 10);
+				break;
+			case 's':
+				by_hits = !strcmp(optarg, "hits");
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+
+	if (optind != argc - 1 || count < 0) {
+		fprintf(stderr, "usage: %s [-n count] [-s size|hits] name\n", argv[0]);
+		return 2;
+	}
+
+	if (!apc_inspect_map(&inspect, argv[optind])) {
+		return 1;
+	}
+
+	if (!inspect.base) {
+		fprintf(stderr, "apcu-inspect: %s is not formatted\n", argv[optind]);
+		return 1;
+	}
+
+	printf("format:           %.*s\n", APC_SMA_FORMAT_SIZE, ((const sma_header_t *) inspect.map)->format);
+	apc_inspect_sma(&inspect);
+	apc_inspect_cache(&inspect, count, by_hits);
+
+	munmap((void *) inspect.map, inspect.size);
+
+	return 0;
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim>600: noexpandtab sw=4 ts=4 sts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4 sts=4
+ */
@@ -68,7 +68,7 @@ static apc_iterator_item_t* apc_iterator_item_ctor(
 
 	if (APC_ITER_VALUE & iterator->format) {
 		ZVAL_UNDEF(&zv);
-		apc_cache_entry_fetch_zval(apc_user_cache, entry, &zv);
+		apc_cache_entry_fetch_zval(iterator->cache, entry, &zv);
 		zend_hash_add_new(ht, apc_str_value, &zv);
 	}
 
@@ -77,23 +77,23 @@ static apc_iterator_item_t* apc_iterator_item_ctor(
 		zend_hash_add_new(ht, apc_str_num_hits, &zv);
 	}
 	if (APC_ITER_MTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->mtime);
+		ZVAL_LONG(&zv, apc_cache_time_unpack(entry->mtime));
 		zend_hash_add_new(ht, apc_str_mtime, &zv);
 	}
 	if (APC_ITER_CTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->ctime);
+		ZVAL_LONG(&zv, apc_cache_time_unpack(entry->ctime));
 		zend_hash_add_new(ht, apc_str_creation_time, &zv);
 	}
 	if (APC_ITER_DTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->dtime);
+		ZVAL_LONG(&zv, apc_cache_time_unpack(entry->dtime));
 		zend_hash_add_new(ht, apc_str_deletion_time, &zv);
 	}
 	if (APC_ITER_ATIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->atime);
+		ZVAL_LONG(&zv, apc_cache_time_unpack(entry->atime));
 		zend_hash_add_new(ht, apc_str_access_time, &zv);
 	}
 	if (APC_ITER_REFCOUNT & iterator->format) {
-		ZVAL_LONG(&zv, entry->ref_count);
+		ZVAL_LONG(&zv, entry->ref_count + entry->shared_count);
 		zend_hash_add_new(ht, apc_str_ref_count, &zv);
 	}
 	if (APC_ITER_MEM_SIZE & iterator->format) {
@@ -198,8 +198,13 @@ static int apc_iterator_search_match(apc_iterator_t *iterator, apc_cache_entry_t
 /* {{{ apc_iterator_check_expiry */
 static int apc_iterator_check_expiry(apc_cache_t* cache, apc_cache_entry_t *entry, time_t t)
 {
+	/* left behind by the last clear */
+	if (entry->generation != cache->header->generation) {
+		return 0;
+	}
+
 	if (entry->ttl) {
-		if ((time_t) (entry->ctime + entry->ttl) < t) {
+		if (apc_cache_time_unpack(entry->ctime) + entry->ttl < t) {
 			return 0;
 		}
 	}
@@ -218,12 +223,12 @@ static int apc_iterator_fetch_active(apc_iterator_t *iterator) {
 		apc_iterator_item_dtor(apc_stack_pop(iterator->stack));
 	}
 
-	APC_RLOCK(apc_user_cache->header);
+	APC_RLOCK(iterator->cache->header);
 	php_apc_try {
-		while (count <= iterator->chunk_size && iterator->slot_idx < apc_user_cache->nslots) {
-			apc_cache_entry_t *entry = apc_user_cache->slots[iterator->slot_idx];
+		while (count <= iterator->chunk_size && iterator->slot_idx < iterator->cache->nslots) {
+			apc_cache_entry_t *entry = iterator->cache->slots[iterator->slot_idx];
 			while (entry) {
-				if (apc_iterator_check_expiry(apc_user_cache, entry, t)) {
+				if (apc_iterator_check_expiry(iterator->cache, entry, t)) {
 					if (apc_iterator_search_match(iterator, entry)) {
 						count++;
 						item = apc_iterator_item_ctor(iterator, entry);
@@ -238,7 +243,7 @@ static int apc_iterator_fetch_active(apc_iterator_t *iterator) {
 		}
 	} php_apc_finally {
 		iterator->stack_idx = 0;
-		APC_RUNLOCK(apc_user_cache->header)
+		APC_RUNLOCK(iterator->cache->header)
 	} php_apc_end_try();
 
 	return count;
@@ -250,9 +255,9 @@ static int apc_iterator_fetch_deleted(apc_iterator_t *iterator) {
 	int count = 0;
 	apc_iterator_item_t *item;
 
-	APC_RLOCK(apc_user_cache->header);
+	APC_RLOCK(iterator->cache->header);
 	php_apc_try {
-		apc_cache_entry_t *entry = apc_user_cache->header->gc;
+		apc_cache_entry_t *entry = iterator->cache->header->gc;
 		while (entry && count <= iterator->slot_idx) {
 			count++;
 			entry = entry->next;
@@ -271,7 +276,7 @@ static int apc_iterator_fetch_deleted(apc_iterator_t *iterator) {
 	} php_apc_finally {
 		iterator->slot_idx += count;
 		iterator->stack_idx = 0;
-		APC_RUNLOCK(apc_user_cache->header);
+		APC_RUNLOCK(iterator->cache->header);
 	} php_apc_end_try();
 
 	return count;
@@ -283,12 +288,12 @@ static void apc_iterator_totals(apc_iterator_t *iterator) {
 	time_t t = apc_time();
 	int i;
 
-	APC_RLOCK(apc_user_cache->header);
+	APC_RLOCK(iterator->cache->header);
 	php_apc_try {
-		for (i=0; i < apc_user_cache->nslots; i++) {
-			apc_cache_entry_t *entry = apc_user_cache->slots[i];
+		for (i=0; i < iterator->cache->nslots; i++) {
+			apc_cache_entry_t *entry = iterator->cache->slots[i];
 			while (entry) {
-				if (apc_iterator_check_expiry(apc_user_cache, entry, t)) {
+				if (apc_iterator_check_expiry(iterator->cache, entry, t)) {
 					if (apc_iterator_search_match(iterator, entry)) {
 						iterator->size += entry->mem_size;
 						iterator->hits += entry->nhits;
@@ -300,7 +305,7 @@ static void apc_iterator_totals(apc_iterator_t *iterator) {
 		}
 	} php_apc_finally {
 		iterator->totals_flag = 1;
-		APC_RUNLOCK(apc_user_cache->header);
+		APC_RUNLOCK(iterator->cache->header);
 	} php_apc_end_try();
 }
 /* }}} */
@@ -331,6 +336,7 @@ void apc_iterator_obj_init(apc_iterator_t *iterator, zval *search, zend_long for
 		return;
 	}
 
+	iterator->cache = APCG(cache);
 	iterator->slot_idx = 0;
 	iterator->stack_idx = 0;
 	iterator->key_idx = 0;
@@ -560,6 +566,12 @@ int apc_iterator_shutdown(int module_number) {
 	return SUCCESS;
 }
 
+/* {{{ apc_iterator_match */
+static zend_bool apc_iterator_match(apc_cache_entry_t *entry, void *data) {
+	return apc_iterator_search_match((apc_iterator_t *) data, entry);
+}
+/* }}} */
+
 /* {{{ apc_iterator_delete */
 int apc_iterator_delete(zval *zobj) {
 	apc_iterator_t *iterator;
@@ -577,11 +589,17 @@ int apc_iterator_delete(zval *zobj) {
 		return 0;
 	}
 
+	/* Matching active entries are deleted in place, during a single scan of the cache */
+	if (iterator->fetch == apc_iterator_fetch_active) {
+		apc_cache_delete_matching(iterator->cache, apc_iterator_match, iterator);
+		return 1;
+	}
+
 	while (iterator->fetch(iterator)) {
 		while (iterator->stack_idx < apc_stack_size(iterator->stack)) {
 			item = apc_stack_get(iterator->stack, iterator->stack_idx++);
 			apc_cache_delete(
-				apc_user_cache, item->key);
+				iterator->cache, item->key);
 		}
 	}
 
@@ -589,6 +607,19 @@ int apc_iterator_delete(zval *zobj) {
 }
 /* }}} */
 
+/* {{{ apc_iterator_export */
+zend_long apc_iterator_export(zval *zobj, php_stream *stream) {
+	apc_iterator_t *iterator = apc_iterator_fetch(zobj);
+
+	if (iterator->initialized == 0) {
+		zend_throw_error(NULL, "Trying to use uninitialized APCUIterator");
+		return -1;
+	}
+
+	return apc_cache_export(iterator->cache, stream, apc_iterator_match, iterator);
+}
+/* }}} */
+
 
 /*
  * Local variables:
@@ -21,6 +21,7 @@
 #define APC_ITERATOR_H
 
 #include "apc.h"
+#include "apc_cache.h"
 #include "apc_stack.h"
 
 #include "ext/pcre/php_pcre.h"
@@ -49,6 +50,7 @@
 /* {{{ apc_iterator_t */
 typedef struct _apc_iterator_t {
 	short int initialized;   /* sanity check in case __construct failed */
+	apc_cache_t *cache;      /* cache of the pool selected when the iterator was created */
 	zend_long format;             /* format bitmask of the return values ie: key, value, info */
 	int (*fetch)(struct _apc_iterator_t *iterator);
 							 /* fetch callback to fetch items from cache slots or lists */
@@ -92,6 +94,7 @@ PHP_APCU_API int apc_iterator_init(int module_number);
 PHP_APCU_API int apc_iterator_shutdown(int module_number);
 
 extern int apc_iterator_delete(zval *key);
+extern zend_long apc_iterator_export(zval *zobj, php_stream *stream);
 #endif
 
 /*
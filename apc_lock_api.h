@@ -38,16 +38,20 @@
 #       ifdef APC_NATIVE_RWLOCK
 		typedef pthread_rwlock_t apc_lock_t;
 #		define APC_LOCK_SHARED
+#		define APC_LOCK_PROCESS_SHARED 1
 #       else
 		typedef pthread_mutex_t apc_lock_t;
 #		define APC_LOCK_RECURSIVE
+#		define APC_LOCK_PROCESS_SHARED 1
 #       endif
 #   else
 		typedef int apc_lock_t;
 #		define APC_LOCK_FILE
+#		define APC_LOCK_PROCESS_SHARED 0
 #   endif
 # else
 # define APC_LOCK_NICE 1
+# define APC_LOCK_PROCESS_SHARED 0
 typedef struct {
 	unsigned long state;
 } apc_lock_t;
@@ -57,8 +61,12 @@ typedef struct {
 # include "apc_windows_srwlock_kernel.h"
 typedef apc_windows_cs_rwlock_t apc_lock_t;
 # define APC_LOCK_SHARED
+# define APC_LOCK_PROCESS_SHARED 0
 #endif
 
+/* APC_LOCK_PROCESS_SHARED is 1 where a lock created by one process excludes any other process
+ * mapping the same memory, as processes attaching to a named segment rely on */
+
 /* {{{ functions */
 /*
   The following functions should be called once per process:
@@ -0,0 +1,222 @@
+/*
+  +----------------------------------------------------------------------+
+  | APCu                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 The PHP Group                                     |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+ */
+
+#include "apc_lz4.h"
+
+#define APC_LZ4_HASH_LOG 12
+#define APC_LZ4_MIN_MATCH 4
+/* the last literals of a block, and the distance of the last match from its end */
+#define APC_LZ4_LAST_LITERALS 5
+#define APC_LZ4_MF_LIMIT 12
+#define APC_LZ4_MAX_DISTANCE 65535
+
+static zend_always_inline uint32_t apc_lz4_read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static zend_always_inline uint32_t apc_lz4_hash(uint32_t v) {
+	return (v * 2654435761U) >> (32 - APC_LZ4_HASH_LOG);
+}
+
+/* {{{ apc_lz4_write_length writes the bytes extending a length beyond its token */
+static unsigned char *apc_lz4_write_length(unsigned char *op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char) len;
+	return op;
+} /* }}} */
+
+/* {{{ apc_lz4_read_length reads the bytes extending a length, returns 0 if they run past end */
+static zend_bool apc_lz4_read_length(const unsigned char **ip, const unsigned char *end, size_t *len) {
+	unsigned char b;
+
+	do {
+		if (*ip >= end) {
+			return 0;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 1;
+} /* }}} */
+
+/* {{{ apc_lz4_write_sequence writes literals followed by a match, or only the literals
+   ending the block when match_len is 0. Returns NULL if that would not fit. */
+static unsigned char *apc_lz4_write_sequence(
+		unsigned char *op, const unsigned char *op_end,
+		const unsigned char *literals, size_t lit_len, size_t offset, size_t match_len) {
+	unsigned char *token = op++;
+	size_t needed = 2 + lit_len / 255 + lit_len + (match_len ? 3 + match_len / 255 : 0);
+
+	if (needed > (size_t) (op_end - token)) {
+		return NULL;
+	}
+
+	if (lit_len >= 15) {
+		*token = 15 << 4;
+		op = apc_lz4_write_length(op, lit_len - 15);
+	} else {
+		*token = (unsigned char) (lit_len << 4);
+	}
+	memcpy(op, literals, lit_len);
+	op += lit_len;
+
+	if (!match_len) {
+		return op;
+	}
+
+	*op++ = (unsigned char) (offset & 0xff);
+	*op++ = (unsigned char) (offset >> 8);
+
+	match_len -= APC_LZ4_MIN_MATCH;
+	if (match_len >= 15) {
+		*token |= 15;
+		op = apc_lz4_write_length(op, match_len - 15);
+	} else {
+		*token |= (unsigned char) match_len;
+	}
+
+	return op;
+} /* }}} */
+
+/* {{{ apc_lz4_compress */
+size_t apc_lz4_compress(const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+	uint32_t table[1 << APC_LZ4_HASH_LOG];
+	const unsigned char *base = (const unsigned char *) src;
+	const unsigned char *end = base + src_size;
+	const unsigned char *ip = base, *anchor = base;
+	unsigned char *op = (unsigned char *) dst;
+	const unsigned char *op_end = op + dst_size;
+
+	if (src_size > APC_LZ4_MAX_INPUT_SIZE) {
+		return 0;
+	}
+
+	/* positions left at 0 point to the start, a match there is checked like any other */
+	memset(table, 0, sizeof(table));
+
+	while (src_size > APC_LZ4_MF_LIMIT && ip < end - APC_LZ4_MF_LIMIT) {
+		uint32_t seq = apc_lz4_read32(ip);
+		uint32_t h = apc_lz4_hash(seq);
+		const unsigned char *ref = base + table[h];
+		const unsigned char *match_end, *match_limit;
+
+		table[h] = (uint32_t) (ip - base);
+		if (ref >= ip || ip - ref > APC_LZ4_MAX_DISTANCE || apc_lz4_read32(ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		/* extend the match, short of the literals ending the block */
+		match_end = ip + APC_LZ4_MIN_MATCH;
+		match_limit = end - APC_LZ4_LAST_LITERALS;
+		ref += APC_LZ4_MIN_MATCH;
+		while (match_end < match_limit && *match_end == *ref) {
+			match_end++;
+			ref++;
+		}
+
+		op = apc_lz4_write_sequence(op, op_end, anchor, ip - anchor, match_end - ref, match_end - ip);
+		if (!op) {
+			return 0;
+		}
+
+		ip = anchor = match_end;
+	}
+
+	op = apc_lz4_write_sequence(op, op_end, anchor, end - anchor, 0, 0);
+	if (!op) {
+		return 0;
+	}
+
+	return op - (unsigned char *) dst;
+} /* }}} */
+
+/* {{{ apc_lz4_decompress */
+zend_bool apc_lz4_decompress(const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+	const unsigned char *ip = (const unsigned char *) src;
+	const unsigned char *ip_end = ip + src_size;
+	unsigned char *op = (unsigned char *) dst;
+	unsigned char *op_end = op + dst_size;
+
+	while (ip < ip_end) {
+		unsigned char token = *ip++;
+		size_t len = token >> 4, offset;
+		const unsigned char *ref;
+
+		if (len == 15 && !apc_lz4_read_length(&ip, ip_end, &len)) {
+			return 0;
+		}
+		if (len > (size_t) (ip_end - ip) || len > (size_t) (op_end - op)) {
+			return 0;
+		}
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* the last sequence has no match */
+		if (ip == ip_end) {
+			break;
+		}
+
+		if (ip_end - ip < 2) {
+			return 0;
+		}
+		offset = ip[0] | ((size_t) ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - (unsigned char *) dst)) {
+			return 0;
+		}
+
+		len = token & 15;
+		if (len == 15 && !apc_lz4_read_length(&ip, ip_end, &len)) {
+			return 0;
+		}
+		len += APC_LZ4_MIN_MATCH;
+		if (len > (size_t) (op_end - op)) {
+			return 0;
+		}
+
+		ref = op - offset;
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* the match overlaps what it writes, repeating the last offset bytes */
+			while (len--) {
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	return op == op_end;
+} /* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim>600: noexpandtab sw=4 ts=4 sts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4 sts=4
+ */
@@ -0,0 +1,52 @@
+/*
+  +----------------------------------------------------------------------+
+  | APCu                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 The PHP Group                                     |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef APC_LZ4_H
+#define APC_LZ4_H
+
+#include "apc.h"
+
+/*
+ * A compressor and decompressor of the LZ4 block format, as described in
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ * Blocks are compressed greedily, favouring speed, and decompressed with bounds checks
+ * throughout. Any LZ4 block decoder can read what apc_lz4_compress writes.
+ */
+
+/* Largest input apc_lz4_compress accepts, as in LZ4 */
+#define APC_LZ4_MAX_INPUT_SIZE 0x7E000000
+
+/*
+ * apc_lz4_compress compresses src into dst, returns the compressed size,
+ * or 0 if it would not fit in dst_size bytes.
+ */
+size_t apc_lz4_compress(const char *src, size_t src_size, char *dst, size_t dst_size);
+
+/*
+ * apc_lz4_decompress decompresses src into dst, returns whether it is a valid block
+ * that decompresses to exactly dst_size bytes.
+ */
+zend_bool apc_lz4_decompress(const char *src, size_t src_size, char *dst, size_t dst_size);
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim>600: noexpandtab sw=4 ts=4 sts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4 sts=4
+ */
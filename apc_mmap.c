@@ -33,7 +33,10 @@
 
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+#include <errno.h>
 
 /*
  * Some operating systems (like FreeBSD) have a MAP_NOSYNC flag that
@@ -116,6 +119,132 @@ apc_segment_t apc_mmap(char *file_mask, size_t size)
 	return segment;
 }
 
+int apc_mmap_open(const char *name)
+{
+	int fd;
+
+	/* names like "/apcu.shm" are POSIX shared memory objects, others are files */
+	if (strstr(name, ".shm")) {
+		fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	} else {
+		fd = open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	}
+
+	if (fd == -1) {
+		zend_error_noreturn(E_CORE_ERROR, "apc_mmap: open on %s failed", name);
+	}
+
+	return fd;
+}
+
+size_t apc_mmap_size(int fd)
+{
+	struct stat sb;
+
+	if (fstat(fd, &sb) < 0) {
+		return 0;
+	}
+
+	return sb.st_size;
+}
+
+apc_segment_t apc_mmap_file(int fd, const char *name, size_t size, void *addr)
+{
+	apc_segment_t segment;
+	int flags = MAP_SHARED;
+
+	if (apc_mmap_size(fd) != size) {
+		if (ftruncate(fd, size) < 0) {
+			zend_error_noreturn(E_CORE_ERROR, "apc_mmap: ftruncate on %s failed", name);
+		}
+	}
+
+#ifdef MAP_FIXED_NOREPLACE
+	/* never replace an existing mapping, fail instead */
+	if (addr) {
+		flags |= MAP_FIXED_NOREPLACE;
+	}
+#endif
+
+	segment.shmaddr = (void *)mmap(addr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	segment.size = size;
+#ifdef APC_MEMPROTECT
+	segment.roaddr = NULL;
+#endif
+
+	if (segment.shmaddr == MAP_FAILED && addr) {
+		/* the address is taken, any other will do */
+		segment.shmaddr = (void *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	if (segment.shmaddr == MAP_FAILED) {
+		zend_error_noreturn(E_CORE_ERROR, "apc_mmap: Failed to mmap %zu bytes of %s. Is your apc.shm_size too large?", size, name);
+	}
+
+	return segment;
+}
+
+zend_bool apc_mmap_lock_init(int fd, zend_bool lock)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = lock ? F_WRLCK : F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 1;
+
+	while (fcntl(fd, F_SETLKW, &fl) < 0) {
+		if (errno != EINTR) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+zend_bool apc_mmap_lock_users(int fd, zend_bool exclusive)
+{
+	while (flock(fd, exclusive ? LOCK_EX | LOCK_NB : LOCK_SH) < 0) {
+		if (errno != EINTR) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+apc_segment_t apc_mmap_readonly(const char *path)
+{
+	apc_segment_t segment;
+	struct stat sb;
+	int fd;
+
+	segment.shmaddr = NULL;
+	segment.size = 0;
+#ifdef APC_MEMPROTECT
+	segment.roaddr = NULL;
+#endif
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return segment;
+	}
+
+	if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+		void *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (addr != MAP_FAILED) {
+			segment.shmaddr = addr;
+			segment.size = sb.st_size;
+		}
+	}
+
+	close(fd);
+
+	return segment;
+}
+
 void apc_unmap(apc_segment_t *segment)
 {
 	if (munmap(segment->shmaddr, segment->size) < 0) {
@@ -37,6 +37,19 @@
 
 #if APC_MMAP
 apc_segment_t apc_mmap(char *file_mask, size_t size);
+/* Opens or creates the named segment, a POSIX shared memory object if the name contains ".shm", a file otherwise */
+int apc_mmap_open(const char *name);
+/* Returns the current size of the named segment open on fd */
+size_t apc_mmap_size(int fd);
+/* Maps the named segment open on fd, resized to size, preferably at addr */
+apc_segment_t apc_mmap_file(int fd, const char *name, size_t size, void *addr);
+/* Takes or releases the lock serializing processes that set up the named segment open on fd */
+zend_bool apc_mmap_lock_init(int fd, zend_bool lock);
+/* Marks this process and its children as users of the named segment open on fd until it is closed;
+ * exclusive only tries whether there are no other users yet */
+zend_bool apc_mmap_lock_users(int fd, zend_bool exclusive);
+/* Maps the existing file at path read only, shmaddr is NULL if it cannot be mapped */
+apc_segment_t apc_mmap_readonly(const char *path);
 void apc_unmap(apc_segment_t* segment);
 #endif
 
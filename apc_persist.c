@@ -18,6 +18,10 @@
 
 #include "apc.h"
 #include "apc_cache.h"
+#include "apc_lz4.h"
+
+/* Defined in apc_cache.c */
+apc_cache_entry_t *apc_cache_entry_alloc(apc_cache_t *cache, size_t size);
 
 #if PHP_VERSION_ID < 70300
 # define GC_SET_REFCOUNT(ref, rc) (GC_REFCOUNT(ref) = (rc))
@@ -46,9 +50,20 @@ typedef struct _apc_persist_context_t {
 	zend_bool memoization_needed;
 	/* Whether to force serialization of the top-level value */
 	zend_bool force_serialization;
+	/* Whether the value holds references, which cannot be shared immutable */
+	zend_bool has_references;
+	/* Whether to flag the copied value immutable, see apc_persist_immutable */
+	zend_bool immutable;
+	/* Hash of empty arrays, which must lie in the memory the copy is shared through */
+	const uint32_t *uninitialized_bucket;
 	/* Serialized object/array string, in case there can only be one */
 	unsigned char *serialized_str;
 	size_t serialized_str_len;
+	/* Compressed value, stored instead of the string or serialized value */
+	char *compressed_str;
+	size_t compressed_str_len;
+	/* What the compressed value decompresses to, APC_CACHE_COMPRESSED_* */
+	uint32_t compressed_type;
 	/* Whole SMA allocation */
 	char *alloc;
 	/* Current position in allocation */
@@ -78,13 +93,22 @@ static inline void apc_persist_copy_zval(apc_persist_context_t *ctxt, zval *zv)
 	apc_persist_copy_zval_impl(ctxt, zv);
 }
 
+/* Hash of empty arrays only used by this process */
+static const uint32_t uninitialized_bucket[-HT_MIN_MASK] = {HT_INVALID_IDX, HT_INVALID_IDX};
+
 void apc_persist_init_context(apc_persist_context_t *ctxt, apc_serializer_t *serializer) {
 	ctxt->serializer = serializer;
 	ctxt->size = 0;
 	ctxt->memoization_needed = 0;
 	ctxt->force_serialization = 0;
+	ctxt->has_references = 0;
+	ctxt->immutable = 0;
+	ctxt->uninitialized_bucket = uninitialized_bucket;
 	ctxt->serialized_str = NULL;
 	ctxt->serialized_str_len = 0;
+	ctxt->compressed_str = NULL;
+	ctxt->compressed_str_len = 0;
+	ctxt->compressed_type = 0;
 	ctxt->alloc = NULL;
 	ctxt->alloc_cur = NULL;
 }
@@ -97,6 +121,9 @@ void apc_persist_destroy_context(apc_persist_context_t *ctxt) {
 	if (ctxt->serialized_str) {
 		efree(ctxt->serialized_str);
 	}
+	if (ctxt->compressed_str) {
+		efree(ctxt->compressed_str);
+	}
 }
 
 static zend_bool apc_persist_calc_memoize(apc_persist_context_t *ctxt, void *ptr) {
@@ -205,6 +232,7 @@ static zend_bool apc_persist_calc_zval(
 			}
 			return apc_persist_calc_serialize(ctxt, zv);
 		case IS_REFERENCE:
+			ctxt->has_references = 1;
 			ADD_SIZE(sizeof(zend_reference));
 			return apc_persist_calc_zval(ctxt, Z_REFVAL_P(zv), 0);
 		case IS_RESOURCE:
@@ -218,6 +246,16 @@ static zend_bool apc_persist_calc_zval(
 
 static zend_bool apc_persist_calc(apc_persist_context_t *ctxt, const apc_cache_entry_t *entry) {
 	ADD_SIZE(sizeof(apc_cache_entry_t));
+	if (entry->index_level) {
+		ADD_SIZE(entry->index_level * sizeof(apc_cache_entry_t *));
+	}
+	if (entry->ntags) {
+		uint32_t i;
+		ADD_SIZE(entry->ntags * sizeof(apc_cache_tag_link_t));
+		for (i = 0; i < entry->ntags; i++) {
+			ADD_SIZE_STR(ZSTR_LEN(entry->tags[i].tag));
+		}
+	}
 	ADD_SIZE_STR(ZSTR_LEN(entry->key));
 	return apc_persist_calc_zval(ctxt, &entry->val, 1);
 }
@@ -274,6 +312,19 @@ static zend_string *apc_persist_copy_zstr(
 	return str;
 }
 
+/* Strings of the value are flagged interned when it is immutable: the engine then
+ * neither counts references to them nor frees them, it shares them as they are. */
+static zend_string *apc_persist_copy_value_zstr(
+		apc_persist_context_t *ctxt, const zend_string *orig_str) {
+	zend_string *str = apc_persist_copy_zstr(ctxt, orig_str);
+#if APC_CACHE_IMMUTABLE
+	if (ctxt->immutable) {
+		GC_ADD_FLAGS(str, IS_STR_INTERNED);
+	}
+#endif
+	return str;
+}
+
 static zend_reference *apc_persist_copy_ref(
 		apc_persist_context_t *ctxt, const zend_reference *orig_ref) {
 	zend_reference *ref = ALLOC(sizeof(zend_reference));
@@ -291,8 +342,6 @@ static zend_reference *apc_persist_copy_ref(
 	return ref;
 }
 
-static const uint32_t uninitialized_bucket[-HT_MIN_MASK] = {HT_INVALID_IDX, HT_INVALID_IDX};
-
 static zend_array *apc_persist_copy_ht(apc_persist_context_t *ctxt, const HashTable *orig_ht) {
 	HashTable *ht = COPY(orig_ht, sizeof(HashTable));
 	uint32_t idx;
@@ -300,6 +349,17 @@ static zend_array *apc_persist_copy_ht(apc_persist_context_t *ctxt, const HashTa
 
 	GC_SET_REFCOUNT(ht, 1);
 	GC_SET_PERSISTENT_TYPE(ht, GC_ARRAY);
+#if APC_CACHE_IMMUTABLE
+	if (ctxt->immutable) {
+		/* as opcache does, a refcount above 1 makes the engine separate before writing */
+		GC_SET_REFCOUNT(ht, 2);
+# ifdef GC_NOT_COLLECTABLE
+		GC_ADD_FLAGS(ht, IS_ARRAY_IMMUTABLE | GC_NOT_COLLECTABLE);
+# else
+		GC_ADD_FLAGS(ht, IS_ARRAY_IMMUTABLE);
+# endif
+	}
+#endif
 
 	/* Immutable arrays from opcache may lack a dtor and the apply protection flag. */
 	ht->pDestructor = ZVAL_PTR_DTOR;
@@ -316,7 +376,7 @@ static zend_array *apc_persist_copy_ht(apc_persist_context_t *ctxt, const HashTa
 #endif
 		ht->nNextFreeElement = 0;
 		ht->nTableMask = HT_MIN_MASK;
-		HT_SET_DATA_ADDR(ht, &uninitialized_bucket);
+		HT_SET_DATA_ADDR(ht, ctxt->uninitialized_bucket);
 		return ht;
 	}
 
@@ -332,7 +392,7 @@ static zend_array *apc_persist_copy_ht(apc_persist_context_t *ctxt, const HashTa
 		}
 
 		if (p->key) {
-			p->key = apc_persist_copy_zstr(ctxt, p->key);
+			p->key = apc_persist_copy_value_zstr(ctxt, p->key);
 			ht->u.flags &= ~HASH_FLAG_STATIC_KEYS;
 		} else if ((zend_long) p->h >= (zend_long) ht->nNextFreeElement) {
 			ht->nNextFreeElement = p->h + 1;
@@ -370,13 +430,19 @@ static void apc_persist_copy_zval_impl(apc_persist_context_t *ctxt, zval *zv) {
 	ptr = apc_persist_get_already_allocated(ctxt, Z_COUNTED_P(zv));
 	switch (Z_TYPE_P(zv)) {
 		case IS_STRING:
-			if (!ptr) ptr = apc_persist_copy_zstr(ctxt, Z_STR_P(zv));
+			if (!ptr) ptr = apc_persist_copy_value_zstr(ctxt, Z_STR_P(zv));
 			ZVAL_STR(zv, ptr);
 			return;
 		case IS_ARRAY:
 			if (!ctxt->serializer) {
 				if (!ptr) ptr = apc_persist_copy_ht(ctxt, Z_ARRVAL_P(zv));
 				ZVAL_ARR(zv, ptr);
+#if APC_CACHE_IMMUTABLE
+				if (ctxt->immutable) {
+					/* not refcounted, the engine neither counts nor collects it */
+					Z_TYPE_FLAGS_P(zv) = 0;
+				}
+#endif
 				return;
 			}
 			/* break missing intentionally */
@@ -396,13 +462,107 @@ static void apc_persist_copy_zval_impl(apc_persist_context_t *ctxt, zval *zv) {
 static apc_cache_entry_t *apc_persist_copy(
 		apc_persist_context_t *ctxt, const apc_cache_entry_t *orig_entry) {
 	apc_cache_entry_t *entry = COPY(orig_entry, sizeof(apc_cache_entry_t));
-	entry->key = apc_persist_copy_zstr(ctxt, entry->key);
+	/* the key directly follows the entry, lookups compare it right after the entry fields.
+	 * Not memoized: values that contain the same string get their own, immutable copy */
+	entry->key = apc_persist_copy_cstr(
+		ctxt, ZSTR_VAL(entry->key), ZSTR_LEN(entry->key), ZSTR_H(entry->key));
+	if (entry->index_level) {
+		/* links are set when the entry is inserted */
+		entry->index_next = ALLOC(entry->index_level * sizeof(apc_cache_entry_t *));
+	}
+	if (entry->ntags) {
+		uint32_t i;
+		entry->tags = COPY(entry->tags, entry->ntags * sizeof(apc_cache_tag_link_t));
+		for (i = 0; i < entry->ntags; i++) {
+			/* not memoized, tags are counted apart from the value */
+			zend_string *tag = entry->tags[i].tag;
+			entry->tags[i].tag = apc_persist_copy_cstr(ctxt, ZSTR_VAL(tag), ZSTR_LEN(tag), ZSTR_H(tag));
+			entry->tags[i].entry = entry;
+			entry->tags[i].next = NULL;
+			entry->tags[i].pprev = NULL;
+		}
+	}
+	if (ctxt->compressed_str) {
+		ZVAL_PTR(&entry->val, apc_persist_copy_cstr(
+			ctxt, ctxt->compressed_str, ctxt->compressed_str_len, 0));
+		Z_EXTRA(entry->val) = ctxt->compressed_type;
+		return entry;
+	}
 	apc_persist_copy_zval(ctxt, &entry->val);
+	Z_EXTRA(entry->val) = 0;
 	return entry;
 }
 
-apc_cache_entry_t *apc_persist(
-		apc_sma_t *sma, apc_serializer_t *serializer, const apc_cache_entry_t *orig_entry) {
+static inline zend_long apc_persist_elapsed(const struct timeval *start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (zend_long) (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+/* Compress the string or the serialized value if it is large enough, and if that saves
+ * at least an eighth of it. Arrays stored natively are left as they are. */
+static void apc_persist_compress(apc_persist_context_t *ctxt, apc_cache_t *cache, const zval *zv) {
+	apc_cache_compression_t *stats = &cache->header->compression;
+	const char *str;
+	char *compressed;
+	size_t len, max_len, compressed_len;
+	uint32_t type;
+	struct timeval start;
+
+	if (ctxt->serialized_str) {
+		str = (const char *) ctxt->serialized_str;
+		len = ctxt->serialized_str_len;
+		type = APC_CACHE_COMPRESSED_SERIALIZED;
+	} else if (Z_TYPE_P(zv) == IS_STRING) {
+		str = Z_STRVAL_P(zv);
+		len = Z_STRLEN_P(zv);
+		type = APC_CACHE_COMPRESSED_STRING;
+	} else {
+		return;
+	}
+
+	/* the compressed value, with its header, must take at most seven eighths of it */
+	max_len = len - len / 8;
+	if (len < (size_t) cache->compress_threshold || len > APC_LZ4_MAX_INPUT_SIZE
+			|| max_len <= sizeof(size_t)) {
+		return;
+	}
+
+	gettimeofday(&start, NULL);
+	compressed = emalloc(sizeof(size_t) + max_len);
+	memcpy(compressed, &len, sizeof(size_t));
+	compressed_len = apc_lz4_compress(str, len, compressed + sizeof(size_t), max_len - sizeof(size_t));
+	ATOMIC_ADD(stats->compress_time, apc_persist_elapsed(&start));
+
+	if (!compressed_len) {
+		efree(compressed);
+		return;
+	}
+
+	compressed_len += sizeof(size_t);
+	ATOMIC_INC(stats->ncompressed);
+	ATOMIC_ADD(stats->size_in, (zend_long) len);
+	ATOMIC_ADD(stats->size_out, (zend_long) compressed_len);
+
+	ctxt->size -= ZEND_MM_ALIGNED_SIZE(_ZSTR_STRUCT_SIZE(len));
+	ctxt->size += ZEND_MM_ALIGNED_SIZE(_ZSTR_STRUCT_SIZE(compressed_len));
+	ctxt->compressed_str = compressed;
+	ctxt->compressed_str_len = compressed_len;
+	ctxt->compressed_type = type;
+	ctxt->immutable = 0;
+}
+
+/* Only strings and arrays copied natively, without references, can be shared immutable */
+static zend_bool apc_persist_immutable(apc_persist_context_t *ctxt, const zval *zv) {
+	if (!APC_CACHE_IMMUTABLE || ctxt->force_serialization || ctxt->has_references) {
+		return 0;
+	}
+
+	return Z_TYPE_P(zv) == IS_STRING || (Z_TYPE_P(zv) == IS_ARRAY && !ctxt->serializer);
+}
+
+apc_cache_entry_t *apc_persist(apc_cache_t *cache, const apc_cache_entry_t *orig_entry) {
+	apc_serializer_t *serializer = cache->serializer;
 	apc_persist_context_t ctxt;
 	apc_cache_entry_t *entry;
 
@@ -435,12 +595,18 @@ apc_cache_entry_t *apc_persist(
 		}
 	}
 
-	ctxt.alloc = ctxt.alloc_cur = apc_sma_malloc(sma, ctxt.size);
+	ctxt.immutable = cache->immutable && apc_persist_immutable(&ctxt, &orig_entry->val);
+	if (cache->compress_threshold > 0) {
+		apc_persist_compress(&ctxt, cache, &orig_entry->val);
+	}
+
+	ctxt.alloc = ctxt.alloc_cur = (char *) apc_cache_entry_alloc(cache, ctxt.size);
 	if (!ctxt.alloc) {
 		apc_persist_destroy_context(&ctxt);
 		return NULL;
 	}
 
+	ctxt.uninitialized_bucket = cache->header->uninitialized_bucket;
 	entry = apc_persist_copy(&ctxt, orig_entry);
 	ZEND_ASSERT(ctxt.alloc_cur == ctxt.alloc + ctxt.size);
 
@@ -450,6 +616,45 @@ apc_cache_entry_t *apc_persist(
 	return entry;
 }
 
+/* Copy a string or an array to process memory, immutable as in apc_persist, for the local
+ * cache. Returns NULL for anything that could not be shared that way or would take more
+ * than limit bytes. The copy is a single allocation headed by its zval, freed with pefree. */
+zval *apc_persist_local(const zval *value, size_t limit, size_t *size) {
+	apc_persist_context_t ctxt;
+	zval *zv;
+
+	if (!APC_CACHE_IMMUTABLE || (Z_TYPE_P(value) != IS_STRING && Z_TYPE_P(value) != IS_ARRAY)) {
+		return NULL;
+	}
+
+	apc_persist_init_context(&ctxt, NULL);
+	if (Z_TYPE_P(value) == IS_ARRAY) {
+		ctxt.memoization_needed = 1;
+		zend_hash_init(&ctxt.already_counted, 0, NULL, NULL, 0);
+		zend_hash_init(&ctxt.already_allocated, 0, NULL, NULL, 0);
+	}
+
+	ctxt.size = ZEND_MM_ALIGNED_SIZE(sizeof(zval));
+	if (!apc_persist_calc_zval(&ctxt, value, 0) || !apc_persist_immutable(&ctxt, value)
+			|| ctxt.size > limit) {
+		apc_persist_destroy_context(&ctxt);
+		return NULL;
+	}
+
+	ctxt.immutable = 1;
+	ctxt.alloc = ctxt.alloc_cur = pemalloc(ctxt.size, 1);
+
+	zv = apc_persist_alloc(&ctxt, sizeof(zval));
+	ZVAL_COPY_VALUE(zv, value);
+	apc_persist_copy_zval(&ctxt, zv);
+	ZEND_ASSERT(ctxt.alloc_cur == ctxt.alloc + ctxt.size);
+
+	*size = ctxt.size;
+
+	apc_persist_destroy_context(&ctxt);
+	return zv;
+}
+
 /*
  * UNPERSIST: Copy from SHM to request memory.
  */
@@ -490,6 +695,56 @@ static zend_bool apc_unpersist_serialized(
 	return 0;
 }
 
+/* An LZ4 block expands at most 255 times, one length byte standing for 255 bytes */
+#define APC_LZ4_MAX_RATIO 255
+
+/* Reads the size a compressed value decompresses to, checking it could hold that much */
+static zend_bool apc_compressed_len(const zend_string *str, size_t *len) {
+	if (ZSTR_LEN(str) <= sizeof(size_t)) {
+		return 0;
+	}
+
+	memcpy(len, ZSTR_VAL(str), sizeof(size_t));
+	return *len <= APC_LZ4_MAX_INPUT_SIZE
+		&& *len / APC_LZ4_MAX_RATIO <= ZSTR_LEN(str) - sizeof(size_t);
+}
+
+static zend_bool apc_unpersist_compressed(zval *dst, const zval *value, apc_cache_t *cache) {
+	apc_cache_compression_t *stats = &cache->header->compression;
+	zend_string *str = Z_PTR_P(value), *decompressed;
+	struct timeval start;
+	zend_bool ok;
+	size_t len;
+
+	if (!apc_compressed_len(str, &len)) {
+		ZVAL_NULL(dst);
+		return 0;
+	}
+	decompressed = zend_string_alloc(len, 0);
+
+	gettimeofday(&start, NULL);
+	ok = apc_lz4_decompress(ZSTR_VAL(str) + sizeof(size_t), ZSTR_LEN(str) - sizeof(size_t),
+		ZSTR_VAL(decompressed), len);
+	ATOMIC_ADD(stats->decompress_time, apc_persist_elapsed(&start));
+	ATOMIC_INC(stats->ndecompressed);
+
+	if (!ok) {
+		zend_string_free(decompressed);
+		ZVAL_NULL(dst);
+		return 0;
+	}
+	ZSTR_VAL(decompressed)[len] = '\0';
+
+	if (Z_EXTRA_P(value) == APC_CACHE_COMPRESSED_STRING) {
+		ZVAL_NEW_STR(dst, decompressed);
+		return 1;
+	}
+
+	ok = apc_unpersist_serialized(dst, decompressed, cache->serializer);
+	zend_string_free(decompressed);
+	return ok;
+}
+
 static inline void *apc_unpersist_get_already_copied(apc_unpersist_context_t *ctxt, void *ptr) {
 	if (ctxt->memoization_needed) {
 		return zend_hash_index_find_ptr(&ctxt->already_copied, (uintptr_t) ptr);
@@ -533,7 +788,11 @@ static zend_array *apc_unpersist_ht(
 
 	apc_unpersist_add_already_copied(ctxt, orig_ht, ht);
 	memcpy(ht, orig_ht, sizeof(HashTable));
+	/* immutable arrays are persisted with a refcount of 2 */
+	GC_SET_REFCOUNT(ht, 1);
 	GC_TYPE_INFO(ht) = GC_ARRAY;
+	/* the persisted pointer may come from another process, see apc_cache_attach */
+	ht->pDestructor = ZVAL_PTR_DTOR;
 
 	if (ht->nNumUsed == 0) {
 		HT_SET_DATA_ADDR(ht, &uninitialized_bucket);
@@ -561,7 +820,9 @@ static zend_array *apc_unpersist_ht(
 			p->val = q->val;
 			p->h = q->h;
 			if (q->key) {
-				p->key = zend_string_dup(q->key, 0);
+				/* not zend_string_dup(), which would return keys flagged interned as they are */
+				p->key = zend_string_init(ZSTR_VAL(q->key), ZSTR_LEN(q->key), 0);
+				ZSTR_H(p->key) = ZSTR_H(q->key);
 			} else {
 				p->key = NULL;
 			}
@@ -572,23 +833,23 @@ static zend_array *apc_unpersist_ht(
 	return ht;
 }
 
+/* The copies are set with ZVAL_*(), as the persisted zval lacks the refcounted
+ * type flag when the value was persisted immutable */
 static void apc_unpersist_zval_impl(apc_unpersist_context_t *ctxt, zval *zv) {
 	void *ptr = apc_unpersist_get_already_copied(ctxt, Z_COUNTED_P(zv));
 	if (ptr) {
-		Z_COUNTED_P(zv) = ptr;
-		Z_ADDREF_P(zv);
-		return;
+		GC_ADDREF((zend_refcounted *) ptr);
 	}
 
 	switch (Z_TYPE_P(zv)) {
 		case IS_STRING:
-			Z_STR_P(zv) = apc_unpersist_zstr(ctxt, Z_STR_P(zv));
+			ZVAL_STR(zv, ptr ? ptr : apc_unpersist_zstr(ctxt, Z_STR_P(zv)));
 			return;
 		case IS_REFERENCE:
-			Z_REF_P(zv) = apc_unpersist_ref(ctxt, Z_REF_P(zv));
+			ZVAL_REF(zv, ptr ? ptr : apc_unpersist_ref(ctxt, Z_REF_P(zv)));
 			return;
 		case IS_ARRAY:
-			Z_ARR_P(zv) = apc_unpersist_ht(ctxt, Z_ARR_P(zv));
+			ZVAL_ARR(zv, ptr ? ptr : apc_unpersist_ht(ctxt, Z_ARR_P(zv)));
 			return;
 		default:
 			ZEND_ASSERT(0);
@@ -596,11 +857,14 @@ static void apc_unpersist_zval_impl(apc_unpersist_context_t *ctxt, zval *zv) {
 	}
 }
 
-zend_bool apc_unpersist(zval *dst, const zval *value, apc_serializer_t *serializer) {
+zend_bool apc_unpersist(zval *dst, const zval *value, apc_cache_t *cache) {
 	apc_unpersist_context_t ctxt;
 
 	if (Z_TYPE_P(value) == IS_PTR) {
-		return apc_unpersist_serialized(dst, Z_PTR_P(value), serializer);
+		if (Z_EXTRA_P(value)) {
+			return apc_unpersist_compressed(dst, value, cache);
+		}
+		return apc_unpersist_serialized(dst, Z_PTR_P(value), cache->serializer);
 	}
 
 	ctxt.memoization_needed = 0;
@@ -618,3 +882,261 @@ zend_bool apc_unpersist(zval *dst, const zval *value, apc_serializer_t *serializ
 	}
 	return 1;
 }
+
+/*
+ * REBASE: Move a persisted entry to another address, e.g. through a file.
+ */
+
+typedef struct _apc_rebase_context_t {
+	/* Copy of the whole allocation of the entry */
+	char *block;
+	size_t size;
+	/* Address the pointers in the block are relative to, and the one they are moved to */
+	uintptr_t from;
+	uintptr_t to;
+	/* Hash the data of empty arrays is set to */
+	const uint32_t *uninitialized_bucket;
+	/* Whether refcounteds may be shared, as when persisting */
+	zend_bool memoization_needed;
+	/* HashTable storing offsets of already rebased arrays and references. */
+	HashTable already_rebased;
+} apc_rebase_context_t;
+
+/* Rebases ptr to an object of len bytes, returning its copy in the block,
+ * or NULL if it does not lie within the block */
+static void *apc_rebase_ptr(apc_rebase_context_t *ctxt, void **ptr, size_t len) {
+	size_t offset = (size_t) ((uintptr_t) *ptr - ctxt->from);
+
+	if (offset >= ctxt->size || len > ctxt->size - offset) {
+		return NULL;
+	}
+
+	*ptr = (void *) (ctxt->to + offset);
+	return ctxt->block + offset;
+}
+
+static zend_bool apc_rebase_already_rebased(apc_rebase_context_t *ctxt, void *ptr) {
+	zval tmp;
+
+	if (!ctxt->memoization_needed) {
+		ctxt->memoization_needed = 1;
+		zend_hash_init(&ctxt->already_rebased, 0, NULL, NULL, 0);
+	}
+
+	if (zend_hash_index_exists(&ctxt->already_rebased, (zend_ulong) ((uintptr_t) ptr - ctxt->from))) {
+		return 1;
+	}
+
+	ZVAL_NULL(&tmp);
+	zend_hash_index_add_new(&ctxt->already_rebased, (zend_ulong) ((uintptr_t) ptr - ctxt->from), &tmp);
+	return 0;
+}
+
+static zend_bool apc_rebase_str(apc_rebase_context_t *ctxt, zend_string **str) {
+	void *ptr = *str;
+	zend_string *copy = apc_rebase_ptr(ctxt, &ptr, sizeof(zend_string));
+
+	if (!copy || ZSTR_LEN(copy) >= ctxt->size
+			|| _ZSTR_STRUCT_SIZE(ZSTR_LEN(copy)) > ctxt->size - (size_t) ((char *) copy - ctxt->block)) {
+		return 0;
+	}
+
+	*str = ptr;
+	return 1;
+}
+
+static zend_bool apc_rebase_zval(apc_rebase_context_t *ctxt, zval *zv);
+
+/* Whether the hash of a table only leads to its used buckets, without loops, so that
+ * lookups stay within the table */
+static zend_bool apc_rebase_ht_hash_valid(const HashTable *ht, const uint32_t *hash, const Bucket *buckets) {
+	uint32_t nhash = (uint32_t) -ht->nTableMask, i;
+
+	if (nhash < (uint32_t) -HT_MIN_MASK || (nhash & (nhash - 1))) {
+		return 0;
+	}
+
+	if (ht->u.flags & HASH_FLAG_PACKED) {
+		/* packed tables are indexed directly */
+		return ht->nTableMask == HT_MIN_MASK;
+	}
+
+	for (i = 0; i < nhash; i++) {
+		if (hash[i] != HT_INVALID_IDX && HT_HASH_TO_IDX(hash[i]) >= ht->nNumUsed) {
+			return 0;
+		}
+	}
+
+	/* buckets are chained to the ones inserted before them */
+	for (i = 0; i < ht->nNumUsed; i++) {
+		uint32_t next = Z_NEXT(buckets[i].val);
+
+		if (next != HT_INVALID_IDX && HT_HASH_TO_IDX(next) >= i) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static zend_bool apc_rebase_ht(apc_rebase_context_t *ctxt, HashTable *ht) {
+	Bucket *p, *end;
+	void *data, *copy;
+
+	if (ht->nNumUsed == 0) {
+		/* the hash of empty arrays lies in the cache header, outside the block */
+		HT_SET_DATA_ADDR(ht, ctxt->uninitialized_bucket);
+		return 1;
+	}
+
+	data = HT_GET_DATA_ADDR(ht);
+	if (ht->nNumUsed > ht->nTableSize || ht->nTableSize > HT_MAX_SIZE
+			|| (ht->nTableSize & (ht->nTableSize - 1)) || (uint32_t) -ht->nTableMask > 2 * ht->nTableSize
+			|| !(copy = apc_rebase_ptr(ctxt, &data, HT_USED_SIZE(ht)))) {
+		return 0;
+	}
+
+	HT_SET_DATA_ADDR(ht, data);
+	p = (Bucket *) ((char *) copy + HT_HASH_SIZE(ht->nTableMask));
+
+	if (!apc_rebase_ht_hash_valid(ht, copy, p)) {
+		return 0;
+	}
+
+	for (end = p + ht->nNumUsed; p < end; p++) {
+		if (Z_TYPE(p->val) == IS_UNDEF) {
+			continue;
+		}
+		if (p->key && !apc_rebase_str(ctxt, &p->key)) {
+			return 0;
+		}
+		if (!apc_rebase_zval(ctxt, &p->val)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static zend_bool apc_rebase_zval(apc_rebase_context_t *ctxt, zval *zv) {
+	zend_string *str;
+	void *ptr, *copy;
+	zend_bool shared;
+
+	switch (Z_TYPE_P(zv)) {
+		case IS_UNDEF:
+		case IS_NULL:
+		case IS_FALSE:
+		case IS_TRUE:
+		case IS_LONG:
+		case IS_DOUBLE:
+			return 1;
+		case IS_STRING:
+			return apc_rebase_str(ctxt, &Z_STR_P(zv));
+		case IS_PTR:
+			/* serialized or compressed value */
+			str = Z_PTR_P(zv);
+			if (!apc_rebase_str(ctxt, &str)) {
+				return 0;
+			}
+			if (Z_EXTRA_P(zv)) {
+				size_t len;
+
+				if (!apc_compressed_len((zend_string *) (ctxt->block + ((uintptr_t) str - ctxt->to)), &len)) {
+					return 0;
+				}
+			}
+			Z_PTR_P(zv) = str;
+			return 1;
+		case IS_ARRAY:
+			shared = apc_rebase_already_rebased(ctxt, Z_ARR_P(zv));
+			ptr = Z_ARR_P(zv);
+			if (!(copy = apc_rebase_ptr(ctxt, &ptr, sizeof(HashTable)))) {
+				return 0;
+			}
+			Z_ARR_P(zv) = ptr;
+			return shared || apc_rebase_ht(ctxt, copy);
+		case IS_REFERENCE:
+			shared = apc_rebase_already_rebased(ctxt, Z_REF_P(zv));
+			ptr = Z_REF_P(zv);
+			if (!(copy = apc_rebase_ptr(ctxt, &ptr, sizeof(zend_reference)))) {
+				return 0;
+			}
+			Z_REF_P(zv) = ptr;
+			return shared || apc_rebase_zval(ctxt, &((zend_reference *) copy)->val);
+		default:
+			return 0;
+	}
+}
+
+zend_bool apc_persist_rebase(apc_cache_t *cache, apc_cache_entry_t *entry, size_t size, const void *from, void *to) {
+	apc_rebase_context_t ctxt;
+	zend_bool ret = 0;
+
+	if (size < sizeof(apc_cache_entry_t) || (size_t) entry->mem_size != size
+			|| entry->index_level > APC_CACHE_INDEX_LEVELS || Z_TYPE(entry->val) == IS_REFERENCE) {
+		return 0;
+	}
+
+	ctxt.block = (char *) entry;
+	ctxt.size = size;
+	ctxt.from = (uintptr_t) from;
+	ctxt.to = (uintptr_t) to;
+	ctxt.uninitialized_bucket = to ? cache->header->uninitialized_bucket : NULL;
+	ctxt.memoization_needed = 0;
+
+	/* links are set when the entry is inserted */
+	entry->next = NULL;
+
+	do {
+		void *ptr;
+
+		if (!apc_rebase_str(&ctxt, &entry->key)) {
+			break;
+		}
+
+		if (entry->index_level) {
+			apc_cache_entry_t **index_next;
+
+			ptr = entry->index_next;
+			if (!(index_next = apc_rebase_ptr(&ctxt, &ptr, entry->index_level * sizeof(apc_cache_entry_t *)))) {
+				break;
+			}
+			memset(index_next, 0, entry->index_level * sizeof(apc_cache_entry_t *));
+			entry->index_next = ptr;
+		}
+
+		if (entry->ntags) {
+			apc_cache_tag_link_t *tags;
+			uint32_t i;
+
+			ptr = entry->tags;
+			if (entry->ntags > size / sizeof(apc_cache_tag_link_t)
+					|| !(tags = apc_rebase_ptr(&ctxt, &ptr, entry->ntags * sizeof(apc_cache_tag_link_t)))) {
+				break;
+			}
+			entry->tags = ptr;
+
+			for (i = 0; i < entry->ntags; i++) {
+				if (!apc_rebase_str(&ctxt, &tags[i].tag)) {
+					break;
+				}
+				tags[i].entry = to;
+				tags[i].next = NULL;
+				tags[i].pprev = NULL;
+			}
+
+			if (i < entry->ntags) {
+				break;
+			}
+		}
+
+		ret = apc_rebase_zval(&ctxt, &entry->val);
+	} while (0);
+
+	if (ctxt.memoization_needed) {
+		zend_hash_destroy(&ctxt.already_rebased);
+	}
+
+	return ret;
+}
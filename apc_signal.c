@@ -49,16 +49,19 @@ static void apc_core_unmap(int signo, siginfo_t *siginfo, void *context);
 static void apc_clear_cache(int signo, siginfo_t *siginfo, void *context);
 #endif
 
-extern apc_cache_t* apc_user_cache;
-
 /* {{{ apc_core_unmap
  *  Coredump signal handler, detached from shm and calls previously installed handlers
  */
 static void apc_core_unmap(int signo, siginfo_t *siginfo, void *context)
 {
+	int i;
+
 	if (apc_user_cache) {
 		apc_sma_detach(apc_user_cache->sma);
 	}
+	for (i = 0; i < apc_npools; i++) {
+		apc_sma_detach(&apc_pools[i].sma);
+	}
 	apc_rehandle_signal(signo, siginfo, context);
 
 #if !defined(WIN32) && !defined(NETWARE)
@@ -70,10 +73,17 @@ static void apc_core_unmap(int signo, siginfo_t *siginfo, void *context)
 
 
 #if defined(SIGUSR1) && defined(APC_CLEAR_SIGNAL)
-/* {{{ apc_reload_cache */
+/* {{{ apc_reload_cache
+ *  Taking the cache lock is not safe in a signal handler, only flag the caches
+ *  to be cleared by the next request */
 static void apc_clear_cache(int signo, siginfo_t *siginfo, void *context) {
+	int i;
+
 	if (apc_user_cache) {
-		apc_cache_clear(apc_user_cache);
+		apc_cache_schedule_clear(apc_user_cache);
+	}
+	for (i = 0; i < apc_npools; i++) {
+		apc_cache_schedule_clear(apc_pools[i].cache);
 	}
 
 	apc_rehandle_signal(signo, siginfo, context);
@@ -40,19 +40,18 @@
 # ifdef HAVE_VALGRIND_MEMCHECK_H
 #  include <valgrind/memcheck.h>
 # endif
-# define APC_SMA_CANARIES 1
 #endif
 
 enum {
 	DEFAULT_NUMSEG=1,
 	DEFAULT_SEGSIZE=30*1024*1024 };
 
-typedef struct sma_header_t sma_header_t;
-struct sma_header_t {
-	apc_mutex_t sma_lock;    /* segment lock */
-	size_t segsize;         /* size of entire segment */
-	size_t avail;           /* bytes available (not necessarily contiguous) */
-};
+/* address file backed segments are formatted at, away from where heap and libraries go */
+#if SIZEOF_SIZE_T == 8
+# define APC_SMA_FILE_ADDR ((void *) 0x600000000000)
+#else
+# define APC_SMA_FILE_ADDR NULL
+#endif
 
 #define SMA_HDR(sma, i)  ((sma_header_t*)((sma->segs[i]).shmaddr))
 #define SMA_ADDR(sma, i) ((char*)(SMA_HDR(sma, i)))
@@ -72,20 +71,6 @@ struct sma_header_t {
 static volatile size_t block_id = 0;
 #endif
 
-typedef struct block_t block_t;
-struct block_t {
-	size_t size;       /* size of this block */
-	size_t prev_size;  /* size of sequentially previous block, 0 if prev is allocated */
-	size_t fnext;      /* offset in segment of next free block */
-	size_t fprev;      /* offset in segment of prev free block */
-#ifdef APC_SMA_CANARIES
-	size_t canary;     /* canary to check for memory overwrites */
-#endif
-#if 0
-	size_t id;         /* identifier for the memory block */
-#endif
-};
-
 /* The macros BLOCKAT and OFFSET are used for convenience throughout this
  * module. Both assume the presence of a variable shmaddr that points to the
  * beginning of the shared memory segment in question. */
@@ -287,6 +272,49 @@ static APC_HOTSPOT size_t sma_deallocate(void* shmaddr, size_t offset)
 }
 /* }}} */
 
+/* {{{ sma_format: lays out an empty segment */
+static void sma_format(void *shmaddr, size_t size)
+{
+	sma_header_t *header = (sma_header_t *) shmaddr;
+	block_t *first, *empty, *last;
+
+	SMA_CREATE_LOCK(&header->sma_lock);
+	header->segsize = size;
+	header->avail = size - ALIGNWORD(sizeof(sma_header_t)) - ALIGNWORD(sizeof(block_t)) - ALIGNWORD(sizeof(block_t));
+	memset(header->format, 0, sizeof(header->format));
+	header->base = NULL;
+	header->root = NULL;
+
+	first = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
+	first->size = 0;
+	first->fnext = ALIGNWORD(sizeof(sma_header_t)) + ALIGNWORD(sizeof(block_t));
+	first->fprev = 0;
+	first->prev_size = 0;
+	SET_CANARY(first);
+#if 0
+	first->id = -1;
+#endif
+	empty = BLOCKAT(first->fnext);
+	empty->size = header->avail - ALIGNWORD(sizeof(block_t));
+	empty->fnext = OFFSET(empty) + empty->size;
+	empty->fprev = ALIGNWORD(sizeof(sma_header_t));
+	empty->prev_size = 0;
+	SET_CANARY(empty);
+#if 0
+	empty->id = -1;
+#endif
+	last = BLOCKAT(empty->fnext);
+	last->size = 0;
+	last->fnext = 0;
+	last->fprev =  OFFSET(empty);
+	last->prev_size = empty->size;
+	SET_CANARY(last);
+#if 0
+	last->id = -1;
+#endif
+}
+/* }}} */
+
 /* {{{ APC SMA API */
 PHP_APCU_API void apc_sma_init(apc_sma_t* sma, void** data, apc_sma_expunge_f expunge, int32_t num, size_t size, char *mask) {
 	int32_t i;
@@ -298,6 +326,7 @@ PHP_APCU_API void apc_sma_init(apc_sma_t* sma, void** data, apc_sma_expunge_f ex
 	sma->initialized = 1;
 	sma->expunge = expunge;
 	sma->data = data;
+	sma->fd = -1;
 
 #if APC_MMAP
 	/*
@@ -320,10 +349,6 @@ PHP_APCU_API void apc_sma_init(apc_sma_t* sma, void** data, apc_sma_expunge_f ex
 	sma->segs = (apc_segment_t*) pemalloc(sma->num * sizeof(apc_segment_t), 1);
 
 	for (i = 0; i < sma->num; i++) {
-		sma_header_t*   header;
-		block_t     *first, *empty, *last;
-		void*       shmaddr;
-
 #if APC_MMAP
 		sma->segs[i] = apc_mmap(mask, sma->size);
 		if(sma->num != 1)
@@ -341,41 +366,91 @@ PHP_APCU_API void apc_sma_init(apc_sma_t* sma, void** data, apc_sma_expunge_f ex
 
 		sma->segs[i].size = sma->size;
 
-		shmaddr = sma->segs[i].shmaddr;
+		sma_format(sma->segs[i].shmaddr, sma->size);
+	}
+}
 
-		header = (sma_header_t*) shmaddr;
-		SMA_CREATE_LOCK(&header->sma_lock);
-		header->segsize = sma->size;
-		header->avail = sma->size - ALIGNWORD(sizeof(sma_header_t)) - ALIGNWORD(sizeof(block_t)) - ALIGNWORD(sizeof(block_t));
+#if APC_MMAP
+/* {{{ sma_reusable: whether a file backed segment was formatted and completed with the same layout */
+static zend_bool sma_reusable(sma_header_t *header, size_t size, const char *format)
+{
+	return header->segsize == size && header->base && header->root
+		&& !strncmp(header->format, format, APC_SMA_FORMAT_SIZE);
+}
+/* }}} */
 
-		first = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
-		first->size = 0;
-		first->fnext = ALIGNWORD(sizeof(sma_header_t)) + ALIGNWORD(sizeof(block_t));
-		first->fprev = 0;
-		first->prev_size = 0;
-		SET_CANARY(first);
-#if 0
-		first->id = -1;
-#endif
-		empty = BLOCKAT(first->fnext);
-		empty->size = header->avail - ALIGNWORD(sizeof(block_t));
-		empty->fnext = OFFSET(empty) + empty->size;
-		empty->fprev = ALIGNWORD(sizeof(sma_header_t));
-		empty->prev_size = 0;
-		SET_CANARY(empty);
-#if 0
-		empty->id = -1;
-#endif
-		last = BLOCKAT(empty->fnext);
-		last->size = 0;
-		last->fnext = 0;
-		last->fprev =  OFFSET(empty);
-		last->prev_size = empty->size;
-		SET_CANARY(last);
-#if 0
-		last->id = -1;
-#endif
+PHP_APCU_API int apc_sma_init_file(apc_sma_t* sma, void** data, apc_sma_expunge_f expunge, size_t size, const char *path, const char *format) {
+	sma_header_t *header;
+	void *base = APC_SMA_FILE_ADDR;
+	zend_bool alone;
+	int result = APC_SMA_FILE_FORMATTED;
+
+	if (sma->initialized) {
+		return result;
 	}
+
+	sma->initialized = 1;
+	sma->expunge = expunge;
+	sma->data = data;
+	sma->num = 1;
+	sma->size = size > 0 ? size : DEFAULT_SEGSIZE;
+	sma->segs = (apc_segment_t*) pemalloc(sizeof(apc_segment_t), 1);
+	sma->fd = apc_mmap_open(path);
+
+	/* processes starting at the same time set the segment up one after the other,
+	 * the first one finds no other users and may format or recover it */
+	apc_mmap_lock_init(sma->fd, 1);
+	alone = apc_mmap_lock_users(sma->fd, 1);
+
+	if (!alone && apc_mmap_size(sma->fd) != sma->size) {
+		zend_error_noreturn(E_CORE_ERROR, "apc_sma_init_file: %s is in use with a different apc.shm_size", path);
+	}
+
+	/* a formatted segment holds absolute pointers, so it must be mapped where it was formatted */
+	sma->segs[0] = apc_mmap_file(sma->fd, path, sma->size, NULL);
+	header = (sma_header_t *) sma->segs[0].shmaddr;
+	if (sma_reusable(header, sma->size, format)) {
+		base = header->base;
+	} else if (!alone) {
+		zend_error_noreturn(E_CORE_ERROR, "apc_sma_init_file: %s is in use with a different format than %s", path, format);
+	}
+
+	if (sma->segs[0].shmaddr != base) {
+		apc_unmap(&sma->segs[0]);
+		sma->segs[0] = apc_mmap_file(sma->fd, path, sma->size, base);
+		header = (sma_header_t *) sma->segs[0].shmaddr;
+	}
+
+	if (header->base == header && sma_reusable(header, sma->size, format)) {
+		if (alone) {
+			/* the previous owner may have died holding the lock */
+			SMA_CREATE_LOCK(&header->sma_lock);
+			result = APC_SMA_FILE_RECOVERED;
+		} else {
+			result = APC_SMA_FILE_JOINED;
+		}
+	} else if (!alone) {
+		zend_error_noreturn(E_CORE_ERROR, "apc_sma_init_file: %s cannot be mapped at %p like its other users do", path, base);
+	} else {
+		sma_format(header, sma->size);
+		strncpy(header->format, format, APC_SMA_FORMAT_SIZE - 1);
+		header->base = header;
+	}
+
+	/* held until the descriptor is closed on detach, or the process and its children exit */
+	apc_mmap_lock_users(sma->fd, 0);
+	apc_mmap_lock_init(sma->fd, 0);
+
+	return result;
+}
+#endif
+
+PHP_APCU_API void *apc_sma_get_root(apc_sma_t* sma) {
+	return SMA_HDR(sma, 0)->root;
+}
+
+PHP_APCU_API void apc_sma_set_root(apc_sma_t* sma, void *root) {
+	SMA_HDR(sma, 0)->root = root;
 }
 
 PHP_APCU_API void apc_sma_detach(apc_sma_t* sma) {
@@ -395,6 +470,12 @@ PHP_APCU_API void apc_sma_detach(apc_sma_t* sma) {
 #endif
 	}
 
+#if APC_MMAP
+	if (sma->fd != -1) {
+		close(sma->fd);
+	}
+#endif
+
 	free(sma->segs);
 }
 
@@ -30,6 +30,41 @@
 
 #include "apc.h"
 #include "apc_sma_api.h"
+#include "apc_mutex.h"
+
+#ifdef APC_SMA_DEBUG
+# define APC_SMA_CANARIES 1
+#endif
+
+/* Layout of a segment, also read by apc_inspect.c */
+
+/* {{{ struct definition: sma_header_t
+   At the start of every segment, followed by the blocks */
+typedef struct sma_header_t sma_header_t;
+struct sma_header_t {
+	apc_mutex_t sma_lock;    /* segment lock */
+	size_t segsize;         /* size of entire segment */
+	size_t avail;           /* bytes available (not necessarily contiguous) */
+	char format[APC_SMA_FORMAT_SIZE]; /* layout of a file backed segment */
+	void *base;             /* address a file backed segment was formatted at */
+	void *root;             /* root object of a file backed segment */
+}; /* }}} */
+
+/* {{{ struct definition: block_t
+   Header of each block, free blocks are linked by offset starting with the first one */
+typedef struct block_t block_t;
+struct block_t {
+	size_t size;       /* size of this block */
+	size_t prev_size;  /* size of sequentially previous block, 0 if prev is allocated */
+	size_t fnext;      /* offset in segment of next free block */
+	size_t fprev;      /* offset in segment of prev free block */
+#ifdef APC_SMA_CANARIES
+	size_t canary;     /* canary to check for memory overwrites */
+#endif
+#if 0
+	size_t id;         /* identifier for the memory block */
+#endif
+}; /* }}} */
 
 #endif
 
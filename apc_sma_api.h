@@ -60,6 +60,9 @@ struct apc_sma_info_t {
 
 typedef void (*apc_sma_expunge_f)(void *pointer, size_t size); /* }}} */
 
+/* size of the format string identifying the layout of a file backed segment */
+#define APC_SMA_FORMAT_SIZE 128
+
 /* {{{ struct definition: apc_sma_t */
 typedef struct _apc_sma_t {
 	zend_bool initialized;         /* flag to indicate this sma has been initialized */
@@ -75,6 +78,7 @@ typedef struct _apc_sma_t {
 
 	/* segments */
 	apc_segment_t *segs;           /* segments */
+	int fd;                        /* descriptor of a named segment, -1 otherwise */
 } apc_sma_t; /* }}} */
 
 /*
@@ -86,6 +90,30 @@ PHP_APCU_API void apc_sma_init(
 		apc_sma_t* sma, void** data, apc_sma_expunge_f expunge,
 		int32_t num, size_t size, char *mask);
 
+#if APC_MMAP
+/* how apc_sma_init_file set up the segment */
+#define APC_SMA_FILE_FORMATTED 0 /* formatted empty */
+#define APC_SMA_FILE_RECOVERED 1 /* left behind by processes that are gone, reused as is */
+#define APC_SMA_FILE_JOINED    2 /* in use by other processes, shared with them */
+
+/*
+* apc_sma_init_file will initialize a shared memory allocator with one named segment,
+* a POSIX shared memory object if path contains ".shm" and a file otherwise
+*
+* a segment with the same format is reused; joining one that other processes use
+* with a different size or format is a fatal error
+*/
+PHP_APCU_API int apc_sma_init_file(
+		apc_sma_t* sma, void** data, apc_sma_expunge_f expunge,
+		size_t size, const char *path, const char *format);
+#endif
+
+/*
+* apc_sma_get_root and apc_sma_set_root access the pointer the owner of a file backed segment finds its data by
+*/
+PHP_APCU_API void *apc_sma_get_root(apc_sma_t* sma);
+PHP_APCU_API void apc_sma_set_root(apc_sma_t* sma, void *root);
+
 /*
  * apc_sma_detach will detach from shared memory and cleanup local allocations.
  */
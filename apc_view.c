@@ -0,0 +1,406 @@
+/*
+  +----------------------------------------------------------------------+
+  | APCu                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 The PHP Group                                     |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+ */
+
+/*
+ * APCUArrayView reads the elements of a cached array straight from the HashTable persisted
+ * in shared memory, copying only the elements read. The entry is pinned while the view
+ * exists, so the array cannot be freed under it, and it is never written to: lookups and
+ * iteration use external positions only. Serialized values cannot be read in place, their
+ * view holds a copy instead.
+ */
+
+#include "php_apc.h"
+#include "apc_view.h"
+#include "apc_cache.h"
+#if PHP_VERSION_ID >= 80000
+# include "apc_view_arginfo.h"
+#else
+# include "apc_view_legacy_arginfo.h"
+#endif
+
+#include "zend_interfaces.h"
+#if PHP_VERSION_ID < 70200
+# include "ext/spl/spl_iterators.h"
+# define zend_ce_countable spl_ce_Countable
+#endif
+
+static zend_class_entry *apc_view_ce;
+static zend_class_entry *apc_view_iterator_ce;
+static zend_object_handlers apc_view_object_handlers;
+static zend_object_handlers apc_view_iterator_object_handlers;
+
+#define ENSURE_INITIALIZED(view) \
+	if (!(view)->ht) { \
+		zend_throw_error(NULL, "Trying to use uninitialized APCUArrayView"); \
+		return; \
+	}
+
+/* {{{ apc_view_copy: copy value, an element of the array of the view, to be usable at runtime */
+static void apc_view_copy(apc_view_t *view, const zval *value, zval *dst) {
+	if (view->entry) {
+		apc_cache_entry_fetch_value(view->cache, view->entry, value, dst);
+	} else {
+		ZVAL_COPY(dst, value);
+	}
+}
+/* }}} */
+
+/* {{{ apc_view_free */
+static void apc_view_free(zend_object *object) {
+	apc_view_t *view = apc_view_fetch_from(object);
+
+	if (view->entry) {
+		apc_cache_entry_release_held(view->cache, view->entry);
+	}
+	zval_ptr_dtor(&view->copy);
+
+	zend_object_std_dtor(object);
+}
+/* }}} */
+
+/* {{{ apc_view_create_object */
+static zend_object* apc_view_create_object(zend_class_entry *ce) {
+	apc_view_t *view = (apc_view_t*) emalloc(sizeof(apc_view_t) + zend_object_properties_size(ce));
+
+	zend_object_std_init(&view->obj, ce);
+	object_properties_init(&view->obj, ce);
+
+	view->cache = NULL;
+	view->entry = NULL;
+	view->ht = NULL;
+	ZVAL_UNDEF(&view->copy);
+	view->obj.handlers = &apc_view_object_handlers;
+
+	return &view->obj;
+}
+/* }}} */
+
+/* {{{ apc_view_iterator_free */
+static void apc_view_iterator_free(zend_object *object) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch_from(object);
+
+	zval_ptr_dtor(&iterator->view);
+	zend_object_std_dtor(object);
+}
+/* }}} */
+
+/* {{{ apc_view_iterator_create_object */
+static zend_object* apc_view_iterator_create_object(zend_class_entry *ce) {
+	apc_view_iterator_t *iterator =
+		(apc_view_iterator_t*) emalloc(sizeof(apc_view_iterator_t) + zend_object_properties_size(ce));
+
+	zend_object_std_init(&iterator->obj, ce);
+	object_properties_init(&iterator->obj, ce);
+
+	ZVAL_UNDEF(&iterator->view);
+	iterator->pos = 0;
+	iterator->obj.handlers = &apc_view_iterator_object_handlers;
+
+	return &iterator->obj;
+}
+/* }}} */
+
+/* {{{ apc_view_iterator_get: the view of an iterator, NULL with an exception if there is none */
+static apc_view_t *apc_view_iterator_get(apc_view_iterator_t *iterator) {
+	if (Z_TYPE(iterator->view) != IS_OBJECT) {
+		zend_throw_error(NULL, "Trying to use uninitialized APCUArrayViewIterator");
+		return NULL;
+	}
+
+	return apc_view_fetch(&iterator->view);
+}
+/* }}} */
+
+/* {{{ apc_view_create */
+PHP_APCU_API zend_bool apc_view_create(zval *dst, apc_cache_t *cache, zend_string *key, time_t t) {
+	apc_cache_entry_t *entry = apc_cache_find(cache, key, t);
+	apc_view_t *view;
+	zval copy;
+
+	if (!entry) {
+		return 0;
+	}
+
+	if (Z_TYPE(entry->val) == IS_ARRAY) {
+		object_init_ex(dst, apc_view_ce);
+		view = apc_view_fetch(dst);
+		view->cache = cache;
+		view->entry = entry;
+		view->ht = Z_ARRVAL(entry->val);
+		/* read in place for as long as the object lives, even past apc.gc_ttl */
+		apc_cache_entry_hold(cache, entry);
+		return 1;
+	}
+
+	if (Z_TYPE(entry->val) != IS_PTR) {
+		apc_cache_entry_release(cache, entry);
+		return 0;
+	}
+
+	/* serialized values cannot be read in place */
+	ZVAL_UNDEF(&copy);
+	php_apc_try {
+		apc_cache_entry_fetch_zval(cache, entry, &copy);
+	} php_apc_finally {
+		apc_cache_entry_release(cache, entry);
+	} php_apc_end_try();
+
+	if (Z_TYPE(copy) != IS_ARRAY) {
+		zval_ptr_dtor(&copy);
+		return 0;
+	}
+
+	object_init_ex(dst, apc_view_ce);
+	view = apc_view_fetch(dst);
+	view->cache = cache;
+	ZVAL_COPY_VALUE(&view->copy, &copy);
+	view->ht = Z_ARRVAL(view->copy);
+	return 1;
+}
+/* }}} */
+
+/* {{{ proto bool APCUArrayView::offsetExists(mixed offset) */
+PHP_METHOD(APCUArrayView, offsetExists) {
+	apc_view_t *view = apc_view_fetch(getThis());
+	zval *offset, *value;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &offset) == FAILURE) {
+		return;
+	}
+
+	ENSURE_INITIALIZED(view);
+
+	value = apc_cache_value_find(view->ht, offset);
+	RETURN_BOOL(value && Z_TYPE_P(value) != IS_NULL);
+}
+/* }}} */
+
+/* {{{ proto mixed APCUArrayView::offsetGet(mixed offset) */
+PHP_METHOD(APCUArrayView, offsetGet) {
+	apc_view_t *view = apc_view_fetch(getThis());
+	zval *offset, *value;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &offset) == FAILURE) {
+		return;
+	}
+
+	ENSURE_INITIALIZED(view);
+
+	value = apc_cache_value_find(view->ht, offset);
+	if (!value) {
+		RETURN_NULL();
+	}
+
+	apc_view_copy(view, value, return_value);
+}
+/* }}} */
+
+/* {{{ proto void APCUArrayView::offsetSet(mixed offset, mixed value) */
+PHP_METHOD(APCUArrayView, offsetSet) {
+	zval *offset, *value;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "zz", &offset, &value) == FAILURE) {
+		return;
+	}
+
+	zend_throw_error(NULL, "APCUArrayView is read-only");
+}
+/* }}} */
+
+/* {{{ proto void APCUArrayView::offsetUnset(mixed offset) */
+PHP_METHOD(APCUArrayView, offsetUnset) {
+	zval *offset;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z", &offset) == FAILURE) {
+		return;
+	}
+
+	zend_throw_error(NULL, "APCUArrayView is read-only");
+}
+/* }}} */
+
+/* {{{ proto int APCUArrayView::count() */
+PHP_METHOD(APCUArrayView, count) {
+	apc_view_t *view = apc_view_fetch(getThis());
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	ENSURE_INITIALIZED(view);
+
+	RETURN_LONG(zend_hash_num_elements(view->ht));
+}
+/* }}} */
+
+/* {{{ proto APCUArrayViewIterator APCUArrayView::getIterator() */
+PHP_METHOD(APCUArrayView, getIterator) {
+	apc_view_t *view = apc_view_fetch(getThis());
+	apc_view_iterator_t *iterator;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	ENSURE_INITIALIZED(view);
+
+	object_init_ex(return_value, apc_view_iterator_ce);
+	iterator = apc_view_iterator_fetch(return_value);
+	ZVAL_COPY(&iterator->view, getThis());
+	zend_hash_internal_pointer_reset_ex((HashTable *) view->ht, &iterator->pos);
+}
+/* }}} */
+
+/* {{{ proto void APCUArrayViewIterator::rewind() */
+PHP_METHOD(APCUArrayViewIterator, rewind) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch(getThis());
+	apc_view_t *view;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if ((view = apc_view_iterator_get(iterator))) {
+		zend_hash_internal_pointer_reset_ex((HashTable *) view->ht, &iterator->pos);
+	}
+}
+/* }}} */
+
+/* {{{ proto void APCUArrayViewIterator::next() */
+PHP_METHOD(APCUArrayViewIterator, next) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch(getThis());
+	apc_view_t *view;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if ((view = apc_view_iterator_get(iterator))) {
+		zend_hash_move_forward_ex((HashTable *) view->ht, &iterator->pos);
+	}
+}
+/* }}} */
+
+/* {{{ proto bool APCUArrayViewIterator::valid() */
+PHP_METHOD(APCUArrayViewIterator, valid) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch(getThis());
+	apc_view_t *view;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if (!(view = apc_view_iterator_get(iterator))) {
+		return;
+	}
+
+	RETURN_BOOL(zend_hash_has_more_elements_ex((HashTable *) view->ht, &iterator->pos) == SUCCESS);
+}
+/* }}} */
+
+/* {{{ proto string|int|null APCUArrayViewIterator::key() */
+PHP_METHOD(APCUArrayViewIterator, key) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch(getThis());
+	apc_view_t *view;
+	zend_string *str_key;
+	zend_ulong num_key;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if (!(view = apc_view_iterator_get(iterator))) {
+		return;
+	}
+
+	switch (zend_hash_get_current_key_ex((HashTable *) view->ht, &str_key, &num_key, &iterator->pos)) {
+		case HASH_KEY_IS_STRING:
+			/* copied, keys in shared memory must not be referenced */
+			RETURN_STRINGL(ZSTR_VAL(str_key), ZSTR_LEN(str_key));
+		case HASH_KEY_IS_LONG:
+			RETURN_LONG(num_key);
+		default:
+			RETURN_NULL();
+	}
+}
+/* }}} */
+
+/* {{{ proto mixed APCUArrayViewIterator::current() */
+PHP_METHOD(APCUArrayViewIterator, current) {
+	apc_view_iterator_t *iterator = apc_view_iterator_fetch(getThis());
+	apc_view_t *view;
+	zval *value;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if (!(view = apc_view_iterator_get(iterator))) {
+		return;
+	}
+
+	value = zend_hash_get_current_data_ex((HashTable *) view->ht, &iterator->pos);
+	if (!value) {
+		RETURN_NULL();
+	}
+
+	ZVAL_DEREF(value);
+	apc_view_copy(view, value, return_value);
+}
+/* }}} */
+
+/* {{{ apc_view_init */
+int apc_view_init(int module_number) {
+	zend_class_entry ce;
+
+	INIT_CLASS_ENTRY(ce, "APCUArrayView", class_APCUArrayView_methods);
+	apc_view_ce = zend_register_internal_class(&ce);
+	apc_view_ce->ce_flags |= ZEND_ACC_FINAL;
+	apc_view_ce->create_object = apc_view_create_object;
+	zend_class_implements(apc_view_ce, 3, zend_ce_arrayaccess, zend_ce_countable, zend_ce_aggregate);
+
+	INIT_CLASS_ENTRY(ce, "APCUArrayViewIterator", class_APCUArrayViewIterator_methods);
+	apc_view_iterator_ce = zend_register_internal_class(&ce);
+	apc_view_iterator_ce->ce_flags |= ZEND_ACC_FINAL;
+	apc_view_iterator_ce->create_object = apc_view_iterator_create_object;
+	zend_class_implements(apc_view_iterator_ce, 1, zend_ce_iterator);
+
+	memcpy(&apc_view_object_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	apc_view_object_handlers.clone_obj = NULL;
+	apc_view_object_handlers.free_obj = apc_view_free;
+	apc_view_object_handlers.offset = XtOffsetOf(apc_view_t, obj);
+
+	memcpy(&apc_view_iterator_object_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	apc_view_iterator_object_handlers.clone_obj = NULL;
+	apc_view_iterator_object_handlers.free_obj = apc_view_iterator_free;
+	apc_view_iterator_object_handlers.offset = XtOffsetOf(apc_view_iterator_t, obj);
+
+	return SUCCESS;
+}
+/* }}} */
+
+int apc_view_shutdown(int module_number) {
+	return SUCCESS;
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim>600: noexpandtab sw=4 ts=4 sts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4 sts=4
+ */
@@ -0,0 +1,65 @@
+/*
+  +----------------------------------------------------------------------+
+  | APCu                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 The PHP Group                                     |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef APC_VIEW_H
+#define APC_VIEW_H
+
+#include "apc.h"
+#include "apc_cache.h"
+
+/* {{{ apc_view_t
+   An array in the cache, whose elements are copied one by one as they are read */
+typedef struct _apc_view_t {
+	apc_cache_t *cache;          /* cache of the entry */
+	apc_cache_entry_t *entry;    /* entry pinned while the view exists, NULL if the value was copied */
+	const HashTable *ht;         /* array viewed, in shared memory unless the value was copied */
+	zval copy;                   /* copy of the value, when it was serialized */
+	zend_object obj;
+} apc_view_t;
+/* }}} */
+
+/* {{{ apc_view_iterator_t */
+typedef struct _apc_view_iterator_t {
+	zval view;                   /* view iterated over */
+	HashPosition pos;            /* position in the array of the view */
+	zend_object obj;
+} apc_view_iterator_t;
+/* }}} */
+
+#define apc_view_fetch_from(o) ((apc_view_t*)((char*)o - XtOffsetOf(apc_view_t, obj)))
+#define apc_view_fetch(z) apc_view_fetch_from(Z_OBJ_P(z))
+
+#define apc_view_iterator_fetch_from(o) ((apc_view_iterator_t*)((char*)o - XtOffsetOf(apc_view_iterator_t, obj)))
+#define apc_view_iterator_fetch(z) apc_view_iterator_fetch_from(Z_OBJ_P(z))
+
+/*
+ * apc_view_create creates in dst a view of the array stored at key.
+ * Returns 0 if there is no such entry or its value is not an array.
+ */
+PHP_APCU_API zend_bool apc_view_create(zval *dst, apc_cache_t *cache, zend_string *key, time_t t);
+
+PHP_APCU_API int apc_view_init(int module_number);
+PHP_APCU_API int apc_view_shutdown(int module_number);
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim>600: noexpandtab sw=4 ts=4 sts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4 sts=4
+ */
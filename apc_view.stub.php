@@ -0,0 +1,32 @@
+<?php
+
+/**
+ * @generate-function-entries
+ * @generate-legacy-arginfo
+ */
+
+final class APCUArrayView implements ArrayAccess, Countable, IteratorAggregate {
+    public function offsetExists(mixed $offset): bool {}
+
+    public function offsetGet(mixed $offset): mixed {}
+
+    public function offsetSet(mixed $offset, mixed $value): void {}
+
+    public function offsetUnset(mixed $offset): void {}
+
+    public function count(): int {}
+
+    public function getIterator(): Iterator {}
+}
+
+final class APCUArrayViewIterator implements Iterator {
+    public function rewind(): void {}
+
+    public function next(): void {}
+
+    public function valid(): bool {}
+
+    public function key(): mixed {}
+
+    public function current(): mixed {}
+}
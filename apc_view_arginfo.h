@@ -0,0 +1,72 @@
+/* This is a generated file, edit the .stub.php file instead.
+ * Stub hash: 8ca621682bd29be1a9dbe773c332342941616653 */
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayView_offsetExists, 0, 1, _IS_BOOL, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_MIXED, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayView_offsetGet, 0, 1, IS_MIXED, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_MIXED, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayView_offsetSet, 0, 2, IS_VOID, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_MIXED, 0)
+	ZEND_ARG_TYPE_INFO(0, value, IS_MIXED, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayView_offsetUnset, 0, 1, IS_VOID, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_MIXED, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayView_count, 0, 0, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_class_APCUArrayView_getIterator, 0, 0, Iterator, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayViewIterator_rewind, 0, 0, IS_VOID, 0)
+ZEND_END_ARG_INFO()
+
+#define arginfo_class_APCUArrayViewIterator_next arginfo_class_APCUArrayViewIterator_rewind
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayViewIterator_valid, 0, 0, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_class_APCUArrayViewIterator_key, 0, 0, IS_MIXED, 0)
+ZEND_END_ARG_INFO()
+
+#define arginfo_class_APCUArrayViewIterator_current arginfo_class_APCUArrayViewIterator_key
+
+
+ZEND_METHOD(APCUArrayView, offsetExists);
+ZEND_METHOD(APCUArrayView, offsetGet);
+ZEND_METHOD(APCUArrayView, offsetSet);
+ZEND_METHOD(APCUArrayView, offsetUnset);
+ZEND_METHOD(APCUArrayView, count);
+ZEND_METHOD(APCUArrayView, getIterator);
+ZEND_METHOD(APCUArrayViewIterator, rewind);
+ZEND_METHOD(APCUArrayViewIterator, next);
+ZEND_METHOD(APCUArrayViewIterator, valid);
+ZEND_METHOD(APCUArrayViewIterator, key);
+ZEND_METHOD(APCUArrayViewIterator, current);
+
+
+static const zend_function_entry class_APCUArrayView_methods[] = {
+	ZEND_ME(APCUArrayView, offsetExists, arginfo_class_APCUArrayView_offsetExists, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayView, offsetGet, arginfo_class_APCUArrayView_offsetGet, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayView, offsetSet, arginfo_class_APCUArrayView_offsetSet, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayView, offsetUnset, arginfo_class_APCUArrayView_offsetUnset, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayView, count, arginfo_class_APCUArrayView_count, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayView, getIterator, arginfo_class_APCUArrayView_getIterator, ZEND_ACC_PUBLIC)
+	ZEND_FE_END
+};
+
+
+static const zend_function_entry class_APCUArrayViewIterator_methods[] = {
+	ZEND_ME(APCUArrayViewIterator, rewind, arginfo_class_APCUArrayViewIterator_rewind, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayViewIterator, next, arginfo_class_APCUArrayViewIterator_next, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayViewIterator, valid, arginfo_class_APCUArrayViewIterator_valid, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayViewIterator, key, arginfo_class_APCUArrayViewIterator_key, ZEND_ACC_PUBLIC)
+	ZEND_ME(APCUArrayViewIterator, current, arginfo_class_APCUArrayViewIterator_current, ZEND_ACC_PUBLIC)
+	ZEND_FE_END
+};
@@ -201,6 +201,11 @@ if test "$PHP_APCU" != "no"; then
   fi
 	
   AC_CHECK_FUNCS(sigaction)
+
+  PHP_CHECK_LIBRARY(pthread, pthread_create, [
+    PHP_ADD_LIBRARY(pthread,,APCU_SHARED_LIBADD)
+    AC_DEFINE(APC_PRELOAD_THREADS, 1, [Whether apc.preload_path is read on threads])
+  ])
   AC_CACHE_CHECK(for union semun, php_cv_semun,
   [
     AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
@@ -238,14 +243,23 @@ if test "$PHP_APCU" != "no"; then
                  apc_stack.c \
                  apc_signal.c \
                  apc_iterator.c \
+                 apc_view.c \
+                 apc_lz4.c \
                  apc_persist.c"
 							   
   PHP_CHECK_LIBRARY(rt, shm_open, [PHP_ADD_LIBRARY(rt,,APCU_SHARED_LIBADD)])
   PHP_NEW_EXTENSION(apcu, $apc_sources, $ext_shared,, \\$(APCU_CFLAGS))
   PHP_SUBST(APCU_SHARED_LIBADD)
   PHP_SUBST(APCU_CFLAGS)
+
+  dnl apcu-inspect reads the named segments only mmap builds have
+  if test "$PHP_APCU_MMAP" != "no"; then
+    APCU_INSPECT=apcu-inspect
+  fi
+  PHP_SUBST(APCU_INSPECT)
+  PHP_ADD_MAKEFILE_FRAGMENT
   PHP_SUBST(PHP_LDFLAGS)
-  PHP_INSTALL_HEADERS(ext/apcu, [php_apc.h apc.h apc_api.h apc_cache.h apc_cache_api.h apc_globals.h apc_iterator.h apc_lock.h apc_mutex.h apc_lock_api.h apc_sma.h apc_sma_api.h apc_serializer.h apc_stack.h apc_arginfo.h php_apc_legacy_arginfo.h])
+  PHP_INSTALL_HEADERS(ext/apcu, [php_apc.h apc.h apc_api.h apc_cache.h apc_cache_api.h apc_globals.h apc_iterator.h apc_lock.h apc_mutex.h apc_lock_api.h apc_sma.h apc_sma_api.h apc_serializer.h apc_stack.h apc_view.h apc_arginfo.h php_apc_legacy_arginfo.h])
   AC_DEFINE(HAVE_APCU, 1, [ ])
 fi
 
@@ -303,8 +317,6 @@ CCACHE_DISABLE=1.])
     AC_MSG_ERROR([Could not find genhtml from the LCOV package])
   fi
 
-  PHP_ADD_MAKEFILE_FRAGMENT
-
   dnl Remove all optimization flags from CFLAGS
   changequote({,})
   CFLAGS=`echo "$CFLAGS" | $SED -e 's/-O[0-9s]*//g'`
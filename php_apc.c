@@ -32,6 +32,7 @@
 
 #include "apc_cache.h"
 #include "apc_iterator.h"
+#include "apc_view.h"
 #include "apc_sma.h"
 #include "apc_lock.h"
 #include "apc_mutex.h"
@@ -43,6 +44,7 @@
 #include "ext/standard/flock_compat.h"
 #include "ext/standard/md5.h"
 #include "ext/standard/php_var.h"
+#include "ext/standard/basic_functions.h"
 #if PHP_VERSION_ID >= 80000
 # include "php_apc_arginfo.h"
 #else
@@ -70,6 +72,10 @@ apc_cache_t* apc_user_cache = NULL;
 /* External APC SMA */
 apc_sma_t apc_sma;
 
+/* Named pools, each with its own SMA */
+apc_pool_t* apc_pools = NULL;
+int apc_npools = 0;
+
 #define X(str) zend_string *apc_str_ ## str;
 	APC_STRINGS
 #undef X
@@ -81,10 +87,28 @@ static void php_apc_init_globals(zend_apcu_globals* apcu_globals)
 	apcu_globals->slam_defense = 0;
 	apcu_globals->smart = 0;
 	apcu_globals->preload_path = NULL;
+	apcu_globals->preload_threads = 4;
+	apcu_globals->restore_file = NULL;
+	apcu_globals->restore_lazy = 0;
 	apcu_globals->coredump_unmap = 0;
 	apcu_globals->use_request_time = 0;
 	apcu_globals->serializer_name = NULL;
+	apcu_globals->prefix_index = 0;
+	apcu_globals->immutable_fetch = 0;
+	apcu_globals->local_size = 0;
+	apcu_globals->compress_threshold = 0;
+	apcu_globals->pools = NULL;
+	apcu_globals->pool_name = NULL;
+	apcu_globals->cache = NULL;
 	apcu_globals->recursion = 0;
+	apcu_globals->rand_seed = 0;
+	apcu_globals->stats_shard = 0;
+	apcu_globals->deferred_refresh = NULL;
+	apcu_globals->shared_entries = NULL;
+	apcu_globals->local = NULL;
+	apcu_globals->local_mem = 0;
+	apcu_globals->local_clock = 0;
+	apcu_globals->local_retired = NULL;
 }
 /* }}} */
 
@@ -125,6 +149,34 @@ static PHP_INI_MH(OnUpdateShmSize) /* {{{ */
 }
 /* }}} */
 
+static PHP_INI_MH(OnUpdateLocalSize) /* {{{ */
+{
+	zend_long s = zend_atol(new_value->val, new_value->len);
+
+	if (s < 0) {
+		return FAILURE;
+	}
+
+	APCG(local_size) = s;
+
+	return SUCCESS;
+}
+/* }}} */
+
+static PHP_INI_MH(OnUpdateCompressThreshold) /* {{{ */
+{
+	zend_long s = zend_atol(new_value->val, new_value->len);
+
+	if (s < 0) {
+		return FAILURE;
+	}
+
+	APCG(compress_threshold) = s;
+
+	return SUCCESS;
+}
+/* }}} */
+
 PHP_INI_BEGIN()
 STD_PHP_INI_BOOLEAN("apc.enabled",      "1",    PHP_INI_SYSTEM, OnUpdateBool,              enabled,          zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.shm_segments",   "1",    PHP_INI_SYSTEM, OnUpdateShmSegments,       shm_segments,     zend_apcu_globals, apcu_globals)
@@ -135,13 +187,24 @@ STD_PHP_INI_ENTRY("apc.ttl",            "0",    PHP_INI_SYSTEM, OnUpdateLong,
 STD_PHP_INI_ENTRY("apc.smart",          "0",    PHP_INI_SYSTEM, OnUpdateLong,              smart,            zend_apcu_globals, apcu_globals)
 #if APC_MMAP
 STD_PHP_INI_ENTRY("apc.mmap_file_mask",  NULL,  PHP_INI_SYSTEM, OnUpdateString,            mmap_file_mask,   zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.persist_file",    NULL,  PHP_INI_SYSTEM, OnUpdateString,            persist_file,     zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.shm_name",        NULL,  PHP_INI_SYSTEM, OnUpdateString,            shm_name,         zend_apcu_globals, apcu_globals)
 #endif
 STD_PHP_INI_BOOLEAN("apc.enable_cli",   "0",    PHP_INI_SYSTEM, OnUpdateBool,              enable_cli,       zend_apcu_globals, apcu_globals)
 STD_PHP_INI_BOOLEAN("apc.slam_defense", "0",    PHP_INI_SYSTEM, OnUpdateBool,              slam_defense,     zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.preload_path", (char*)NULL,              PHP_INI_SYSTEM, OnUpdateString,       preload_path,  zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.preload_threads", "4",                  PHP_INI_SYSTEM, OnUpdateLong,         preload_threads, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.restore_file", (char*)NULL,              PHP_INI_SYSTEM, OnUpdateString,       restore_file,  zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.restore_lazy", "0", PHP_INI_SYSTEM, OnUpdateBool, restore_lazy, zend_apcu_globals, apcu_globals)
 STD_PHP_INI_BOOLEAN("apc.coredump_unmap", "0", PHP_INI_SYSTEM, OnUpdateBool, coredump_unmap, zend_apcu_globals, apcu_globals)
 STD_PHP_INI_BOOLEAN("apc.use_request_time", "0", PHP_INI_ALL, OnUpdateBool, use_request_time,  zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.serializer", "php", PHP_INI_SYSTEM, OnUpdateStringUnempty, serializer_name, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.prefix_index", "0", PHP_INI_SYSTEM, OnUpdateBool, prefix_index, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.immutable_fetch", "0", PHP_INI_SYSTEM, OnUpdateBool, immutable_fetch, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.local_size", "0", PHP_INI_SYSTEM, OnUpdateLocalSize, local_size, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.compress_threshold", "0", PHP_INI_SYSTEM, OnUpdateCompressThreshold, compress_threshold, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.pools", (char*)NULL, PHP_INI_SYSTEM, OnUpdateString, pools, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.pool", (char*)NULL, PHP_INI_SYSTEM|PHP_INI_PERDIR, OnUpdateString, pool_name, zend_apcu_globals, apcu_globals)
 PHP_INI_END()
 
 /* }}} */
@@ -151,6 +214,91 @@ zend_bool apc_is_enabled(void)
 	return APCG(enabled);
 }
 
+/* {{{ apc_pool_find */
+apc_cache_t* apc_pool_find(const char *name, size_t len)
+{
+	int i;
+
+	if (len == sizeof("default")-1 && !memcmp(name, "default", len)) {
+		return apc_user_cache;
+	}
+
+	for (i = 0; i < apc_npools; i++) {
+		if (strlen(apc_pools[i].name) == len && !memcmp(apc_pools[i].name, name, len)) {
+			return apc_pools[i].cache;
+		}
+	}
+
+	return NULL;
+} /* }}} */
+
+/* {{{ apc_pools_create
+   Creates the pools listed in apc.pools, e.g. "sessions:16M,ratelimit:4M" */
+static void apc_pools_create(const char *config, char *mmap_file_mask)
+{
+	char *list = pestrdup(config, 1), *tok, *last = NULL;
+	int npools = 1;
+	const char *p;
+
+	for (p = config; *p; p++) {
+		if (*p == ',') {
+			npools++;
+		}
+	}
+
+	/* allocated once, the SMA of each pool refers to its cache pointer */
+	apc_pools = pecalloc(npools, sizeof(apc_pool_t), 1);
+
+	for (tok = php_strtok_r(list, ",", &last); tok; tok = php_strtok_r(NULL, ",", &last)) {
+		apc_pool_t *pool = &apc_pools[apc_npools];
+		char *name = tok, *size = strchr(tok, ':');
+		zend_long segsize;
+
+		while (*name == ' ') {
+			name++;
+		}
+
+		if (!size || size == name) {
+			apc_warning("apc.pools: '%s' is not a name:size pair", tok);
+			continue;
+		}
+		*size++ = '\0';
+
+		segsize = zend_atol(size, strlen(size));
+		if (segsize <= 0) {
+			apc_warning("apc.pools: invalid size for pool '%s'", name);
+			continue;
+		}
+
+		if (apc_pool_find(name, strlen(name))) {
+			apc_warning("apc.pools: pool '%s' is defined more than once", name);
+			continue;
+		}
+
+#if APC_MMAP
+		/* apc_mmap() replaces the template of a file mask, restore it for each pool */
+		if (mmap_file_mask && strlen(mmap_file_mask) >= 6 && strcmp(mmap_file_mask, "/dev/zero")) {
+			memcpy(&mmap_file_mask[strlen(mmap_file_mask)-6], "XXXXXX", 6);
+		}
+#endif
+
+		pool->name = pestrdup(name, 1);
+		apc_sma_init(
+			&pool->sma, (void **) &pool->cache, (apc_sma_expunge_f) apc_cache_default_expunge,
+			1, segsize, mmap_file_mask);
+		pool->cache = apc_cache_create(
+			&pool->sma,
+			apc_find_serializer(APCG(serializer_name)),
+			APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense));
+		pool->cache->indexed = APCG(prefix_index);
+		pool->cache->immutable = APCG(immutable_fetch) && APC_CACHE_IMMUTABLE;
+		pool->cache->compress_threshold = APCG(compress_threshold);
+		apc_npools++;
+	}
+
+	pefree(list, 1);
+} /* }}} */
+
 /* {{{ PHP_MINFO_FUNCTION(apcu) */
 static PHP_MINFO_FUNCTION(apcu)
 {
@@ -165,6 +313,8 @@ static PHP_MINFO_FUNCTION(apcu)
 #if APC_MMAP
 	php_info_print_table_row(2, "MMAP Support", "Enabled");
 	php_info_print_table_row(2, "MMAP File Mask", APCG(mmap_file_mask));
+	php_info_print_table_row(2, "Persist File", APCG(persist_file));
+	php_info_print_table_row(2, "Shared Segment Name", APCG(shm_name));
 #else
 	php_info_print_table_row(2, "MMAP Support", "Disabled");
 #endif
@@ -203,6 +353,8 @@ static PHP_MINFO_FUNCTION(apcu)
 /* {{{ PHP_MINIT_FUNCTION(apcu) */
 static PHP_MINIT_FUNCTION(apcu)
 {
+	zend_bool locks_shared;
+
 #if defined(ZTS) && defined(COMPILE_DL_APCU)
 	ZEND_TSRMLS_CACHE_UPDATE();
 #endif
@@ -217,7 +369,7 @@ static PHP_MINIT_FUNCTION(apcu)
 #undef X
 
 	/* locks initialized regardless of settings */
-	apc_lock_init();
+	locks_shared = apc_lock_init() && APC_LOCK_PROCESS_SHARED;
 	APC_MUTEX_INIT();
 
 	/* Disable APC in cli mode unless overridden by apc.enable_cli */
@@ -231,14 +383,36 @@ static PHP_MINIT_FUNCTION(apcu)
 		if (!APCG(initialized)) {
 #if APC_MMAP
 			char *mmap_file_mask = APCG(mmap_file_mask);
+			char *segment_name = APCG(shm_name) && *APCG(shm_name) ? APCG(shm_name) : APCG(persist_file);
 #else
 			char *mmap_file_mask = NULL;
 #endif
 
+			int segment = APC_SMA_FILE_FORMATTED;
+			zend_bool attached = 0;
+
 			/* ensure this runs only once */
 			APCG(initialized) = 1;
 
 			/* initialize shared memory allocator */
+#if APC_MMAP
+			/* processes attaching to the segment would take locks that do not exclude each other */
+			if (segment_name && *segment_name && !locks_shared) {
+				apc_warning("apc.shm_name and apc.persist_file require process-shared pthread locks, the main cache is not shared");
+				segment_name = NULL;
+			}
+
+			if (segment_name && *segment_name) {
+				char format[APC_SMA_FORMAT_SIZE];
+
+				apc_cache_format(
+					format, sizeof(format), APCG(serializer_name), APCG(entries_hint), APCG(prefix_index));
+				segment = apc_sma_init_file(
+					&apc_sma, (void **) &apc_user_cache, (apc_sma_expunge_f) apc_cache_default_expunge,
+					APCG(shm_size), segment_name, format);
+				attached = segment != APC_SMA_FILE_FORMATTED;
+			} else
+#endif
 			apc_sma_init(
 				&apc_sma, (void **) &apc_user_cache, (apc_sma_expunge_f) apc_cache_default_expunge,
 				APCG(shm_segments), APCG(shm_size), mmap_file_mask);
@@ -252,22 +426,55 @@ static PHP_MINIT_FUNCTION(apcu)
 			/* test out the constant function pointer */
 			assert(apc_get_serializers()->name != NULL);
 
-			/* create user cache */
-			apc_user_cache = apc_cache_create(
-				&apc_sma,
-				apc_find_serializer(APCG(serializer_name)),
-				APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense));
+			/* create user cache, or attach to the one in the named segment */
+			if (attached) {
+				apc_user_cache = apc_cache_attach(
+					&apc_sma,
+					apc_find_serializer(APCG(serializer_name)), apc_sma_get_root(&apc_sma),
+					APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense),
+					segment == APC_SMA_FILE_RECOVERED);
+			} else {
+				apc_user_cache = apc_cache_create(
+					&apc_sma,
+					apc_find_serializer(APCG(serializer_name)),
+					APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense));
+#if APC_MMAP
+				if (segment_name && *segment_name) {
+					apc_sma_set_root(&apc_sma, apc_user_cache->shmaddr);
+				}
+#endif
+			}
+			apc_user_cache->indexed = APCG(prefix_index);
+			apc_user_cache->immutable = APCG(immutable_fetch) && APC_CACHE_IMMUTABLE;
+			apc_user_cache->compress_threshold = APCG(compress_threshold);
+
+			/* create named pools */
+			if (APCG(pools) && *APCG(pools)) {
+				apc_pools_create(APCG(pools), mmap_file_mask);
+			}
 
 			/* preload data from path specified in configuration */
-			if (APCG(preload_path)) {
+			if (APCG(preload_path) && !attached) {
 				apc_cache_preload(
 					apc_user_cache, APCG(preload_path));
 			}
+
+			/* restore the snapshot specified in configuration */
+			if (APCG(restore_file) && *APCG(restore_file) && !attached) {
+#if APC_MMAP
+				/* the snapshot would only be mapped by this process, not by those attaching later */
+				if (APCG(restore_lazy) && !(segment_name && *segment_name)) {
+					apc_cache_restore_lazy(apc_user_cache, APCG(restore_file));
+				} else
+#endif
+				apc_cache_restore(apc_user_cache, APCG(restore_file));
+			}
 		}
 	}
 
-	/* initialize iterator object */
+	/* initialize iterator and view objects */
 	apc_iterator_init(module_number);
+	apc_view_init(module_number);
 
 	return SUCCESS;
 }
@@ -287,19 +494,35 @@ static PHP_MSHUTDOWN_FUNCTION(apcu)
 	/* only shut down if APC is enabled */
 	if (APCG(enabled)) {
 		if (APCG(initialized)) {
+			int i;
+
 			/* Detach cache and shared memory allocator from shared memory. */
 			apc_cache_detach(apc_user_cache);
 			apc_sma_detach(&apc_sma);
 
+			for (i = 0; i < apc_npools; i++) {
+				apc_cache_detach(apc_pools[i].cache);
+				apc_sma_detach(&apc_pools[i].sma);
+				pefree(apc_pools[i].name, 1);
+			}
+			if (apc_pools) {
+				pefree(apc_pools, 1);
+				apc_pools = NULL;
+				apc_npools = 0;
+			}
+
 			APCG(initialized) = 0;
 		}
 
+		apc_cache_local_destroy();
+
 #if HAVE_SIGACTION
 		apc_shutdown_signals();
 #endif
 	}
 
 	apc_iterator_shutdown(module_number);
+	apc_view_shutdown(module_number);
 
 	UNREGISTER_INI_ENTRIES();
 	return SUCCESS;
@@ -314,9 +537,35 @@ static PHP_RINIT_FUNCTION(apcu)
 
 	APCG(request_time) = 0;
 	if (APCG(enabled)) {
+		int i;
+
+		/* Spread the statistics updates of concurrent workers over the counter shards */
+		apc_cache_select_stats_shard();
+
+		/* Select the pool of this request, apc.pool may be set per FPM pool */
+		APCG(cache) = apc_user_cache;
+		if (APCG(pool_name) && *APCG(pool_name)) {
+			apc_cache_t *cache = apc_pool_find(APCG(pool_name), strlen(APCG(pool_name)));
+
+			if (cache) {
+				APCG(cache) = cache;
+			} else {
+				apc_warning("apc.pool=%s is not a pool defined in apc.pools", APCG(pool_name));
+			}
+		}
+
+		/* Clears requested by a signal are carried out here, outside of signal context */
+		apc_cache_run_scheduled_clear(apc_user_cache);
+		for (i = 0; i < apc_npools; i++) {
+			apc_cache_run_scheduled_clear(apc_pools[i].cache);
+		}
+
 		if (APCG(serializer_name)) {
 			/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
 			apc_cache_serializer(apc_user_cache, APCG(serializer_name));
+			for (i = 0; i < apc_npools; i++) {
+				apc_cache_serializer(apc_pools[i].cache, APCG(serializer_name));
+			}
 		}
 
 #if HAVE_SIGACTION
@@ -327,6 +576,26 @@ static PHP_RINIT_FUNCTION(apcu)
 }
 /* }}} */
 
+/* {{{ PHP_RSHUTDOWN_FUNCTION(apcu) */
+static PHP_RSHUTDOWN_FUNCTION(apcu)
+{
+	/* Regenerations deferred once the shutdown functions have run are dropped, their
+	 * claims time out and the next request regenerates those entries */
+	apc_cache_entry_discard_deferred();
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ ZEND_MODULE_POST_ZEND_DEACTIVATE_D(apcu) */
+static ZEND_MODULE_POST_ZEND_DEACTIVATE_D(apcu)
+{
+	/* Values fetched without copying may be referenced until the executor is shut down */
+	apc_cache_release_shared();
+	apc_cache_local_collect();
+	return SUCCESS;
+}
+/* }}} */
+
 /* {{{ proto void apcu_clear_cache() */
 PHP_FUNCTION(apcu_clear_cache)
 {
@@ -334,7 +603,7 @@ PHP_FUNCTION(apcu_clear_cache)
 		return;
 	}
 
-	apc_cache_clear(apc_user_cache);
+	apc_cache_clear(APCG(cache));
 	RETURN_TRUE;
 }
 /* }}} */
@@ -348,7 +617,7 @@ PHP_FUNCTION(apcu_cache_info)
 		return;
 	}
 
-	if (!apc_cache_info(return_value, apc_user_cache, limited)) {
+	if (!apc_cache_info(return_value, APCG(cache), limited)) {
 		php_error_docref(NULL, E_WARNING, "No APC info available.  Perhaps APC is not enabled? Check apc.enabled in your ini file");
 		RETURN_FALSE;
 	}
@@ -364,12 +633,13 @@ PHP_FUNCTION(apcu_key_info)
 		return;
 	}
 
-	apc_cache_stat(apc_user_cache, key, return_value);
+	apc_cache_stat(APCG(cache), key, return_value);
 } /* }}} */
 
 /* {{{ proto array apcu_sma_info([bool limited]) */
 PHP_FUNCTION(apcu_sma_info)
 {
+	apc_sma_t* sma;
 	apc_sma_info_t* info;
 	zval block_lists;
 	int i;
@@ -379,7 +649,8 @@ PHP_FUNCTION(apcu_sma_info)
 		return;
 	}
 
-	info = apc_sma_info(&apc_sma, limited);
+	sma = APCG(cache) ? APCG(cache)->sma : &apc_sma;
+	info = apc_sma_info(sma, limited);
 
 	if (!info) {
 		php_error_docref(NULL, E_WARNING, "No APC SMA info available.  Perhaps APC is disabled via apc.enabled?");
@@ -389,10 +660,10 @@ PHP_FUNCTION(apcu_sma_info)
 
 	add_assoc_long(return_value, "num_seg", info->num_seg);
 	add_assoc_double(return_value, "seg_size", (double)info->seg_size);
-	add_assoc_double(return_value, "avail_mem", (double)apc_sma_get_avail_mem(&apc_sma));
+	add_assoc_double(return_value, "avail_mem", (double)apc_sma_get_avail_mem(sma));
 
 	if (limited) {
-		apc_sma_free_info(&apc_sma, info);
+		apc_sma_free_info(sma, info);
 		return;
 	}
 
@@ -415,7 +686,7 @@ PHP_FUNCTION(apcu_sma_info)
 		add_next_index_zval(&block_lists, &list);
 	}
 	add_assoc_zval(return_value, "block_lists", &block_lists);
-	apc_sma_free_info(&apc_sma, info);
+	apc_sma_free_info(sma, info);
 }
 /* }}} */
 
@@ -426,10 +697,10 @@ zend_bool php_apc_update(
 {
 	if (APCG(serializer_name)) {
 		/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
-		apc_cache_serializer(apc_user_cache, APCG(serializer_name));
+		apc_cache_serializer(APCG(cache), APCG(serializer_name));
 	}
 
-	return apc_cache_atomic_update_long(apc_user_cache, key, updater, data, insert_if_not_found, ttl);
+	return apc_cache_atomic_update_long(APCG(cache), key, updater, data, insert_if_not_found, ttl);
 }
 /* }}} */
 
@@ -440,40 +711,23 @@ static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclu
 	zval *key;
 	zval *val = NULL;
 	zend_long ttl = 0L;
+	HashTable *tags = NULL;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|zl", &key, &val, &ttl) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|zlh", &key, &val, &ttl, &tags) == FAILURE) {
 		return;
 	}
 
 	if (APCG(serializer_name)) {
 		/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
-		apc_cache_serializer(apc_user_cache, APCG(serializer_name));
+		apc_cache_serializer(APCG(cache), APCG(serializer_name));
 	}
 
 	/* TODO: Port to array|string for PHP 8? */
 	if (Z_TYPE_P(key) == IS_ARRAY) {
-		zval *hentry;
-		zend_string *hkey;
-		zend_ulong hkey_idx;
-		HashTable* hash = Z_ARRVAL_P(key);
-
 		/* We only insert keys that failed */
-		zval fail_zv;
-		ZVAL_LONG(&fail_zv, -1);
 		array_init(return_value);
-
-		ZEND_HASH_FOREACH_KEY_VAL(hash, hkey_idx, hkey, hentry) {
-			ZVAL_DEREF(hentry);
-			if (hkey) {
-				zend_string_addref(hkey);
-			} else {
-				hkey = zend_long_to_str(hkey_idx);
-			}
-			if (!apc_cache_store(apc_user_cache, hkey, hentry, (uint32_t) ttl, exclusive)) {
-				zend_symtable_add_new(Z_ARRVAL_P(return_value), hkey, &fail_zv);
-			}
-			zend_string_release(hkey);
-		} ZEND_HASH_FOREACH_END();
+		apc_cache_store_multi(
+			APCG(cache), Z_ARRVAL_P(key), (uint32_t) ttl, exclusive, tags, Z_ARRVAL_P(return_value));
 		return;
 	} else if (Z_TYPE_P(key) == IS_STRING) {
 		if (!val) {
@@ -481,7 +735,7 @@ static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclu
 			RETURN_FALSE;
 		}
 
-		RETURN_BOOL(apc_cache_store(apc_user_cache, Z_STR_P(key), val, (uint32_t) ttl, exclusive));
+		RETURN_BOOL(apc_cache_store_tagged(APCG(cache), Z_STR_P(key), val, (uint32_t) ttl, exclusive, tags));
 	} else {
 		apc_warning("apc_store expects key parameter to be a string or an array of key/value pairs.");
 		RETURN_FALSE;
@@ -499,14 +753,14 @@ PHP_FUNCTION(apcu_enabled) {
 }
 /* }}} */
 
-/* {{{ proto int apcu_store(mixed key, mixed var [, long ttl ])
+/* {{{ proto int apcu_store(mixed key, mixed var [, long ttl [, array tags ]])
  */
 PHP_FUNCTION(apcu_store) {
 	apc_store_helper(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
 }
 /* }}} */
 
-/* {{{ proto int apcu_add(mixed key, mixed var [, long ttl ])
+/* {{{ proto int apcu_add(mixed key, mixed var [, long ttl [, array tags ]])
  */
 PHP_FUNCTION(apcu_add) {
 	apc_store_helper(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
@@ -604,10 +858,10 @@ PHP_FUNCTION(apcu_cas) {
 
 	if (APCG(serializer_name)) {
 		/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
-		apc_cache_serializer(apc_user_cache, APCG(serializer_name));
+		apc_cache_serializer(APCG(cache), APCG(serializer_name));
 	}
 
-	RETURN_BOOL(apc_cache_atomic_update_long(apc_user_cache, key, php_cas_updater, &vals, 0, 0));
+	RETURN_BOOL(apc_cache_atomic_update_long(APCG(cache), key, php_cas_updater, &vals, 0, 0));
 }
 /* }}} */
 
@@ -631,24 +885,25 @@ PHP_FUNCTION(apcu_fetch) {
 
 	/* TODO: Port to array|string for PHP 8? */
 	if (Z_TYPE_P(key) == IS_STRING) {
-		result = apc_cache_fetch(apc_user_cache, Z_STR_P(key), t, return_value);
+		result = apc_cache_fetch(APCG(cache), Z_STR_P(key), t, return_value);
 	} else if (Z_TYPE_P(key) == IS_ARRAY) {
 		zval *hentry;
+		zend_string **keys;
+		size_t nkeys = 0;
 
-		array_init(return_value);
+		keys = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(key)), sizeof(zend_string *), 0);
 		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(key), hentry) {
 			ZVAL_DEREF(hentry);
 			if (Z_TYPE_P(hentry) == IS_STRING) {
-				zval result_entry;
-				ZVAL_UNDEF(&result_entry);
-
-				if (apc_cache_fetch(apc_user_cache, Z_STR_P(hentry), t, &result_entry)) {
-					zend_hash_update(Z_ARRVAL_P(return_value), Z_STR_P(hentry), &result_entry);
-				}
+				keys[nkeys++] = Z_STR_P(hentry);
 			} else {
 				apc_warning("apc_fetch() expects a string or array of strings.");
 			}
 		} ZEND_HASH_FOREACH_END();
+
+		array_init(return_value);
+		apc_cache_fetch_multi(APCG(cache), keys, nkeys, t, Z_ARRVAL_P(return_value));
+		efree(keys);
 		result = 1;
 	} else {
 		apc_warning("apc_fetch() expects a string or array of strings.");
@@ -664,6 +919,106 @@ PHP_FUNCTION(apcu_fetch) {
 }
 /* }}} */
 
+/* {{{ proto mixed apcu_fetch_path(string key, array path [, bool &success])
+ */
+PHP_FUNCTION(apcu_fetch_path) {
+	zend_string *key;
+	HashTable *path;
+	zval *success = NULL;
+	zend_bool result;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sh|z", &key, &path, &success) == FAILURE) {
+		return;
+	}
+
+	result = apc_cache_fetch_path(APCG(cache), key, path, apc_time(), return_value);
+
+	if (success) {
+		ZEND_TRY_ASSIGN_REF_BOOL(success, result);
+	}
+	if (!result) {
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto APCUArrayView|false apcu_fetch_view(string key)
+ */
+PHP_FUNCTION(apcu_fetch_view) {
+	zend_string *key;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &key) == FAILURE) {
+		return;
+	}
+
+	if (!apc_view_create(return_value, APCG(cache), key, apc_time())) {
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto mixed apcu_fetch_versioned(string key [, int &version])
+ */
+PHP_FUNCTION(apcu_fetch_versioned) {
+	zend_string *key;
+	zval *version = NULL;
+	zend_long found = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S|z", &key, &version) == FAILURE) {
+		return;
+	}
+
+	/* no entry has version 0, whatever is found is fetched */
+	if (!apc_cache_fetch_if_changed(APCG(cache), key, &found, apc_time(), return_value)) {
+		ZVAL_FALSE(return_value);
+	}
+
+	if (version) {
+		ZEND_TRY_ASSIGN_REF_LONG(version, found);
+	}
+}
+/* }}} */
+
+/* {{{ proto mixed apcu_fetch_if_changed(string key, int &version)
+ */
+PHP_FUNCTION(apcu_fetch_if_changed) {
+	zend_string *key;
+	zval *version;
+	zend_long found;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sz", &key, &version) == FAILURE) {
+		return;
+	}
+
+	found = zval_get_long(Z_REFVAL_P(version));
+	if (!apc_cache_fetch_if_changed(APCG(cache), key, &found, apc_time(), return_value)) {
+		ZVAL_FALSE(return_value);
+	}
+
+	ZEND_TRY_ASSIGN_REF_LONG(version, found);
+}
+/* }}} */
+
+/* {{{ proto bool apcu_store_if_version(string key, mixed var, int version [, long ttl])
+ */
+PHP_FUNCTION(apcu_store_if_version) {
+	zend_string *key;
+	zval *val;
+	zend_long version, ttl = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Szl|l", &key, &val, &version, &ttl) == FAILURE) {
+		return;
+	}
+
+	if (APCG(serializer_name)) {
+		/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
+		apc_cache_serializer(APCG(cache), APCG(serializer_name));
+	}
+
+	RETURN_BOOL(apc_cache_store_if_version(APCG(cache), key, val, version, (uint32_t) ttl));
+}
+/* }}} */
+
 /* {{{ proto mixed apcu_exists(mixed key)
  */
 PHP_FUNCTION(apcu_exists) {
@@ -682,7 +1037,7 @@ PHP_FUNCTION(apcu_exists) {
 
 	/* TODO: Port to array|string for PHP 8? */
 	if (Z_TYPE_P(key) == IS_STRING) {
-		RETURN_BOOL(apc_cache_exists(apc_user_cache, Z_STR_P(key), t));
+		RETURN_BOOL(apc_cache_exists(APCG(cache), Z_STR_P(key), t));
 	} else if (Z_TYPE_P(key) == IS_ARRAY) {
 		zval *hentry;
 		zval true_zv;
@@ -692,7 +1047,7 @@ PHP_FUNCTION(apcu_exists) {
 		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(key), hentry) {
 			ZVAL_DEREF(hentry);
 			if (Z_TYPE_P(hentry) == IS_STRING) {
-				if (apc_cache_exists(apc_user_cache, Z_STR_P(hentry), t)) {
+				if (apc_cache_exists(APCG(cache), Z_STR_P(hentry), t)) {
 					  zend_hash_add_new(Z_ARRVAL_P(return_value), Z_STR_P(hentry), &true_zv);
 				}
 			} else {
@@ -717,10 +1072,26 @@ PHP_FUNCTION(apcu_delete) {
 	}
 
 	if (Z_TYPE_P(keys) == IS_STRING) {
-		RETURN_BOOL(apc_cache_delete(apc_user_cache, Z_STR_P(keys)));
+		RETURN_BOOL(apc_cache_delete(APCG(cache), Z_STR_P(keys)));
 	} else if (Z_TYPE_P(keys) == IS_ARRAY) {
 		zval *hentry;
+		zend_string **skeys;
+		zend_bool *deleted;
+		size_t nkeys = 0, i = 0;
+
+		/* delete all string keys at once */
+		skeys = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(keys)), sizeof(zend_string *), 0);
+		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(keys), hentry) {
+			ZVAL_DEREF(hentry);
+			if (Z_TYPE_P(hentry) == IS_STRING) {
+				skeys[nkeys++] = Z_STR_P(hentry);
+			}
+		} ZEND_HASH_FOREACH_END();
 
+		deleted = safe_emalloc(nkeys, sizeof(zend_bool), 0);
+		apc_cache_delete_multi(APCG(cache), skeys, nkeys, deleted);
+
+		/* then report the keys that were not deleted, in order */
 		array_init(return_value);
 		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(keys), hentry) {
 			ZVAL_DEREF(hentry);
@@ -728,11 +1099,14 @@ PHP_FUNCTION(apcu_delete) {
 				apc_warning("apc_delete() expects a string, array of strings, or APCIterator instance");
 				add_next_index_zval(return_value, hentry);
 				Z_TRY_ADDREF_P(hentry);
-			} else if (apc_cache_delete(apc_user_cache, Z_STR_P(hentry)) != 1) {
+			} else if (!deleted[i++]) {
 				add_next_index_zval(return_value, hentry);
 				Z_TRY_ADDREF_P(hentry);
 			}
 		} ZEND_HASH_FOREACH_END();
+
+		efree(deleted);
+		efree(skeys);
 	} else if (Z_TYPE_P(keys) == IS_OBJECT) {
 		RETURN_BOOL(apc_iterator_delete(keys) != 0);
 	} else {
@@ -741,18 +1115,236 @@ PHP_FUNCTION(apcu_delete) {
 	}
 }
 
+/* {{{ proto int apcu_delete_prefix(string prefix)
+ */
+PHP_FUNCTION(apcu_delete_prefix)
+{
+	zend_string *prefix;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &prefix) == FAILURE) {
+		return;
+	}
+
+	RETURN_LONG(apc_cache_delete_prefix(APCG(cache), prefix));
+}
+/* }}} */
+
+/* {{{ proto array apcu_fetch_prefix(string prefix)
+ */
+PHP_FUNCTION(apcu_fetch_prefix)
+{
+	zend_string *prefix;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &prefix) == FAILURE) {
+		return;
+	}
+
+	if (!apc_cache_fetch_prefix(APCG(cache), prefix, apc_time(), return_value)) {
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto int apcu_invalidate_tags(array tags)
+ */
+PHP_FUNCTION(apcu_invalidate_tags)
+{
+	HashTable *tags;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "h", &tags) == FAILURE) {
+		return;
+	}
+
+	RETURN_LONG(apc_cache_invalidate_tags(APCG(cache), tags));
+}
+/* }}} */
+
+/* {{{ proto int|false apcu_dump(string filename)
+ */
+PHP_FUNCTION(apcu_dump)
+{
+	char *filename;
+	size_t filename_len;
+	zend_long count;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "p", &filename, &filename_len) == FAILURE) {
+		return;
+	}
+
+	if (php_check_open_basedir(filename)) {
+		RETURN_FALSE;
+	}
+
+	count = apc_cache_dump(APCG(cache), filename);
+	if (count < 0) {
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(count);
+}
+/* }}} */
+
+/* {{{ proto int|false apcu_restore(string filename)
+ */
+PHP_FUNCTION(apcu_restore)
+{
+	char *filename;
+	size_t filename_len;
+	zend_long count;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "p", &filename, &filename_len) == FAILURE) {
+		return;
+	}
+
+	if (php_check_open_basedir(filename)) {
+		RETURN_FALSE;
+	}
+
+	count = apc_cache_restore(APCG(cache), filename);
+	if (count < 0) {
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(count);
+}
+/* }}} */
+
+/* {{{ proto int|false apcu_export(resource stream [, ?APCUIterator filter])
+ */
+PHP_FUNCTION(apcu_export)
+{
+	zval *zstream, *filter = NULL;
+	php_stream *stream;
+	zend_long count;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "r|O!", &zstream, &filter, apc_iterator_get_ce()) == FAILURE) {
+		return;
+	}
+
+	php_stream_from_zval(stream, zstream);
+
+	if (filter) {
+		count = apc_iterator_export(filter, stream);
+	} else {
+		count = apc_cache_export(APCG(cache), stream, NULL, NULL);
+	}
+
+	if (count < 0) {
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(count);
+}
+/* }}} */
+
+/* {{{ proto int|false apcu_import(resource stream)
+ */
+PHP_FUNCTION(apcu_import)
+{
+	zval *zstream;
+	php_stream *stream;
+	zend_long count;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "r", &zstream) == FAILURE) {
+		return;
+	}
+
+	php_stream_from_zval(stream, zstream);
+
+	count = apc_cache_import(APCG(cache), stream);
+	if (count < 0) {
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(count);
+}
+/* }}} */
+
+/* Deferred regenerations run as a shutdown function, under max_execution_time and before
+ * destructors are called. It is registered along with the first regeneration deferred. */
+static zend_bool php_apc_register_deferred(void) {
+	php_shutdown_function_entry entry;
+#if PHP_VERSION_ID >= 80000
+	zval callable;
+
+	ZVAL_STRING(&callable, "apcu_entry_run_deferred");
+	if (zend_fcall_info_init(&callable, 0, &entry.fci, &entry.fci_cache, NULL, NULL) != SUCCESS
+			|| !append_user_shutdown_function(&entry)) {
+		zval_ptr_dtor(&callable);
+		return 0;
+	}
+#else
+	entry.arg_count = 1;
+	entry.arguments = (zval *) safe_emalloc(sizeof(zval), 1, 0);
+	ZVAL_STRING(&entry.arguments[0], "apcu_entry_run_deferred");
+	if (!append_user_shutdown_function(entry)) {
+		zval_ptr_dtor(&entry.arguments[0]);
+		efree(entry.arguments);
+		return 0;
+	}
+#endif
+
+	return 1;
+}
+
 PHP_FUNCTION(apcu_entry) {
 	zend_string *key;
 	zend_fcall_info fci = empty_fcall_info;
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	zend_long ttl = 0L;
+	zend_long grace = 0L;
+	double beta = 0.0;
+	zend_bool defer = 0;
 	zend_long now = apc_time();
+	zend_bool deferred = APCG(deferred_refresh) != NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sf|lldb", &key, &fci, &fcc, &ttl, &grace, &beta, &defer) != SUCCESS) {
+		return;
+	}
+
+	apc_cache_entry(APCG(cache), key, &fci, &fcc, ttl, grace, beta, defer, now, return_value);
+
+	if (!deferred && APCG(deferred_refresh) && !php_apc_register_deferred()) {
+		/* nothing would run it, and its claim would hold off other regenerations */
+		php_error_docref(NULL, E_WARNING, "Unable to register the deferred regeneration, running it now");
+		apc_cache_entry_run_deferred();
+	}
+}
+/* }}} */
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sf|l", &key, &fci, &fcc, &ttl) != SUCCESS) {
+/* {{{ proto void apcu_entry_run_deferred()
+    Runs the regenerations apcu_entry() deferred so far, for instance right after fastcgi_finish_request() */
+PHP_FUNCTION(apcu_entry_run_deferred) {
+	if (zend_parse_parameters_none() == FAILURE) {
 		return;
 	}
 
-	apc_cache_entry(apc_user_cache, key, &fci, &fcc, ttl, now, return_value);
+	apc_cache_entry_run_deferred();
+}
+/* }}} */
+
+/* {{{ proto bool apcu_select_pool(string name)
+ */
+PHP_FUNCTION(apcu_select_pool) {
+	zend_string *name;
+	apc_cache_t *cache;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &name) != SUCCESS) {
+		return;
+	}
+
+	if (!APCG(enabled)) {
+		RETURN_FALSE;
+	}
+
+	cache = apc_pool_find(ZSTR_VAL(name), ZSTR_LEN(name));
+	if (!cache) {
+		php_error_docref(NULL, E_WARNING, "Pool '%s' is not defined in apc.pools", ZSTR_VAL(name));
+		RETURN_FALSE;
+	}
+
+	APCG(cache) = cache;
+	RETURN_TRUE;
 }
 /* }}} */
 
@@ -787,10 +1379,12 @@ zend_module_entry apcu_module_entry = {
 	PHP_MINIT(apcu),
 	PHP_MSHUTDOWN(apcu),
 	PHP_RINIT(apcu),
-	NULL,
+	PHP_RSHUTDOWN(apcu),
 	PHP_MINFO(apcu),
 	PHP_APCU_VERSION,
-	STANDARD_MODULE_PROPERTIES
+	NO_MODULE_GLOBALS,
+	ZEND_MODULE_POST_ZEND_DEACTIVATE_N(apcu),
+	STANDARD_MODULE_PROPERTIES_EX
 };
 /* }}} */
 
@@ -16,10 +16,10 @@ function apcu_sma_info(bool $limited = false): array|false {}
 function apcu_enabled(): bool {}
 
 /** @param array|string $key */
-function apcu_store($key, mixed $value = UNKNOWN, int $ttl = 0): array|bool {}
+function apcu_store($key, mixed $value = UNKNOWN, int $ttl = 0, array $tags = []): array|bool {}
 
 /** @param array|string $key */
-function apcu_add($key, mixed $value = UNKNOWN, int $ttl = 0): array|bool {}
+function apcu_add($key, mixed $value = UNKNOWN, int $ttl = 0, array $tags = []): array|bool {}
 
 /** @param bool $success */
 function apcu_inc(string $key, int $step = 1, &$success = null, int $ttl = 0): int|false {}
@@ -41,7 +41,39 @@ function apcu_exists($key): array|bool {}
 /** @param APCUIterator|array|string $key */
 function apcu_delete($key): array|bool {}
 
-function apcu_entry(string $key, callable $callback, int $ttl = 0): mixed {}
+function apcu_entry(string $key, callable $callback, int $ttl = 0, int $grace = 0, float $beta = 0.0, bool $defer = false): mixed {}
+
+function apcu_entry_run_deferred(): void {}
+
+function apcu_select_pool(string $name): bool {}
+
+function apcu_delete_prefix(string $prefix): int {}
+
+function apcu_fetch_prefix(string $prefix): array|false {}
+
+function apcu_invalidate_tags(array $tags): int {}
+
+function apcu_dump(string $filename): int|false {}
+
+function apcu_restore(string $filename): int|false {}
+
+/** @param resource $stream */
+function apcu_export($stream, ?APCUIterator $filter = null): int|false {}
+
+/** @param resource $stream */
+function apcu_import($stream): int|false {}
+
+function apcu_fetch_view(string $key): APCUArrayView|false {}
+
+/** @param bool $success */
+function apcu_fetch_path(string $key, array $path, &$success = null): mixed {}
+
+/** @param int $version */
+function apcu_fetch_versioned(string $key, &$version = null): mixed {}
+
+function apcu_fetch_if_changed(string $key, int &$version): mixed {}
+
+function apcu_store_if_version(string $key, mixed $value, int $version, int $ttl = 0): bool {}
 
 #ifdef APC_DEBUG
 function apcu_inc_request_time(int $by = 1): void {}
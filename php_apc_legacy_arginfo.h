@@ -1,5 +1,5 @@
 /* This is a generated file, edit the .stub.php file instead.
- * Stub hash: 5282d856fd334278d5799581ad251977a3c6b18e */
+ * Stub hash: 7e08f6d19507cb62defbadffe12fd38a2b9cd3bb */
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_clear_cache, 0, 0, 0)
 ZEND_END_ARG_INFO()
@@ -20,6 +20,7 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_store, 0, 0, 1)
 	ZEND_ARG_INFO(0, key)
 	ZEND_ARG_INFO(0, value)
 	ZEND_ARG_INFO(0, ttl)
+	ZEND_ARG_INFO(0, tags)
 ZEND_END_ARG_INFO()
 
 #define arginfo_apcu_add arginfo_apcu_store
@@ -52,6 +53,65 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_entry, 0, 0, 2)
 	ZEND_ARG_INFO(0, key)
 	ZEND_ARG_INFO(0, callback)
 	ZEND_ARG_INFO(0, ttl)
+	ZEND_ARG_INFO(0, grace)
+	ZEND_ARG_INFO(0, beta)
+	ZEND_ARG_INFO(0, defer)
+ZEND_END_ARG_INFO()
+
+#define arginfo_apcu_entry_run_deferred arginfo_apcu_clear_cache
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_select_pool, 0, 0, 1)
+	ZEND_ARG_INFO(0, name)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_delete_prefix, 0, 0, 1)
+	ZEND_ARG_INFO(0, prefix)
+ZEND_END_ARG_INFO()
+
+#define arginfo_apcu_fetch_prefix arginfo_apcu_delete_prefix
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_invalidate_tags, 0, 0, 1)
+	ZEND_ARG_INFO(0, tags)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_dump, 0, 0, 1)
+	ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+#define arginfo_apcu_restore arginfo_apcu_dump
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_export, 0, 0, 1)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, filter)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_import, 0, 0, 1)
+	ZEND_ARG_INFO(0, stream)
+ZEND_END_ARG_INFO()
+
+#define arginfo_apcu_fetch_view arginfo_apcu_key_info
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_fetch_path, 0, 0, 2)
+	ZEND_ARG_INFO(0, key)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_INFO(1, success)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_fetch_versioned, 0, 0, 1)
+	ZEND_ARG_INFO(0, key)
+	ZEND_ARG_INFO(1, version)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_fetch_if_changed, 0, 0, 2)
+	ZEND_ARG_INFO(0, key)
+	ZEND_ARG_INFO(1, version)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_apcu_store_if_version, 0, 0, 3)
+	ZEND_ARG_INFO(0, key)
+	ZEND_ARG_INFO(0, value)
+	ZEND_ARG_INFO(0, version)
+	ZEND_ARG_INFO(0, ttl)
 ZEND_END_ARG_INFO()
 
 #if defined(APC_DEBUG)
@@ -75,6 +135,20 @@ PHP_APCU_API ZEND_FUNCTION(apcu_fetch);
 PHP_APCU_API ZEND_FUNCTION(apcu_exists);
 PHP_APCU_API ZEND_FUNCTION(apcu_delete);
 PHP_APCU_API ZEND_FUNCTION(apcu_entry);
+PHP_APCU_API ZEND_FUNCTION(apcu_entry_run_deferred);
+PHP_APCU_API ZEND_FUNCTION(apcu_select_pool);
+PHP_APCU_API ZEND_FUNCTION(apcu_delete_prefix);
+PHP_APCU_API ZEND_FUNCTION(apcu_fetch_prefix);
+PHP_APCU_API ZEND_FUNCTION(apcu_invalidate_tags);
+PHP_APCU_API ZEND_FUNCTION(apcu_dump);
+PHP_APCU_API ZEND_FUNCTION(apcu_restore);
+PHP_APCU_API ZEND_FUNCTION(apcu_export);
+PHP_APCU_API ZEND_FUNCTION(apcu_import);
+PHP_APCU_API ZEND_FUNCTION(apcu_fetch_view);
+PHP_APCU_API ZEND_FUNCTION(apcu_fetch_path);
+PHP_APCU_API ZEND_FUNCTION(apcu_fetch_versioned);
+PHP_APCU_API ZEND_FUNCTION(apcu_fetch_if_changed);
+PHP_APCU_API ZEND_FUNCTION(apcu_store_if_version);
 #if defined(APC_DEBUG)
 PHP_APCU_API ZEND_FUNCTION(apcu_inc_request_time);
 #endif
@@ -95,6 +169,20 @@ static const zend_function_entry ext_functions[] = {
 	ZEND_FE(apcu_exists, arginfo_apcu_exists)
 	ZEND_FE(apcu_delete, arginfo_apcu_delete)
 	ZEND_FE(apcu_entry, arginfo_apcu_entry)
+	ZEND_FE(apcu_entry_run_deferred, arginfo_apcu_entry_run_deferred)
+	ZEND_FE(apcu_select_pool, arginfo_apcu_select_pool)
+	ZEND_FE(apcu_delete_prefix, arginfo_apcu_delete_prefix)
+	ZEND_FE(apcu_fetch_prefix, arginfo_apcu_fetch_prefix)
+	ZEND_FE(apcu_invalidate_tags, arginfo_apcu_invalidate_tags)
+	ZEND_FE(apcu_dump, arginfo_apcu_dump)
+	ZEND_FE(apcu_restore, arginfo_apcu_restore)
+	ZEND_FE(apcu_export, arginfo_apcu_export)
+	ZEND_FE(apcu_import, arginfo_apcu_import)
+	ZEND_FE(apcu_fetch_view, arginfo_apcu_fetch_view)
+	ZEND_FE(apcu_fetch_path, arginfo_apcu_fetch_path)
+	ZEND_FE(apcu_fetch_versioned, arginfo_apcu_fetch_versioned)
+	ZEND_FE(apcu_fetch_if_changed, arginfo_apcu_fetch_if_changed)
+	ZEND_FE(apcu_store_if_version, arginfo_apcu_store_if_version)
 #if defined(APC_DEBUG)
 	ZEND_FE(apcu_inc_request_time, arginfo_apcu_inc_request_time)
 #endif
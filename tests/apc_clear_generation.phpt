@@ -0,0 +1,42 @@
+--TEST--
+APC: apcu_clear_cache leaves no visible entries behind
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+for ($i = 0; $i < 100; $i++) {
+    apcu_store("key$i", $i, 0, ["tag"]);
+}
+apcu_store("kept", "old");
+
+var_dump(apcu_clear_cache());
+
+$info = apcu_cache_info();
+var_dump($info["num_entries"], count($info["cache_list"]));
+var_dump(apcu_fetch("key1"), apcu_exists("key2"), apcu_key_info("key3"));
+var_dump(apcu_delete("key4"));
+var_dump(apcu_invalidate_tags(["tag"]));
+var_dump((new APCUIterator('/^key/'))->getTotalCount());
+
+var_dump(apcu_add("kept", "new"));
+var_dump(apcu_fetch("kept"));
+var_dump(apcu_inc("key5"));
+var_dump(apcu_cache_info(true)["num_entries"]);
+?>
+--EXPECT--
+bool(true)
+int(0)
+int(0)
+bool(false)
+bool(false)
+NULL
+bool(false)
+int(0)
+int(0)
+bool(true)
+string(3) "new"
+int(1)
+int(2)
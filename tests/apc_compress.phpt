@@ -0,0 +1,46 @@
+--TEST--
+APC: apc.compress_threshold stores large values compressed
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.compress_threshold=4K
+--FILE--
+<?php
+
+$text = str_repeat("The quick brown fox jumps over the lazy dog. ", 1000);
+$rows = [];
+for ($i = 0; $i < 500; $i++) {
+	$rows[] = ["id" => $i, "name" => "row $i", "tags" => ["a", "b", "c"]];
+}
+
+/* compressed values take a fraction of their size */
+apcu_store("text", $text);
+var_dump(apcu_cache_info(true)["mem_size"] < strlen($text) / 4);
+
+apcu_store("rows", $rows);
+apcu_store("small", str_repeat("x", 100));
+apcu_store("random", random_bytes(8192));
+
+var_dump(apcu_fetch("text") === $text);
+var_dump(apcu_fetch("rows") === $rows);
+var_dump(apcu_fetch("small") === str_repeat("x", 100));
+var_dump(strlen(apcu_fetch("random")));
+
+$info = apcu_cache_info(true);
+var_dump($info["num_compressed"], $info["compression_ratio"] > 4);
+var_dump($info["num_decompressed"], $info["compressed_size"] < $info["compressed_original_size"]);
+?>
+===DONE===
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+int(8192)
+int(2)
+bool(true)
+int(2)
+bool(true)
+===DONE===
@@ -0,0 +1,44 @@
+--TEST--
+APC: apcu_delete with an array of keys and with an iterator
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.entries_hint=4096
+--FILE--
+<?php
+for ($i = 0; $i < 3000; $i++) {
+    apcu_store("a$i", $i);
+    apcu_store("b$i", $i);
+}
+
+var_dump(apcu_delete(["a1", "missing", "a2", 3, "a1"]));
+var_dump(apcu_exists("a1"), apcu_exists("a2"), apcu_exists("a3"));
+
+var_dump(apcu_delete(new APCUIterator('/^a/')));
+var_dump(apcu_cache_info(true)["num_entries"]);
+
+var_dump(apcu_delete(new APCUIterator(["b1", "b2", "nope"])));
+var_dump(apcu_exists("b1"), apcu_exists("b3"));
+var_dump(apcu_cache_info(true)["num_entries"]);
+?>
+--EXPECTF--
+Warning: apcu_delete(): apc_delete() expects a string, array of strings, or APCIterator instance in %s on line %d
+array(3) {
+  [0]=>
+  string(7) "missing"
+  [1]=>
+  int(3)
+  [2]=>
+  string(2) "a1"
+}
+bool(false)
+bool(false)
+bool(true)
+bool(true)
+int(3000)
+bool(true)
+bool(false)
+bool(true)
+int(2998)
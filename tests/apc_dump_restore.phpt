@@ -0,0 +1,54 @@
+--TEST--
+APC: apcu_dump and apcu_restore
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+$file = __DIR__ . '/apc_dump_restore.snapshot';
+
+$shared = ["shared"];
+$values = [
+    "string" => "foo",
+    "int" => 42,
+    "array" => ["a" => [1, 2.5, "b"], "c" => $shared, "d" => $shared, "e" => []],
+    "object" => new ArrayObject([1, 2]),
+    "empty" => [],
+];
+var_dump(apcu_store($values, null, 0, ["tag"]));
+
+var_dump(apcu_dump($file));
+
+apcu_clear_cache();
+var_dump(apcu_store("string", "kept"));
+
+var_dump(apcu_restore($file));
+var_dump(apcu_fetch("string"), apcu_fetch("int"), apcu_fetch("array") == $values["array"],
+    apcu_fetch("object") == $values["object"], apcu_fetch("empty"));
+
+/* the tags are restored with the entries */
+var_dump(apcu_invalidate_tags(["tag"]), apcu_exists("int"));
+
+var_dump(@apcu_restore(__FILE__));
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/apc_dump_restore.snapshot');
+?>
+--EXPECT--
+array(0) {
+}
+int(5)
+bool(true)
+int(4)
+string(4) "kept"
+int(42)
+bool(true)
+bool(true)
+array(0) {
+}
+int(4)
+bool(false)
+bool(false)
@@ -0,0 +1,46 @@
+--TEST--
+APC: apcu_entry (grace period)
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+--FILE--
+<?php
+$generate = function ($value) {
+	return function ($key) use ($value) {
+		echo "generate $key\n";
+		return $value;
+	};
+};
+
+var_dump(apcu_entry("key", $generate("v1"), 1, 10));
+
+echo "T+2\n";
+apcu_inc_request_time(2);
+var_dump(apcu_fetch("key"));
+/* Claims the regeneration and defers it, returning the stale value */
+var_dump(apcu_entry("key", function () { return "v2"; }, 1, 10, 0.0, true));
+/* The regeneration is claimed already, keep serving the stale value */
+var_dump(apcu_entry("key", $generate("v2"), 1, 10));
+
+echo "T+20\n";
+apcu_inc_request_time(18);
+var_dump(apcu_entry("key", $generate("v3"), 1, 10));
+var_dump(apcu_fetch("key"));
+?>
+--EXPECT--
+generate key
+string(2) "v1"
+T+2
+bool(false)
+string(2) "v1"
+string(2) "v1"
+T+20
+generate key
+string(2) "v3"
+string(2) "v3"
@@ -0,0 +1,26 @@
+--TEST--
+APC: apcu_entry (cache access from the generator)
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+apcu_store("config", "db");
+
+$value = apcu_entry("test", function($key) {
+	apcu_store("generated", $key);
+	apcu_delete("stale");
+	return apcu_fetch("config") . ":" . apcu_inc("counter");
+});
+
+var_dump($value, apcu_fetch("test"), apcu_fetch("generated"), apcu_fetch("counter"));
+?>
+===DONE===
+--EXPECT--
+string(4) "db:1"
+string(4) "db:1"
+string(4) "test"
+int(1)
+===DONE===
@@ -0,0 +1,56 @@
+--TEST--
+APC: apcu_entry (deferred regeneration runs as a shutdown function)
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+--FILE--
+<?php
+class Holder {
+	public function __destruct() {
+		echo "destructed\n";
+	}
+}
+
+$generate = function ($value) {
+	return function ($key) use ($value) {
+		echo "generate $key $value\n";
+		$GLOBALS["holders"][] = new Holder;
+		return $value;
+	};
+};
+
+apcu_entry("key", function () { return "v1"; }, 1, 10);
+apcu_inc_request_time(2);
+
+/* Regenerated when asked to, as after fastcgi_finish_request() */
+var_dump(apcu_entry("key", $generate("v2"), 1, 10, 0.0, true));
+echo "response sent\n";
+apcu_entry_run_deferred();
+var_dump(apcu_fetch("key"));
+
+apcu_inc_request_time(2);
+
+/* Otherwise once the response is complete, before destructors are called */
+var_dump(apcu_entry("key", $generate("v3"), 1, 10, 0.0, true));
+register_shutdown_function(function () {
+	var_dump(apcu_fetch("key"));
+});
+echo "response sent\n";
+?>
+--EXPECT--
+string(2) "v1"
+response sent
+generate key v2
+string(2) "v2"
+string(2) "v2"
+response sent
+generate key v3
+string(2) "v3"
+destructed
+destructed
@@ -0,0 +1,47 @@
+--TEST--
+APC: apcu_export and apcu_import on streams
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+for ($i = 0; $i < 250; $i++) {
+    apcu_store("user:$i", ["id" => $i]);
+}
+apcu_store("other", "x");
+
+$stream = fopen("php://temp", "w+");
+var_dump(apcu_export($stream));
+var_dump(apcu_export($stream, new APCUIterator('/^user:1\d$/')));
+rewind($stream);
+
+apcu_clear_cache();
+var_dump(apcu_import($stream), apcu_cache_info(true)["num_entries"]);
+var_dump(apcu_fetch("user:249"), apcu_fetch("other"));
+
+/* the second export follows the first one on the stream */
+apcu_clear_cache();
+var_dump(apcu_import($stream), apcu_exists("other"));
+var_dump(@apcu_import($stream));
+
+$garbage = fopen("php://memory", "w+");
+fwrite($garbage, "not a snapshot");
+rewind($garbage);
+var_dump(@apcu_import($garbage));
+?>
+--EXPECT--
+int(251)
+int(10)
+int(251)
+int(251)
+array(1) {
+  ["id"]=>
+  int(249)
+}
+string(1) "x"
+int(10)
+bool(false)
+bool(false)
+bool(false)
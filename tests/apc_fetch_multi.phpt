@@ -0,0 +1,55 @@
+--TEST--
+APC: apcu_fetch with an array of keys
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=0
+--FILE--
+<?php
+$keys = [];
+for ($i = 0; $i < 200; $i++) {
+    apcu_store("key$i", $i % 2 ? str_repeat("x", 5000) : [$i]);
+    $keys[] = "key$i";
+}
+apcu_store("expired", 1, 1);
+sleep(2);
+
+$values = apcu_fetch($keys, $success);
+var_dump($success, count($values), array_keys($values) === $keys);
+var_dump($values["key10"], strlen($values["key11"]));
+
+var_dump(apcu_fetch(["key2", "missing", "expired", "key2", "key1" . "0"]));
+var_dump(apcu_fetch([]));
+var_dump(array_keys(apcu_fetch(["key3", 42])));
+?>
+--EXPECTF--
+bool(true)
+int(200)
+bool(true)
+array(1) {
+  [0]=>
+  int(10)
+}
+int(5000)
+array(2) {
+  ["key2"]=>
+  array(1) {
+    [0]=>
+    int(2)
+  }
+  ["key10"]=>
+  array(1) {
+    [0]=>
+    int(10)
+  }
+}
+array(0) {
+}
+
+Warning: apcu_fetch(): apc_fetch() expects a string or array of strings. in %s on line %d
+array(1) {
+  [0]=>
+  string(4) "key3"
+}
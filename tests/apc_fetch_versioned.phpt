@@ -0,0 +1,74 @@
+--TEST--
+APC: apcu_fetch_versioned, apcu_fetch_if_changed and apcu_store_if_version
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+
+var_dump(apcu_fetch_versioned("list", $version), $version);
+
+/* version 0 stores only if there is no entry yet */
+var_dump(apcu_store_if_version("list", [1], 0));
+var_dump(apcu_store_if_version("list", [2], 0));
+
+$list = apcu_fetch_versioned("list", $version);
+var_dump($list, $version > 0);
+
+/* optimistic update, the second one lost the race */
+$list[] = 2;
+var_dump(apcu_store_if_version("list", $list, $version));
+var_dump(apcu_store_if_version("list", [3], $version));
+var_dump(apcu_fetch("list"));
+
+/* nothing is fetched while the version is current */
+apcu_fetch_versioned("list", $version);
+$known = $version;
+var_dump(apcu_fetch_if_changed("list", $known), $known === $version);
+apcu_store("list", [4]);
+var_dump(apcu_fetch_if_changed("list", $known), $known > $version);
+
+/* updates in place give a new version too */
+apcu_store("counter", 1);
+apcu_fetch_versioned("counter", $version);
+apcu_inc("counter");
+var_dump(apcu_fetch_if_changed("counter", $version));
+var_dump(apcu_cas("counter", 2, 5), apcu_fetch_if_changed("counter", $version));
+
+apcu_delete("list");
+var_dump(apcu_fetch_if_changed("list", $known), $known);
+?>
+===DONE===
+--EXPECT--
+bool(false)
+int(0)
+bool(true)
+bool(false)
+array(1) {
+  [0]=>
+  int(1)
+}
+bool(true)
+bool(true)
+bool(false)
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+bool(false)
+bool(true)
+array(1) {
+  [0]=>
+  int(4)
+}
+bool(true)
+int(2)
+bool(true)
+int(5)
+bool(false)
+int(0)
+===DONE===
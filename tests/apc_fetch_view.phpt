@@ -0,0 +1,95 @@
+--TEST--
+APC: apcu_fetch_view and apcu_fetch_path
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.serializer=default
+--FILE--
+<?php
+
+$map = [];
+for ($i = 0; $i < 1000; $i++) {
+	$map["k$i"] = ["id" => $i, "tags" => ["t$i", "u$i"]];
+}
+$map[42] = "answer";
+apcu_store("map", $map);
+apcu_store("scalar", 5);
+
+$view = apcu_fetch_view("map");
+var_dump(get_class($view), count($view));
+var_dump($view["k7"]["tags"][1], $view[42], $view["42"], $view["nope"]);
+var_dump(isset($view["k999"]), isset($view["k1000"]), empty($view["k0"]["id"]));
+
+/* the view outlives the entry */
+apcu_delete("map");
+var_dump($view["k500"]["id"]);
+
+try {
+	$view["k1"] = 1;
+} catch (Error $e) {
+	echo $e->getMessage(), "\n";
+}
+try {
+	unset($view["k1"]);
+} catch (Error $e) {
+	echo $e->getMessage(), "\n";
+}
+
+$n = 0;
+foreach ($view as $key => $value) {
+	if ($n++ < 2 || $key === 42) {
+		var_dump($key, $value === $map[$key]);
+	}
+}
+var_dump($n);
+
+var_dump(apcu_fetch_view("map"), apcu_fetch_view("scalar"));
+
+apcu_store("map", $map);
+var_dump(apcu_fetch_path("map", ["k3", "tags", 0]));
+var_dump(apcu_fetch_path("map", ["k3", "tags"]));
+var_dump(apcu_fetch_path("map", []) === $map);
+var_dump(apcu_fetch_path("map", ["k3", "id", "x"], $success), $success);
+var_dump(apcu_fetch_path("missing", ["k3"], $success), $success);
+var_dump(apcu_fetch_path("map", ["42"], $success), $success);
+?>
+===DONE===
+--EXPECT--
+string(13) "APCUArrayView"
+int(1001)
+string(2) "u7"
+string(6) "answer"
+string(6) "answer"
+NULL
+bool(true)
+bool(false)
+bool(true)
+int(500)
+APCUArrayView is read-only
+APCUArrayView is read-only
+string(2) "k0"
+bool(true)
+string(2) "k1"
+bool(true)
+int(42)
+bool(true)
+int(1001)
+bool(false)
+bool(false)
+string(2) "t3"
+array(2) {
+  [0]=>
+  string(2) "t3"
+  [1]=>
+  string(2) "u3"
+}
+bool(true)
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+string(6) "answer"
+bool(true)
+===DONE===
@@ -0,0 +1,54 @@
+--TEST--
+APC: apcu_fetch_view over empty arrays and past apc.gc_ttl
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.serializer=default
+apc.gc_ttl=1
+--FILE--
+<?php
+
+apcu_store("empty", []);
+apcu_store("nested", ["a" => [], "b" => ["c" => []]]);
+
+$view = apcu_fetch_view("empty");
+var_dump(count($view), isset($view["a"]), isset($view[0]), $view["a"] ?? "none");
+foreach ($view as $value) {
+	echo "unexpected\n";
+}
+
+var_dump(apcu_fetch_path("nested", ["a", "x"], $success), $success);
+var_dump(apcu_fetch_path("nested", ["b", "c", 0], $success), $success);
+var_dump(apcu_fetch_path("nested", ["b", "c"]));
+
+/* the view keeps its entry after the gc frees the others */
+$view = apcu_fetch_view("nested");
+apcu_store("nested", "replaced");
+sleep(2);
+for ($i = 0; $i < 16; $i++) {
+	apcu_store("fill$i", ["x" => [1, 2], "y" => [3, 4]]);
+}
+var_dump(count($view), isset($view["a"][0]), $view["b"]);
+?>
+===DONE===
+--EXPECT--
+int(0)
+bool(false)
+bool(false)
+string(4) "none"
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+array(0) {
+}
+int(2)
+bool(false)
+array(1) {
+  ["c"]=>
+  array(0) {
+  }
+}
+===DONE===
@@ -0,0 +1,32 @@
+--TEST--
+APC: per-entry hit counters are exact for cold entries and sampled for hot ones
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+apcu_store("cold", "value");
+apcu_store("hot", "value");
+
+for ($i = 0; $i < 10; $i++) {
+	apcu_fetch("cold");
+}
+
+for ($i = 0; $i < 100000; $i++) {
+	apcu_fetch("hot");
+}
+
+$cold = apcu_key_info("cold");
+$hot = apcu_key_info("hot");
+var_dump($cold["hits"]);
+var_dump($hot["hits"] > 50000 && $hot["hits"] < 200000);
+var_dump($cold["access_time"] >= $cold["creation_time"]);
+?>
+===DONE===
+--EXPECT--
+int(10)
+bool(true)
+bool(true)
+===DONE===
@@ -0,0 +1,35 @@
+--TEST--
+APC: hits are exact up to the sampling boundary and the access time follows the clock
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=0
+--FILE--
+<?php
+apcu_store("key", "value");
+
+for ($i = 0; $i < 64; $i++) {
+	apcu_fetch("key");
+}
+var_dump(apcu_key_info("key")["hits"]);
+
+/* the first sampled hit counts two or nothing */
+apcu_fetch("key");
+var_dump(in_array(apcu_key_info("key")["hits"], [64, 66], true));
+
+/* the access time has second resolution and moves once the clock has */
+$atime = apcu_key_info("key")["access_time"];
+sleep(2);
+apcu_fetch("key");
+$info = apcu_key_info("key");
+var_dump($info["access_time"] > $atime, $info["access_time"] >= time() - 1);
+?>
+===DONE===
+--EXPECT--
+int(64)
+bool(true)
+bool(true)
+bool(true)
+===DONE===
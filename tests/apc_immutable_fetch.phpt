@@ -0,0 +1,131 @@
+--TEST--
+APC: apc.immutable_fetch returns values without copying them
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_VERSION_ID < 70300) die('skip Requires PHP >= 7.3.0');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.serializer=default
+apc.immutable_fetch=1
+--FILE--
+<?php
+
+apcu_store("str", "hello world");
+apcu_store("arr", ["a" => [1, 2, 3], "b" => "two", 5 => 5.5]);
+$shared = [1, 2];
+$ref = 1;
+apcu_store("ref", [&$ref, $shared, $shared]);
+
+/* changes are made on a copy */
+$arr = apcu_fetch("arr");
+$arr["a"][] = 4;
+$arr["c"] = "new";
+unset($arr["b"]);
+var_dump($arr);
+var_dump(apcu_fetch("arr"));
+
+$str = apcu_fetch("str");
+$str .= "!";
+var_dump($str, apcu_fetch("str"));
+
+/* fetched values outlive the entry */
+$arr = apcu_fetch("arr");
+apcu_delete("arr");
+apcu_store("arr", "replaced");
+foreach ($arr["a"] as $k => $v) {
+	echo "$k => $v\n";
+}
+var_dump(apcu_fetch("arr"));
+
+/* references are copied */
+$ref = apcu_fetch("ref");
+$ref[0] = 2;
+var_dump($ref);
+
+var_dump(apcu_fetch(["str", "missing", "ref"]));
+?>
+===DONE===
+--EXPECT--
+array(3) {
+  ["a"]=>
+  array(4) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+    [2]=>
+    int(3)
+    [3]=>
+    int(4)
+  }
+  [5]=>
+  float(5.5)
+  ["c"]=>
+  string(3) "new"
+}
+array(3) {
+  ["a"]=>
+  array(3) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+    [2]=>
+    int(3)
+  }
+  ["b"]=>
+  string(3) "two"
+  [5]=>
+  float(5.5)
+}
+string(12) "hello world!"
+string(11) "hello world"
+0 => 1
+1 => 2
+2 => 3
+string(8) "replaced"
+array(3) {
+  [0]=>
+  int(2)
+  [1]=>
+  array(2) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+  }
+  [2]=>
+  array(2) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+  }
+}
+array(2) {
+  ["str"]=>
+  string(11) "hello world"
+  ["ref"]=>
+  array(3) {
+    [0]=>
+    int(1)
+    [1]=>
+    array(2) {
+      [0]=>
+      int(1)
+      [1]=>
+      int(2)
+    }
+    [2]=>
+    array(2) {
+      [0]=>
+      int(1)
+      [1]=>
+      int(2)
+    }
+  }
+}
+===DONE===
@@ -0,0 +1,43 @@
+--TEST--
+APC: apc.immutable_fetch with values containing the key string
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_VERSION_ID < 70300) die('skip Requires PHP >= 7.3.0');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.serializer=default
+apc.immutable_fetch=1
+--FILE--
+<?php
+
+$key = str_repeat("k", 8);
+apcu_store($key, [$key, "name" => $key, $key => [$key]]);
+apcu_store("short", ["short"]);
+
+/* strings shared with the key are as immutable as the rest of the value */
+for ($i = 0; $i < 100; $i++) {
+	$arr = apcu_fetch($key);
+	$s = $arr[0];
+	$t = $arr["name"];
+	$u = $arr[$key][0];
+	unset($s, $t, $u, $arr);
+
+	$arr = apcu_fetch("short");
+	$s = $arr[0];
+	unset($s, $arr);
+}
+
+var_dump(apcu_fetch($key) === [$key, "name" => $key, $key => [$key]]);
+var_dump(apcu_fetch("short"));
+?>
+===DONE===
+--EXPECT--
+bool(true)
+array(1) {
+  [0]=>
+  string(5) "short"
+}
+===DONE===
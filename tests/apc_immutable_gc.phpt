@@ -0,0 +1,54 @@
+--TEST--
+APC: values returned by apc.immutable_fetch outlive apc.gc_ttl
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_VERSION_ID < 70300) die('skip Requires PHP >= 7.3.0');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.serializer=default
+apc.immutable_fetch=1
+apc.gc_ttl=1
+--FILE--
+<?php
+
+apcu_store("arr", ["a" => [1, 2, 3], "b" => str_repeat("x", 32)]);
+apcu_store("str", str_repeat("y", 32));
+
+$arr = apcu_fetch("arr");
+$str = apcu_fetch("str");
+
+/* the old entries go to the gc list, still referenced */
+apcu_store("arr", "replaced");
+apcu_store("str", "replaced");
+
+/* past apc.gc_ttl, the next insertions run the gc and reuse freed memory */
+sleep(2);
+for ($i = 0; $i < 16; $i++) {
+	apcu_store("fill$i", ["a" => [7, 8, 9], "b" => str_repeat("z", 32)]);
+}
+
+var_dump($arr, $str);
+var_dump(apcu_fetch("arr"), apcu_fetch("str"));
+?>
+===DONE===
+--EXPECT--
+array(2) {
+  ["a"]=>
+  array(3) {
+    [0]=>
+    int(1)
+    [1]=>
+    int(2)
+    [2]=>
+    int(3)
+  }
+  ["b"]=>
+  string(32) "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+}
+string(32) "yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy"
+string(8) "replaced"
+string(8) "replaced"
+===DONE===
@@ -0,0 +1,54 @@
+--TEST--
+APC: apc.local_size keeps fetched values until their entry changes
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_VERSION_ID < 70300) die('skip Requires PHP >= 7.3.0');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.local_size=1M
+--FILE--
+<?php
+
+apcu_store("arr", ["a" => [1, 2], "b" => "two"]);
+apcu_store("obj", [new ArrayObject([1])]);
+apcu_store("big", str_repeat("x", 2 * 1024 * 1024));
+
+/* the second fetch is served locally, changes are made on a copy */
+$arr = apcu_fetch("arr");
+$arr["a"][] = 3;
+var_dump($arr["a"], apcu_fetch("arr") === ["a" => [1, 2], "b" => "two"]);
+
+/* a new entry replaces the local value, those fetched before are left as they were */
+$old = apcu_fetch("arr");
+apcu_store("arr", "replaced");
+var_dump(apcu_fetch("arr"), $old["b"]);
+
+apcu_delete("arr");
+var_dump(apcu_fetch("arr"));
+
+/* values holding objects or larger than apc.local_size are copied as usual */
+var_dump(get_class(apcu_fetch("obj")[0]), get_class(apcu_fetch("obj")[0]));
+var_dump(strlen(apcu_fetch("big")), strlen(apcu_fetch("big")));
+?>
+===DONE===
+--EXPECT--
+array(3) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+  [2]=>
+  int(3)
+}
+bool(true)
+string(8) "replaced"
+string(3) "two"
+bool(false)
+string(11) "ArrayObject"
+string(11) "ArrayObject"
+int(2097152)
+int(2097152)
+===DONE===
@@ -0,0 +1,53 @@
+--TEST--
+APC: apc.persist_file keeps entries across restarts
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_OS == "WINNT") die("skip not on windows");
+if (ini_get('apc.persist_file') === false) die("skip mmap support required");
+?>
+--FILE--
+<?php
+$file = __DIR__ . '/apc_persist_file.data';
+@unlink($file);
+
+$php = getenv('TEST_PHP_EXECUTABLE');
+$args = "-n -d extension_dir=" . __DIR__ . "/../modules -d extension=apcu.so"
+	. " -d apc.enable_cli=1 -d apc.shm_size=8M -d apc.persist_file=" . escapeshellarg($file);
+
+function run($args, $code) {
+	global $php;
+	echo shell_exec("$php $args -r " . escapeshellarg($code));
+}
+
+run($args, 'var_dump(apcu_store("foo", ["bar" => [1, 2.5, "baz"]]), apcu_store("ttl", 1, 1000));');
+run($args, 'var_dump(apcu_fetch("foo"), apcu_exists("ttl"), apcu_store("qux", []));');
+run($args, 'var_dump(apcu_fetch("qux"), apcu_cache_info(true)["num_entries"]);');
+
+/* a different layout starts out empty */
+run("$args -d apc.entries_hint=100", 'var_dump(apcu_fetch("foo"));');
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/apc_persist_file.data');
+?>
+--EXPECT--
+bool(true)
+bool(true)
+array(1) {
+  ["bar"]=>
+  array(3) {
+    [0]=>
+    int(1)
+    [1]=>
+    float(2.5)
+    [2]=>
+    string(3) "baz"
+  }
+}
+bool(true)
+bool(true)
+array(0) {
+}
+int(3)
+bool(false)
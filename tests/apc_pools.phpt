@@ -0,0 +1,45 @@
+--TEST--
+APC: named pools
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.pools=sessions:4M,counters:1M
+--FILE--
+<?php
+apcu_store("key", "default");
+
+var_dump(apcu_select_pool("sessions"));
+var_dump(apcu_fetch("key"));
+apcu_store("key", "sessions");
+$info = apcu_sma_info(true);
+var_dump($info["seg_size"] <= 4 * 1024 * 1024);
+
+var_dump(apcu_select_pool("counters"));
+var_dump(apcu_inc("key"));
+var_dump(iterator_count(new APCUIterator()));
+
+var_dump(apcu_select_pool("default"));
+var_dump(apcu_fetch("key"));
+apcu_clear_cache();
+
+var_dump(apcu_select_pool("sessions"));
+var_dump(apcu_fetch("key"));
+
+var_dump(apcu_select_pool("missing"));
+?>
+--EXPECTF--
+bool(true)
+bool(false)
+bool(true)
+bool(true)
+int(1)
+int(1)
+bool(true)
+string(7) "default"
+bool(true)
+string(8) "sessions"
+
+Warning: apcu_select_pool(): Pool 'missing' is not defined in apc.pools in %s on line %d
+bool(false)
@@ -0,0 +1,47 @@
+--TEST--
+APC: apcu_delete_prefix and apcu_fetch_prefix (with index)
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.prefix_index=1
+--FILE--
+<?php
+apcu_store("user:1:name", "alice");
+apcu_store("user:1:mail", "alice@example.com");
+apcu_store("user:10:name", "bob");
+apcu_store("user:2:name", "carol");
+apcu_store("users", 3);
+apcu_store("post:1", "hello");
+
+$users = apcu_fetch_prefix("user:1");
+ksort($users);
+var_dump($users);
+var_dump(apcu_fetch_prefix("nothing"));
+
+var_dump(apcu_delete_prefix("user:1:"));
+var_dump(apcu_exists("user:1:name"), apcu_exists("user:10:name"));
+var_dump(apcu_delete_prefix("user"));
+var_dump(apcu_cache_info(true)["num_entries"]);
+var_dump(apcu_delete_prefix(""));
+var_dump(apcu_fetch("post:1"));
+?>
+--EXPECT--
+array(3) {
+  ["user:1:mail"]=>
+  string(17) "alice@example.com"
+  ["user:1:name"]=>
+  string(5) "alice"
+  ["user:10:name"]=>
+  string(3) "bob"
+}
+array(0) {
+}
+int(2)
+bool(false)
+bool(true)
+int(3)
+int(1)
+int(1)
+bool(false)
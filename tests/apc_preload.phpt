@@ -0,0 +1,50 @@
+--TEST--
+APC: apc.preload_path loads data files in batches
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_OS == "WINNT") die("skip not on windows");
+?>
+--FILE--
+<?php
+$dir = __DIR__ . '/apc_preload';
+@mkdir($dir);
+for ($i = 0; $i < 300; $i++) {
+	file_put_contents("$dir/key$i.data", serialize(["n" => $i]));
+}
+file_put_contents("$dir/broken.data", "a:1:{");
+file_put_contents("$dir/empty.data", "");
+file_put_contents("$dir/ignored.txt", serialize(1));
+
+$php = getenv('TEST_PHP_EXECUTABLE');
+$args = "-n -d extension_dir=" . __DIR__ . "/../modules -d extension=apcu.so"
+	. " -d apc.enable_cli=1 -d apc.preload_path=" . escapeshellarg($dir);
+
+$code = 'var_dump(apcu_cache_info(true)["num_entries"], apcu_fetch("key0"), apcu_fetch("key299")["n"], apcu_exists(["broken", "empty", "ignored"]));';
+foreach ([0, 3] as $threads) {
+	echo shell_exec("$php $args -d apc.preload_threads=$threads -r " . escapeshellarg($code));
+}
+?>
+--CLEAN--
+<?php
+$dir = __DIR__ . '/apc_preload';
+array_map('unlink', glob("$dir/*"));
+@rmdir($dir);
+?>
+--EXPECT--
+int(300)
+array(1) {
+  ["n"]=>
+  int(0)
+}
+int(299)
+array(0) {
+}
+int(300)
+array(1) {
+  ["n"]=>
+  int(0)
+}
+int(299)
+array(0) {
+}
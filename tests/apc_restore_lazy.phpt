@@ -0,0 +1,59 @@
+--TEST--
+APC: apc.restore_lazy loads snapshot entries on first access
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_OS == "WINNT") die("skip not on windows");
+if (ini_get('apc.restore_lazy') === false) die("skip mmap support required");
+?>
+--FILE--
+<?php
+$file = __DIR__ . '/apc_restore_lazy.snapshot';
+@unlink($file);
+
+$php = getenv('TEST_PHP_EXECUTABLE');
+$args = "-n -d extension_dir=" . __DIR__ . "/../modules -d extension=apcu.so -d apc.enable_cli=1";
+
+function run($args, $code) {
+	global $php;
+	echo shell_exec("$php $args -r " . escapeshellarg($code));
+}
+
+run($args, '
+	apcu_store(["a" => 1, "b" => [2, "two"], "c" => 3, "p:1" => "x", "p:2" => "y"]);
+	var_dump(apcu_dump(' . var_export($file, true) . '));
+');
+
+run("$args -d apc.restore_lazy=1 -d apc.restore_file=" . escapeshellarg($file), '
+	var_dump(apcu_cache_info(true)["num_entries"]);
+	var_dump(apcu_fetch("b"), apcu_cache_info(true)["num_entries"]);
+	var_dump(apcu_delete("a"), apcu_fetch("a"));
+	var_dump(apcu_store("c", "new"), apcu_fetch("c"));
+	var_dump(apcu_inc("missing"), apcu_fetch_prefix("p:"));
+');
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/apc_restore_lazy.snapshot');
+?>
+--EXPECT--
+int(5)
+int(0)
+array(2) {
+  [0]=>
+  int(2)
+  [1]=>
+  string(3) "two"
+}
+int(1)
+bool(false)
+bool(false)
+bool(true)
+string(3) "new"
+int(1)
+array(2) {
+  ["p:1"]=>
+  string(1) "x"
+  ["p:2"]=>
+  string(1) "y"
+}
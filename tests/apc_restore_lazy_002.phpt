@@ -0,0 +1,56 @@
+--TEST--
+APC: apc.restore_lazy matches, invalidates and dumps snapshot entries without loading them
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_OS == "WINNT") die("skip not on windows");
+if (ini_get('apc.restore_lazy') === false) die("skip mmap support required");
+?>
+--FILE--
+<?php
+$file = __DIR__ . '/apc_restore_lazy_002.snapshot';
+$copy = __DIR__ . '/apc_restore_lazy_002.copy.snapshot';
+@unlink($file);
+@unlink($copy);
+
+$php = getenv('TEST_PHP_EXECUTABLE');
+$args = "-n -d extension_dir=" . __DIR__ . "/../modules -d extension=apcu.so -d apc.enable_cli=1";
+
+function run($args, $code) {
+	global $php;
+	echo shell_exec("$php $args -r " . escapeshellarg($code));
+}
+
+run($args, '
+	apcu_store(["a" => 1, "d:1" => 2, "d:2" => 3]);
+	apcu_store("t1", "one", 0, ["red"]);
+	apcu_store("t2", "two", 0, ["blue"]);
+	var_dump(apcu_dump(' . var_export($file, true) . '));
+');
+
+run("$args -d apc.restore_lazy=1 -d apc.restore_file=" . escapeshellarg($file), '
+	apcu_delete(new APCUIterator("/^d:/"));
+	var_dump(apcu_invalidate_tags(["red"]));
+	var_dump(apcu_cache_info(true)["num_entries"]);
+	var_dump(apcu_dump(' . var_export($copy, true) . '), apcu_cache_info(true)["num_entries"]);
+');
+
+run("$args -d apc.restore_file=" . escapeshellarg($copy), '
+	var_dump(apcu_fetch("a"), apcu_fetch("t2"), apcu_exists(["d:1", "d:2", "t1"]));
+');
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/apc_restore_lazy_002.snapshot');
+@unlink(__DIR__ . '/apc_restore_lazy_002.copy.snapshot');
+?>
+--EXPECT--
+int(5)
+int(1)
+int(0)
+int(2)
+int(0)
+int(1)
+string(3) "two"
+array(0) {
+}
@@ -0,0 +1,53 @@
+--TEST--
+APC: apc.shm_name shares the cache between running processes
+--SKIPIF--
+<?php
+require_once(dirname(__FILE__) . '/skipif.inc');
+if (PHP_OS == "WINNT") die("skip not on windows");
+if (ini_get('apc.shm_name') === false) die("skip mmap support required");
+?>
+--FILE--
+<?php
+$file = __DIR__ . '/apc_shm_name.data';
+@unlink($file);
+
+$php = getenv('TEST_PHP_EXECUTABLE');
+$args = "-n -d extension_dir=" . __DIR__ . "/../modules -d extension=apcu.so"
+	. " -d apc.enable_cli=1 -d apc.shm_name=" . escapeshellarg($file);
+
+function run($args, $code) {
+	global $php;
+	echo shell_exec("$php $args -r " . escapeshellarg($code) . " 2>&1");
+}
+
+/* the first process stays alive until told to look at what the second one stored */
+$owner = proc_open("$php $args -d apc.shm_size=8M -r " . escapeshellarg('
+	apcu_store("foo", [1, 2]);
+	echo "ready\n";
+	fgets(STDIN);
+	var_dump(apcu_fetch("bar"));
+'), [["pipe", "r"], ["pipe", "w"]], $pipes);
+echo fgets($pipes[1]);
+
+run("$args -d apc.shm_size=8M", 'var_dump(apcu_fetch("foo"), apcu_store("bar", "baz"));');
+run("$args -d apc.shm_size=16M", 'var_dump(apcu_fetch("foo"));');
+
+fwrite($pipes[0], "\n");
+echo stream_get_contents($pipes[1]);
+proc_close($owner);
+?>
+--CLEAN--
+<?php
+@unlink(__DIR__ . '/apc_shm_name.data');
+?>
+--EXPECTF--
+ready
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+bool(true)
+%AFatal error: apc_sma_init_file: %s is in use with a different apc.shm_size%A
+string(3) "baz"
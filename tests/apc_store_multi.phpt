@@ -0,0 +1,43 @@
+--TEST--
+APC: apcu_store and apcu_add with an array of keys
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+$values = [];
+for ($i = 0; $i < 5000; $i++) {
+    $values["key$i"] = $i % 3 ? $i : ["value" => $i];
+}
+
+var_dump(apcu_store($values, null, 0, ["bulk"]));
+var_dump(apcu_cache_info(true)["num_entries"]);
+var_dump(apcu_fetch("key4999"), apcu_fetch("key3"));
+
+var_dump(apcu_add(["key1" => "new", "key5000" => "new", 7 => "int"]));
+var_dump(apcu_fetch("key1"), apcu_fetch("key5000"), apcu_fetch("7"));
+
+var_dump(apcu_invalidate_tags(["bulk"]));
+var_dump(apcu_store([]));
+?>
+--EXPECT--
+array(0) {
+}
+int(5000)
+int(4999)
+array(1) {
+  ["value"]=>
+  int(3)
+}
+array(1) {
+  ["key1"]=>
+  int(-1)
+}
+int(1)
+string(3) "new"
+string(3) "int"
+int(5000)
+array(0) {
+}
@@ -0,0 +1,38 @@
+--TEST--
+APC: apcu_store with tags and apcu_invalidate_tags
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+apcu_store("user:1", "alice", 0, ["users", "team:a"]);
+apcu_store("user:2", "bob", 0, ["users", "team:b", "users"]);
+apcu_store(["post:1" => "hello", "post:2" => "world"], null, 0, ["posts", "team:a"]);
+apcu_add("plain", "untagged");
+
+var_dump(apcu_invalidate_tags(["team:a"]));
+var_dump(apcu_exists("user:1"), apcu_exists("post:1"), apcu_exists("post:2"));
+var_dump(apcu_fetch("user:2"));
+
+/* overwriting an entry drops its old tags */
+apcu_store("user:2", "bob", 0, ["team:c"]);
+var_dump(apcu_invalidate_tags(["users", "team:b"]));
+var_dump(apcu_invalidate_tags(["team:c", "unknown"]));
+var_dump(apcu_invalidate_tags([]));
+
+var_dump(apcu_cache_info(true)["num_entries"]);
+var_dump(apcu_fetch("plain"));
+?>
+--EXPECT--
+int(3)
+bool(false)
+bool(false)
+bool(false)
+string(3) "bob"
+int(0)
+int(1)
+int(0)
+int(1)
+string(8) "untagged"